@@ -0,0 +1,191 @@
+#include "alloc_trace.h"
+
+#include <atomic>
+#include <new>
+#include <cstdlib> // malloc, free, abort
+#include <cstdio>
+#include <cstdint>
+
+//
+// This replaces global new/delete for EVERY cpp file in the exe it is linked into.
+//
+// Every block gets a little header in front of it (the size that was asked for, and where malloc's block really starts)
+// so delete knows what it is deleting, without having to look anything up.
+//
+namespace alloc_trace
+{
+    namespace
+    {
+        struct Header
+        {
+            void * raw; // what malloc gave us
+            std::size_t size; // what was asked for
+        };
+
+        // plain data, so no dynamic initialization and no destructor
+        // (ie it is safe to use from operator new, even while threads start and stop)
+        thread_local counts threadCounts;
+
+        struct AtomicCounts
+        {
+            std::atomic<std::size_t> allocations{ 0 };
+            std::atomic<std::size_t> deallocations{ 0 };
+            std::atomic<std::size_t> bytes_allocated{ 0 };
+            std::atomic<std::size_t> bytes_deallocated{ 0 };
+            std::atomic<std::size_t> by_size_class[num_size_classes] = {};
+        };
+        // constant initialized (so it is ready before any other static initializer calls new)
+        AtomicCounts processCounts;
+
+        std::atomic<failure_handler> failureHandler{ nullptr };
+
+        void default_failure_handler(char const * what, counts const & seen)
+        {
+            std::fprintf(stderr, "%s: %zu unexpected allocation(s), %zu bytes\n", what, seen.allocations, seen.bytes_allocated);
+            std::abort();
+        }
+
+        void record_allocation(std::size_t size)
+        {
+            std::size_t c = size_class(size);
+            threadCounts.allocations++;
+            threadCounts.bytes_allocated += size;
+            threadCounts.by_size_class[c]++;
+            processCounts.allocations.fetch_add(1, std::memory_order_relaxed);
+            processCounts.bytes_allocated.fetch_add(size, std::memory_order_relaxed);
+            processCounts.by_size_class[c].fetch_add(1, std::memory_order_relaxed);
+        }
+        void record_deallocation(std::size_t size)
+        {
+            threadCounts.deallocations++;
+            threadCounts.bytes_deallocated += size;
+            processCounts.deallocations.fetch_add(1, std::memory_order_relaxed);
+            processCounts.bytes_deallocated.fetch_add(size, std::memory_order_relaxed);
+        }
+
+        void * try_allocate(std::size_t size, std::size_t align) noexcept
+        {
+            if (align < alignof(Header))
+                align = alignof(Header);
+            // room for the header, plus enough to slide the block up to alignment
+            std::size_t total = size + sizeof(Header) + align - 1;
+            if (total < size)
+                return nullptr; // overflow
+            void * raw = std::malloc(total);
+            if (!raw)
+                return nullptr;
+            std::uintptr_t p = (reinterpret_cast<std::uintptr_t>(raw) + sizeof(Header) + align - 1) & ~(std::uintptr_t)(align - 1);
+            Header * header = reinterpret_cast<Header *>(p) - 1;
+            header->raw = raw;
+            header->size = size;
+            record_allocation(size);
+            return reinterpret_cast<void *>(p);
+        }
+
+        void * allocate(std::size_t size, std::size_t align)
+        {
+            for (;;)
+            {
+                if (void * p = try_allocate(size, align))
+                    return p;
+                // required by [new.delete.single]: call the new_handler until it gives up
+                std::new_handler handler = std::get_new_handler();
+                if (!handler)
+                    throw std::bad_alloc();
+                handler();
+            }
+        }
+
+        void deallocate(void * p) noexcept
+        {
+            if (!p)
+                return;
+            Header * header = static_cast<Header *>(p) - 1;
+            record_deallocation(header->size);
+            std::free(header->raw);
+        }
+
+        constexpr std::size_t default_align = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+    }
+
+    counts this_thread()
+    {
+        return threadCounts;
+    }
+
+    counts all_threads()
+    {
+        counts c;
+        c.allocations = processCounts.allocations.load(std::memory_order_relaxed);
+        c.deallocations = processCounts.deallocations.load(std::memory_order_relaxed);
+        c.bytes_allocated = processCounts.bytes_allocated.load(std::memory_order_relaxed);
+        c.bytes_deallocated = processCounts.bytes_deallocated.load(std::memory_order_relaxed);
+        for (std::size_t i = 0; i < num_size_classes; i++)
+            c.by_size_class[i] = processCounts.by_size_class[i].load(std::memory_order_relaxed);
+        return c;
+    }
+
+    failure_handler set_failure_handler(failure_handler handler)
+    {
+        return failureHandler.exchange(handler);
+    }
+
+    no_allocations::~no_allocations()
+    {
+        counts seen = s.so_far();
+        if (seen.allocations)
+        {
+            failure_handler handler = failureHandler.load();
+            (handler ? handler : &default_failure_handler)(what, seen);
+        }
+    }
+}
+
+// the replacements (no inline, required by [replacement.functions]/3)
+
+void * operator new(std::size_t size)
+{
+    return alloc_trace::allocate(size, alloc_trace::default_align);
+}
+void * operator new[](std::size_t size)
+{
+    return alloc_trace::allocate(size, alloc_trace::default_align);
+}
+void * operator new(std::size_t size, std::nothrow_t const &) noexcept
+{
+    return alloc_trace::try_allocate(size, alloc_trace::default_align);
+}
+void * operator new[](std::size_t size, std::nothrow_t const &) noexcept
+{
+    return alloc_trace::try_allocate(size, alloc_trace::default_align);
+}
+void * operator new(std::size_t size, std::align_val_t align)
+{
+    return alloc_trace::allocate(size, static_cast<std::size_t>(align));
+}
+void * operator new[](std::size_t size, std::align_val_t align)
+{
+    return alloc_trace::allocate(size, static_cast<std::size_t>(align));
+}
+void * operator new(std::size_t size, std::align_val_t align, std::nothrow_t const &) noexcept
+{
+    return alloc_trace::try_allocate(size, static_cast<std::size_t>(align));
+}
+void * operator new[](std::size_t size, std::align_val_t align, std::nothrow_t const &) noexcept
+{
+    return alloc_trace::try_allocate(size, static_cast<std::size_t>(align));
+}
+
+// every block knows its own size, so all the deletes are the same
+void operator delete(void * p) noexcept { alloc_trace::deallocate(p); }
+void operator delete[](void * p) noexcept { alloc_trace::deallocate(p); }
+void operator delete(void * p, std::size_t) noexcept { alloc_trace::deallocate(p); }
+void operator delete[](void * p, std::size_t) noexcept { alloc_trace::deallocate(p); }
+void operator delete(void * p, std::nothrow_t const &) noexcept { alloc_trace::deallocate(p); }
+void operator delete[](void * p, std::nothrow_t const &) noexcept { alloc_trace::deallocate(p); }
+void operator delete(void * p, std::align_val_t) noexcept { alloc_trace::deallocate(p); }
+void operator delete[](void * p, std::align_val_t) noexcept { alloc_trace::deallocate(p); }
+void operator delete(void * p, std::size_t, std::align_val_t) noexcept { alloc_trace::deallocate(p); }
+void operator delete[](void * p, std::size_t, std::align_val_t) noexcept { alloc_trace::deallocate(p); }
+void operator delete(void * p, std::align_val_t, std::nothrow_t const &) noexcept { alloc_trace::deallocate(p); }
+void operator delete[](void * p, std::align_val_t, std::nothrow_t const &) noexcept { alloc_trace::deallocate(p); }
@@ -0,0 +1,148 @@
+#ifndef alloc_trace_h_INCLUDED
+#define alloc_trace_h_INCLUDED
+
+#include <array>
+#include <cstddef>
+#include <utility>
+
+//
+// Counting heap allocations, so tests and benchmarks can say "this doesn't touch the heap" and mean it.
+//
+// Link alloc_trace.cpp into the exe (ONE exe, it replaces global operator new/delete for everything in it)
+// and then:
+//
+//    alloc_trace::scope s;
+//    ... stuff ...
+//    EXPECT_EQ(0u, s.so_far().allocations);
+//
+// or
+//
+//    EXPECT_EQ(0u, alloc_trace::count([&] { stuff(); }).allocations);
+//
+// or, in a hot path (in an instrumented build), fail loudly if it ever allocates:
+//
+//    alloc_trace::no_allocations guard("render loop");
+//
+// Counts are kept per thread (so other threads allocating don't make your test flaky),
+// and also in total for the process. Each allocation is also counted in a size class (a histogram by powers of 2).
+// Since every allocation remembers its own size, deletes are counted exactly (and in O(1)).
+//
+namespace alloc_trace
+{
+    // size class c holds sizes in [2^(c+3), 2^(c+4)) - ie 0-15, 16-31, 32-63, ... - with the last one holding everything bigger
+    constexpr std::size_t num_size_classes = 16;
+
+    inline std::size_t size_class(std::size_t bytes)
+    {
+        std::size_t c = 0;
+        for (bytes >>= 4; bytes && c + 1 < num_size_classes; bytes >>= 1)
+            c++;
+        return c;
+    }
+    // smallest size in class c
+    inline std::size_t size_class_min(std::size_t c)
+    {
+        return c ? std::size_t(8) << c : 0;
+    }
+
+    struct counts
+    {
+        std::size_t allocations = 0;
+        std::size_t deallocations = 0;
+        std::size_t bytes_allocated = 0;
+        std::size_t bytes_deallocated = 0;
+        std::array<std::size_t, num_size_classes> by_size_class{}; // allocations, by size_class()
+
+        // allocations in the size classes from bytes' up (so exact when bytes is a power of 2, and >= 16)
+        std::size_t allocations_of_at_least(std::size_t bytes) const
+        {
+            std::size_t n = 0;
+            for (std::size_t c = size_class(bytes); c < num_size_classes; c++)
+                n += by_size_class[c];
+            return n;
+        }
+
+        friend counts operator-(counts a, counts const & b)
+        {
+            a.allocations -= b.allocations;
+            a.deallocations -= b.deallocations;
+            a.bytes_allocated -= b.bytes_allocated;
+            a.bytes_deallocated -= b.bytes_deallocated;
+            for (std::size_t c = 0; c < num_size_classes; c++)
+                a.by_size_class[c] -= b.by_size_class[c];
+            return a;
+        }
+    };
+
+    // since this thread started
+    counts this_thread();
+    // since the process started (includes threads that have finished)
+    counts all_threads();
+
+    enum class threads
+    {
+        this_one,
+        all,
+    };
+
+    // counts what happens while it is alive
+    class scope
+    {
+        threads which;
+        counts start;
+
+        counts now() const
+        {
+            return which == threads::this_one ? this_thread() : all_threads();
+        }
+
+    public:
+        explicit scope(threads which = threads::this_one)
+            : which(which), start(now())
+        {
+        }
+
+        counts so_far() const
+        {
+            return now() - start;
+        }
+        // start counting again from here
+        void restart()
+        {
+            start = now();
+        }
+    };
+
+    // what f() did
+    template <typename F>
+    counts count(F && f, threads which = threads::this_one)
+    {
+        scope s(which);
+        std::forward<F>(f)();
+        return s.so_far();
+    }
+
+    // called when a no_allocations scope saw an allocation
+    // The default prints to stderr and calls std::abort()
+    using failure_handler = void (*)(char const * what, counts const & seen);
+    // returns the previous one (nullptr means back to the default)
+    failure_handler set_failure_handler(failure_handler handler);
+
+    // the failure handler is called (when this is destroyed) if this thread allocated while it was alive
+    class no_allocations
+    {
+        scope s;
+        char const * what;
+
+    public:
+        explicit no_allocations(char const * what = "alloc_trace::no_allocations")
+            : what(what)
+        {
+        }
+        no_allocations(no_allocations const &) = delete;
+        no_allocations & operator=(no_allocations const &) = delete;
+        ~no_allocations();
+    };
+}
+
+#endif // _h
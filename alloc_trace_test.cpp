@@ -0,0 +1,137 @@
+#include "alloc_trace.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+// link with alloc_trace.cpp
+
+namespace
+{
+    // the compiler is allowed to leave out a new/delete pair that it can see through, so don't let it see through
+    void * volatile sink;
+    template <typename T>
+    T * escape(T * p)
+    {
+        sink = p;
+        return static_cast<T *>(sink);
+    }
+    void new_and_delete_int()
+    {
+        delete escape(new int);
+    }
+
+    int failures = 0;
+    void count_failure(char const *, alloc_trace::counts const &)
+    {
+        failures++;
+    }
+}
+
+TEST(alloc_trace, size_classes)
+{
+    using namespace alloc_trace;
+    EXPECT_EQ(0u, size_class(0));
+    EXPECT_EQ(0u, size_class(15));
+    EXPECT_EQ(1u, size_class(16));
+    EXPECT_EQ(1u, size_class(31));
+    EXPECT_EQ(2u, size_class(32));
+    EXPECT_EQ(9u, size_class(4096));
+    EXPECT_EQ(4096u, size_class_min(9));
+    EXPECT_EQ(num_size_classes - 1, size_class(std::size_t(1) << 40));
+}
+
+TEST(alloc_trace, counts_new_and_delete)
+{
+    alloc_trace::scope s;
+    int * p = escape(new int(17));
+    EXPECT_EQ(1u, s.so_far().allocations);
+    EXPECT_EQ(sizeof(int), s.so_far().bytes_allocated);
+    EXPECT_EQ(0u, s.so_far().deallocations);
+    delete p;
+    EXPECT_EQ(1u, s.so_far().deallocations);
+    EXPECT_EQ(sizeof(int), s.so_far().bytes_deallocated);
+}
+
+TEST(alloc_trace, counts_arrays_aligned_and_nothrow)
+{
+    struct alignas(128) Aligned { char c; };
+    auto c = alloc_trace::count([] {
+        delete[] escape(new char[100]);
+        Aligned * a = escape(new Aligned);
+        EXPECT_EQ(0u, reinterpret_cast<std::uintptr_t>(a) % 128);
+        delete a;
+        delete escape(new (std::nothrow) int);
+    });
+    EXPECT_EQ(3u, c.allocations);
+    EXPECT_EQ(3u, c.deallocations);
+    EXPECT_EQ(100 + sizeof(Aligned) + sizeof(int), c.bytes_allocated);
+    EXPECT_EQ(c.bytes_allocated, c.bytes_deallocated);
+}
+
+TEST(alloc_trace, histogram)
+{
+    auto c = alloc_trace::count([] {
+        std::vector<std::unique_ptr<char[]>> v;
+        v.reserve(4);
+        v.emplace_back(new char[8]);
+        v.emplace_back(new char[5000]);
+        v.emplace_back(new char[5000]);
+    });
+    EXPECT_EQ(4u, c.allocations); // the vector, and 3 arrays
+    EXPECT_EQ(1u, c.by_size_class[alloc_trace::size_class(8)]);
+    EXPECT_EQ(2u, c.by_size_class[alloc_trace::size_class(5000)]);
+    EXPECT_EQ(2u, c.allocations_of_at_least(4096));
+}
+
+TEST(alloc_trace, other_threads_are_not_counted_by_default)
+{
+    std::atomic<int> step{ 0 };
+    std::thread t([&step] {
+        while (step.load() != 1)
+            std::this_thread::yield();
+        new_and_delete_int();
+        step = 2;
+    });
+    // starting the thread may have allocated here, so start counting after that
+    alloc_trace::scope mine;
+    alloc_trace::scope everyones(alloc_trace::threads::all);
+    step = 1;
+    while (step.load() != 2)
+        std::this_thread::yield();
+    EXPECT_EQ(0u, mine.so_far().allocations);
+    EXPECT_GE(everyones.so_far().allocations, 1u);
+    t.join();
+}
+
+TEST(alloc_trace, restart)
+{
+    alloc_trace::scope s;
+    new_and_delete_int();
+    s.restart();
+    EXPECT_EQ(0u, s.so_far().allocations);
+}
+
+TEST(alloc_trace, no_allocations)
+{
+    auto prev = alloc_trace::set_failure_handler(&count_failure);
+    failures = 0;
+    {
+        alloc_trace::no_allocations guard;
+        int x = 17;
+        (void)x;
+    }
+    EXPECT_EQ(0, failures);
+    {
+        alloc_trace::no_allocations guard("test");
+        new_and_delete_int();
+    }
+    EXPECT_EQ(1, failures);
+    alloc_trace::set_failure_handler(prev);
+}
@@ -0,0 +1,136 @@
+#ifndef any_key_h_INCLUDED
+#define any_key_h_INCLUDED
+
+#include "any_movable.h"
+
+#include <cstddef>
+#include <functional> // std::hash
+#include <type_traits>
+#include <utility>
+
+//
+// An any_movable that can be a key - in an unordered_set/unordered_map - for values of mixed types:
+//
+//    std::unordered_set<any_key> seen;
+//    if (seen.insert(any_key(msg.id)).second) ...        // (an int, say)
+//    if (seen.insert(any_key(std::string(name))).second) ...
+//
+// The held type needs a std::hash and an operator== (see any_movable_detail::is_hashable).
+// The hash is worked out once, when the key is made, and kept beside the item,
+// so rehashing a big set never calls back through the vtable.
+// Keys of different types are never equal: the cached hashes (which mix in the type) almost always differ,
+// and when they don't, comparing types rejects them before any operator== is called.
+//
+// The item is const (changing it would change its hash while it is in a set).
+//
+template <typename Any = any_movable>
+class basic_any_key
+{
+    Any item;
+    std::size_t h;
+
+    static std::size_t hash_of(Any const & a)
+    {
+        if (!a.has_value())
+            return 0;
+        std::size_t v = a.hash(); // throws if it can't be hashed
+        // (so 17 and 17L are unlikely to collide)
+        return v ^ (a.type().hash_code() + std::size_t(0x9e3779b97f4a7c15ull) + (v << 6) + (v >> 2));
+    }
+
+public:
+    basic_any_key()
+        : h(0)
+    {
+    }
+    template <typename T, typename = std::enable_if_t<!std::is_same_v<std::decay_t<T>, basic_any_key>>>
+    explicit basic_any_key(T && t)
+        : item(std::forward<T>(t)), h(hash_of(item))
+    {
+        static_assert(any_movable_detail::is_basic_any_movable_v<std::decay_t<T>> || any_movable_detail::is_hashable_v<std::decay_t<T>>,
+            "any_key needs std::hash<T> and T == T");
+    }
+    template <typename T, typename ...Args>
+    explicit basic_any_key(std::in_place_type_t<T>, Args &&... args)
+        : h(0)
+    {
+        static_assert(any_movable_detail::is_hashable_v<T>, "any_key needs std::hash<T> and T == T");
+        item.template emplace<T>(std::forward<Args>(args)...);
+        h = hash_of(item);
+    }
+
+    basic_any_key(basic_any_key && other) noexcept(std::is_nothrow_move_constructible_v<Any>)
+        : item(std::move(other.item)), h(std::exchange(other.h, 0))
+    {
+    }
+    basic_any_key & operator=(basic_any_key && other)
+    {
+        item = std::move(other.item);
+        h = std::exchange(other.h, 0);
+        return *this;
+    }
+
+    std::size_t hash() const
+    {
+        return h;
+    }
+    Any const & value() const
+    {
+        return item;
+    }
+    // the item, out of the key (leaves the key empty)
+    Any release() &&
+    {
+        h = 0;
+        return std::move(item);
+    }
+
+    bool has_value() const
+    {
+        return item.has_value();
+    }
+    std::type_info const & type() const
+    {
+        return item.type();
+    }
+    template <typename T>
+    bool has_type() const
+    {
+        return item.template has_type<T>();
+    }
+    template <typename T>
+    T const * access_ptr() const
+    {
+        return item.template access_ptr<T>();
+    }
+    template <typename T>
+    T const & access() const
+    {
+        return item.template access<T>();
+    }
+
+    friend bool operator==(basic_any_key const & a, basic_any_key const & b)
+    {
+        return a.h == b.h && a.item.equals(b.item);
+    }
+    friend bool operator!=(basic_any_key const & a, basic_any_key const & b)
+    {
+        return !(a == b);
+    }
+};
+
+using any_key = basic_any_key<>;
+
+namespace std
+{
+    template <typename Any>
+    struct hash<basic_any_key<Any>>
+    {
+        std::size_t operator()(basic_any_key<Any> const & k) const noexcept
+        {
+            return k.hash();
+        }
+    };
+}
+
+#endif // _h
@@ -0,0 +1,151 @@
+#include "any_key.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace
+{
+    struct Point
+    {
+        int x, y;
+        friend bool operator==(Point a, Point b) { return a.x == b.x && a.y == b.y; }
+    };
+
+    struct NoHash
+    {
+        int x;
+        friend bool operator==(NoHash a, NoHash b) { return a.x == b.x; }
+    };
+
+    struct Compared
+    {
+        static int compares;
+        int x;
+        friend bool operator==(Compared a, Compared b) { compares++; return a.x == b.x; }
+    };
+    int Compared::compares = 0;
+
+    struct NotEqualityComparable {};
+}
+
+namespace std
+{
+    template <> struct hash<Point>
+    {
+        size_t operator()(Point p) const { return std::hash<int>()(p.x) * 31 + std::hash<int>()(p.y); }
+    };
+    template <> struct hash<Compared>
+    {
+        size_t operator()(Compared) const { return 0; } // all collide, so == gets called
+    };
+}
+
+static_assert(any_movable_detail::is_hashable_v<int>);
+static_assert(any_movable_detail::is_hashable_v<std::string>);
+static_assert(any_movable_detail::is_hashable_v<Point>);
+static_assert(!any_movable_detail::is_hashable_v<NoHash>);
+static_assert(!any_movable_detail::is_hashable_v<std::vector<int>>);
+// (vector's == is declared even though it wouldn't compile - it must still be holdable)
+static_assert(!any_movable_detail::is_hashable_v<std::vector<NotEqualityComparable>>);
+
+TEST(any_movable, hash_and_equals)
+{
+    any_movable a = std::string("hello");
+    any_movable b = std::string("hello");
+    any_movable c = std::string("world");
+    any_movable d = 17;
+    any_movable e, f;
+
+    EXPECT_TRUE(a.hashable());
+    EXPECT_EQ(std::hash<std::string>()("hello"), a.hash());
+    EXPECT_EQ(a.hash(), b.hash());
+    EXPECT_TRUE(a.equals(b));
+    EXPECT_FALSE(a.equals(c));
+    EXPECT_FALSE(a.equals(d));
+    EXPECT_FALSE(a.equals(e));
+    EXPECT_TRUE(e.equals(f));
+    EXPECT_EQ(0u, e.hash());
+
+    // across sizes
+    basic_any_movable<64> big = std::string("hello");
+    EXPECT_TRUE(a.equals(big));
+    EXPECT_TRUE(big.equals(a));
+}
+
+TEST(any_movable, unhashable_items)
+{
+    any_movable n = NoHash{ 1 };
+    any_movable m = NoHash{ 1 };
+    any_movable v = std::vector<NotEqualityComparable>(3);
+    EXPECT_FALSE(n.hashable());
+    EXPECT_FALSE(v.hashable());
+    EXPECT_THROW(n.hash(), std::bad_any_cast);
+    EXPECT_THROW(n.equals(m), std::bad_any_cast);
+    any_movable i = 1;
+    EXPECT_FALSE(n.equals(i)); // different types - no need for ==
+}
+
+TEST(any_key, unordered_set_of_mixed_types)
+{
+    std::unordered_set<any_key> set;
+    EXPECT_TRUE(set.insert(any_key(17)).second);
+    EXPECT_TRUE(set.insert(any_key(std::string("seventeen"))).second);
+    EXPECT_TRUE(set.insert(any_key(Point{ 1, 7 })).second);
+    EXPECT_TRUE(set.insert(any_key(17L)).second); // not the same as the int
+    EXPECT_FALSE(set.insert(any_key(17)).second);
+    EXPECT_FALSE(set.insert(any_key(std::string("seventeen"))).second);
+    EXPECT_FALSE(set.insert(any_key(Point{ 1, 7 })).second);
+    EXPECT_EQ(4u, set.size());
+
+    EXPECT_EQ(1u, set.count(any_key(Point{ 1, 7 })));
+    EXPECT_EQ(0u, set.count(any_key(Point{ 7, 1 })));
+}
+
+TEST(any_key, unordered_map)
+{
+    std::unordered_map<any_key, int> cache;
+    cache[any_key(std::string("a"))] = 1;
+    cache[any_key(2.5)] = 2;
+    EXPECT_EQ(1, cache.at(any_key(std::string("a"))));
+    EXPECT_EQ(2, cache.at(any_key(2.5)));
+    EXPECT_EQ(0u, cache.count(any_key(2.5f)));
+}
+
+TEST(any_key, hash_is_cached_and_types_are_checked_first)
+{
+    any_key a(Compared{ 1 });
+    any_key b(Compared{ 1 });
+    any_key c(std::in_place_type<Compared>, Compared{ 2 });
+    std::size_t h = a.hash();
+    EXPECT_EQ(h, std::hash<any_key>()(a));
+
+    Compared::compares = 0;
+    EXPECT_TRUE(a == b);
+    EXPECT_FALSE(a == c);
+    EXPECT_EQ(2, Compared::compares);
+
+    any_key i(0);
+    EXPECT_FALSE(a == i); // different type, never gets to Compared's ==
+    EXPECT_EQ(2, Compared::compares);
+}
+
+TEST(any_key, from_any_movable_and_back)
+{
+    any_movable m = std::string("moved in");
+    any_key k(std::move(m));
+    EXPECT_TRUE(k.has_type<std::string>());
+    EXPECT_EQ("moved in", k.access<std::string>());
+    EXPECT_EQ(k, any_key(std::string("moved in")));
+
+    any_movable out = std::move(k).release();
+    EXPECT_EQ("moved in", out.access<std::string>());
+    EXPECT_FALSE(k.has_value());
+
+    any_movable n = NoHash{ 1 };
+    EXPECT_THROW(any_key(std::move(n)), std::bad_any_cast);
+}
@@ -0,0 +1,218 @@
+#ifndef any_map_h_INCLUDED
+#define any_map_h_INCLUDED
+
+#include "any_movable.h"
+#include "dense_type_id.h"
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <any> // bad_any_cast
+#include <algorithm> // find
+
+//
+// A bag of "one of each type" - like std::unordered_map<std::type_index, any_movable>, but
+// each type gets a (process-wide) small integer id the first time it is used, and
+// the items live in a plain array of any_movables, indexed by that id.
+// So get<T>() is an array index - no hashing a type_info, no chasing nodes - and small items live right in the array.
+//
+//    any_map context;
+//    context.emplace<RequestId>(17);
+//    context.emplace<Deadline>(now + 100ms);
+//    ...
+//    if (Deadline * d = context.get_ptr<Deadline>()) ...
+//
+// Like std::vector, adding a type that is new to this map can grow the array, which moves the (inline) items,
+// so hold on to the map, not to pointers into it.
+// The array is as long as the biggest id used, so this is for programs with tens or hundreds of context types, not millions.
+//
+// clear() destroys the items but keeps the array, so a map reused for each request stops allocating after the first
+// (except for items too big to fit in Any).
+//
+namespace any_map_detail
+{
+    struct ids;
+
+    // dense: 0, 1, 2, ... in order of first use (by any any_map)
+    template <typename T>
+    std::size_t type_id()
+    {
+        return dense_type_id<ids, T>();
+    }
+}
+
+template <typename Any = any_movable>
+class basic_any_map
+{
+    std::vector<Any> slots; // slots[type_id<T>()] holds the T (or is empty)
+    std::vector<std::uint32_t> used; // which slots hold something (so clear() doesn't need to look at all of them)
+
+    template <typename T>
+    static std::size_t id()
+    {
+        return any_map_detail::type_id<std::remove_cv_t<T>>();
+    }
+
+    void forget(std::size_t i)
+    {
+        auto it = std::find(used.begin(), used.end(), (std::uint32_t)i);
+        *it = used.back();
+        used.pop_back();
+    }
+
+    Any & slot_for(std::size_t i)
+    {
+        if (i >= slots.size())
+            slots.resize(i + 1);
+        return slots[i];
+    }
+
+public:
+    basic_any_map() = default;
+    basic_any_map(basic_any_map &&) = default;
+    basic_any_map & operator=(basic_any_map &&) = default;
+    basic_any_map(basic_any_map const &) = delete;
+    basic_any_map & operator=(basic_any_map const &) = delete;
+
+    // makes the T (replacing any T already there)
+    // (a replacement T is made before the old one goes - so args can refer to it, ie set(get<T>()) - and if making it throws, the old one stays)
+    template <typename T, typename ...Args>
+    T & emplace(Args &&... args)
+    {
+        std::size_t i = id<T>();
+        if (i < slots.size())
+        {
+            Any & slot = slots[i];
+            if (!slot.has_value())
+            {
+                // the common case (ie a map reused per request) - right into the slot
+                // (an empty slot has nothing for args to refer to, and the slots don't move)
+                used.reserve(used.size() + 1); // so push_back can't throw after emplace
+                T & t = slot.template emplace<T>(std::forward<Args>(args)...);
+                used.push_back((std::uint32_t)i);
+                return t;
+            }
+            Any fresh;
+            fresh.template emplace<T>(std::forward<Args>(args)...);
+            try
+            {
+                slot = std::move(fresh);
+            }
+            catch (...)
+            {
+                if (!slot.has_value())
+                    forget(i); // the old one is gone, and there is no new one
+                throw;
+            }
+            return *static_cast<T *>(slot.data());
+        }
+        // a type new to this map: growing the slots moves the items, and args might refer to one of them, so make the T first
+        // (only the first time the map sees the type)
+        Any fresh;
+        fresh.template emplace<T>(std::forward<Args>(args)...);
+        Any & slot = slot_for(i);
+        used.reserve(used.size() + 1);
+        slot = std::move(fresh);
+        used.push_back((std::uint32_t)i);
+        return *static_cast<T *>(slot.data());
+    }
+    template <typename T>
+    std::decay_t<T> & set(T && t)
+    {
+        return emplace<std::decay_t<T>>(std::forward<T>(t));
+    }
+
+    // the T that is already there, or makes one
+    template <typename T, typename ...Args>
+    T & get_or_emplace(Args &&... args)
+    {
+        if (T * t = get_ptr<T>())
+            return *t;
+        return emplace<T>(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    bool contains() const
+    {
+        return get_ptr<T>() != nullptr;
+    }
+
+    // null if there is no T
+    template <typename T>
+    T * get_ptr()
+    {
+        std::size_t i = id<T>();
+        // no need to check the type - only a T ever goes in T's slot
+        return i < slots.size() ? static_cast<T *>(slots[i].data()) : nullptr;
+    }
+    template <typename T>
+    T const * get_ptr() const
+    {
+        return const_cast<basic_any_map *>(this)->get_ptr<T>();
+    }
+    // throws std::bad_any_cast if there is no T
+    template <typename T>
+    T & get()
+    {
+        if (T * t = get_ptr<T>())
+            return *t;
+        throw std::bad_any_cast();
+    }
+    template <typename T>
+    T const & get() const
+    {
+        return const_cast<basic_any_map *>(this)->get<T>();
+    }
+
+    // returns false if there was no T
+    template <typename T>
+    bool erase()
+    {
+        std::size_t i = id<T>();
+        if (i >= slots.size() || !slots[i].has_value())
+            return false;
+        slots[i].reset();
+        forget(i);
+        return true;
+    }
+
+    // destroys all the items, but keeps the memory for next time
+    void clear()
+    {
+        for (std::uint32_t i : used)
+            slots[i].reset();
+        used.clear();
+    }
+
+    std::size_t size() const
+    {
+        return used.size();
+    }
+    bool empty() const
+    {
+        return used.empty();
+    }
+
+    // f(Any &) for each item (in no particular order)
+    // f can change the item (ie via access_ptr<T>()), but must not reset it, or emplace some other type in it -
+    // the map relies on T's slot holding a T (use erase<T>() and emplace<T>() for those, after for_each)
+    template <typename F>
+    void for_each(F && f)
+    {
+        for (std::uint32_t i : used)
+            f(slots[i]);
+    }
+    // f(Any const &)
+    template <typename F>
+    void for_each(F && f) const
+    {
+        for (std::uint32_t i : used)
+            f(std::as_const(slots[i]));
+    }
+};
+
+using any_map = basic_any_map<>;
+
+#endif // _h
@@ -0,0 +1,176 @@
+#include "any_map.h"
+#include "alloc_trace.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+
+// link with alloc_trace.cpp
+
+namespace
+{
+    struct RequestId { int id; };
+    struct UserName { std::string name; };
+    struct Unused { };
+
+    struct Counted
+    {
+        static int alive;
+        Counted() { alive++; }
+        Counted(Counted &&) noexcept { alive++; }
+        ~Counted() { alive--; }
+    };
+    int Counted::alive = 0;
+
+    struct ThrowsOnConstruct
+    {
+        ThrowsOnConstruct(int) { throw 17; }
+    };
+}
+
+TEST(any_map, type_ids_are_dense_and_stable)
+{
+    std::size_t a = any_map_detail::type_id<struct IdA>();
+    std::size_t b = any_map_detail::type_id<struct IdB>();
+    EXPECT_EQ(a + 1, b);
+    EXPECT_EQ(a, any_map_detail::type_id<struct IdA>());
+}
+
+TEST(any_map, emplace_and_get)
+{
+    any_map m;
+    EXPECT_TRUE(m.empty());
+    EXPECT_EQ(nullptr, m.get_ptr<RequestId>());
+
+    m.emplace<RequestId>(RequestId{ 17 });
+    m.set(UserName{ "bob" });
+    EXPECT_EQ(2u, m.size());
+    EXPECT_TRUE(m.contains<RequestId>());
+    EXPECT_FALSE(m.contains<Unused>());
+    EXPECT_EQ(17, m.get<RequestId>().id);
+    EXPECT_EQ("bob", m.get<UserName>().name);
+    EXPECT_THROW(m.get<Unused>(), std::bad_any_cast);
+
+    any_map const & cm = m;
+    EXPECT_EQ(17, cm.get_ptr<RequestId>()->id);
+}
+
+TEST(any_map, emplace_replaces)
+{
+    any_map m;
+    m.set(RequestId{ 1 });
+    m.set(RequestId{ 2 });
+    EXPECT_EQ(1u, m.size());
+    EXPECT_EQ(2, m.get<RequestId>().id);
+}
+
+TEST(any_map, get_or_emplace)
+{
+    any_map m;
+    EXPECT_EQ(5, m.get_or_emplace<RequestId>(RequestId{ 5 }).id);
+    EXPECT_EQ(5, m.get_or_emplace<RequestId>(RequestId{ 6 }).id);
+}
+
+TEST(any_map, erase)
+{
+    any_map m;
+    m.set(RequestId{ 1 });
+    m.set(UserName{ "x" });
+    EXPECT_TRUE(m.erase<RequestId>());
+    EXPECT_FALSE(m.erase<RequestId>());
+    EXPECT_FALSE(m.erase<Unused>());
+    EXPECT_EQ(1u, m.size());
+    EXPECT_FALSE(m.contains<RequestId>());
+    EXPECT_TRUE(m.contains<UserName>());
+}
+
+TEST(any_map, clear_destroys_items)
+{
+    Counted::alive = 0;
+    any_map m;
+    m.emplace<Counted>();
+    m.set(std::make_unique<int>(3));
+    EXPECT_EQ(1, Counted::alive);
+    m.clear();
+    EXPECT_EQ(0, Counted::alive);
+    EXPECT_TRUE(m.empty());
+    EXPECT_FALSE(m.contains<std::unique_ptr<int>>());
+}
+
+TEST(any_map, reuse_after_clear_does_not_allocate)
+{
+    any_map m;
+    auto fill = [&m] {
+        m.set(RequestId{ 1 });
+        m.emplace<double>(2.5);
+        m.emplace<UserName>();
+    };
+    fill(); // first time, the slots are allocated
+    m.clear();
+
+    auto heap = alloc_trace::count([&] {
+        for (int request = 0; request < 10; request++)
+        {
+            fill();
+            EXPECT_EQ(2.5, m.get<double>());
+            m.clear();
+        }
+    });
+    EXPECT_EQ(0u, heap.allocations);
+}
+
+TEST(any_map, throwing_emplace_leaves_it_consistent)
+{
+    any_map m;
+    m.set(RequestId{ 1 });
+    EXPECT_THROW(m.emplace<ThrowsOnConstruct>(0), int);
+    EXPECT_EQ(1u, m.size());
+    EXPECT_FALSE(m.contains<ThrowsOnConstruct>());
+}
+
+TEST(any_map, set_from_what_is_already_there)
+{
+    any_map m;
+    m.set(UserName{ "a name long enough to be on the heap, not in the string" });
+    m.set(m.get<UserName>());
+    EXPECT_EQ("a name long enough to be on the heap, not in the string", m.get<UserName>().name);
+    m.emplace<UserName>(UserName{ m.get<UserName>().name + "!" });
+    EXPECT_EQ("a name long enough to be on the heap, not in the string!", m.get<UserName>().name);
+    EXPECT_EQ(1u, m.size());
+
+    // a type new to the map grows the slots, which moves UserName - after the new one is made from it
+    struct Greeting
+    {
+        std::string text;
+        explicit Greeting(std::string const & name) : text("hello " + name) {}
+    };
+    m.emplace<Greeting>(m.get<UserName>().name);
+    EXPECT_EQ("hello a name long enough to be on the heap, not in the string!", m.get<Greeting>().text);
+    EXPECT_EQ(2u, m.size());
+}
+
+TEST(any_map, for_each_can_change_items)
+{
+    any_map m;
+    m.set(RequestId{ 17 });
+    m.set(UserName{ "fred" });
+    int found = 0;
+    m.for_each([&found](any_movable & item) {
+        if (RequestId * r = item.access_ptr<RequestId>())
+        {
+            r->id++;
+            found++;
+        }
+        else if (item.has_type<UserName>())
+            found++;
+    });
+    EXPECT_EQ(2, found);
+    EXPECT_EQ(18, m.get<RequestId>().id);
+
+    std::size_t names = 0;
+    std::as_const(m).for_each([&names](any_movable const & item) { names += item.has_type<UserName>(); });
+    EXPECT_EQ(1u, names);
+    EXPECT_EQ(2u, m.size());
+}
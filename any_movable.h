@@ -6,95 +6,261 @@
 #include <typeinfo> // typeid, std::type_info
 #include <any> // bad_any_cast
 #include <type_traits>
+#include <vector> // base offset cache
+#include <cstddef> // std::ptrdiff_t
+#include <limits> // numeric_limits
+#include <cstring> // memcpy
+#include <memory> // allocator_traits
+#include <memory_resource> // pmr::polymorphic_allocator
+#include <tuple> // tuple_element_t
+#include <functional> // std::hash
 
 #include <iostream>
 
-class any_movable
+//
+// Optionally, declare the bases of a type you will hold in an any_movable:
+//
+//    template <> struct any_movable_bases<Derived> { using type = any_bases<Middle, OtherBase>; };
+//    template <> struct any_movable_bases<Middle> { using type = any_bases<Base>; };
+//
+// then has_dynamic_type / access_dynamic / any_dynamic_cast find the bases by table lookup
+// instead of throwing an exception (see try_as_base_by_throwing() below for the evil that is otherwise done).
+// Bases of declared bases are found too (ie Derived -> Middle -> Base above).
+// A declaration is trusted - a base that is not listed (directly or via its listed bases) is not found.
+//
+template <typename ...Bases>
+struct any_bases
 {
-    union Storage
+};
+
+template <typename T, typename = void>
+struct any_movable_bases
+{
+    // no 'type' here means "undeclared" (so fall back to try-catch)
+};
+
+namespace any_movable_detail
+{
+    template <typename T, typename = void>
+    struct is_declared : std::bool_constant<!std::is_class_v<T>> // non-classes have no bases, so are trivially "declared"
     {
-        unsigned char data[6 * sizeof(void *)]; // approx same size as std::function's buffer
-        long double to_ensure_alignment_with_almost_anything;
     };
-
-    struct Base
-    {
-        // The interface that any_movable will use to handle the held item
-        // A Derived<T> template will derive from this and implement the interface for each T
-        virtual ~Base() {}
-        virtual Base * move_to(void * dst) { return new (dst) Base(); }
-        virtual std::type_info const & getTypeInfo() const { return typeid(void); }
-        virtual void * getItem() { return nullptr; }
-        virtual void const * getItem() const { return nullptr; }
-        virtual bool can_assign() const { return true; } // you can assign nothing to nothing!
-        virtual void move_assign(void * data) { }
-        virtual void youveGotToThrowItThrowIt() const { throw getItem(); } //nullptr!
-        virtual bool isClass() const { return false; } // is the type you are holding a class or non-class
+    template <typename T>
+    struct is_declared<T, std::void_t<typename any_movable_bases<T>::type>> : std::true_type
+    {
     };
-    // Implement Base for each T
-    template<typename T>
-    struct Derived : Base
+    template <typename T>
+    constexpr bool is_declared_v = is_declared<T>::value;
+
+    template <typename B, typename T>
+    void * find_base(T * t, std::type_info const & ti);
+
+    template <typename T, typename ...Bases>
+    void * find_in_bases(T * t, std::type_info const & ti, any_bases<Bases...>)
     {
-        T t;
-        template <typename ...Args>
-        Derived(Args &&... args) : t(std::forward<Args>(args)...)
-        {
-        }
+        void * found = nullptr;
+        (void)((found = find_base<Bases>(t, ti)) || ...); // first found, in the order listed
+        return found;
+    }
 
-        virtual ~Derived() {}
-        virtual Base * move_to(void * dst) override
-        {
-            return new (dst) Derived(std::move(t));
-        }
-        virtual std::type_info const & getTypeInfo() const override
-        {
-            return typeid(T);
-        }
-        virtual void * getItem() override
-        {
-            return &t;
-        }
-        virtual void const * getItem() const override
-        {
-            return &t;
-        }
-        virtual void move_assign(void * data) override
+    template <typename B, typename T>
+    void * find_base(T * t, std::type_info const & ti)
+    {
+        B * b = t; // if this doesn't compile, your any_movable_bases<T> lists a B that isn't a base of T
+        if (typeid(B) == ti)
+            return b;
+        if constexpr (std::is_class_v<B> && is_declared_v<B>)
+            return find_in_bases(b, ti, typename any_movable_bases<B>::type());
+        return nullptr;
+    }
+
+    // returns the T * inside item (of type held) as a void *, or nullptr if T is not a declared base
+    template <typename T>
+    void * find_declared_base(T * item, std::type_info const & ti)
+    {
+        if constexpr (std::is_class_v<T> && is_declared_v<T>)
+            return find_in_bases(item, ti, typename any_movable_bases<T>::type());
+        else
+            return nullptr;
+    }
+
+    struct VTable;
+
+    // Remembers, per thread, where (if at all) the requested type T lives inside each held type
+    // (ie the pointer adjustment from the held item to its T base).
+    // Per thread, so no locks, and each thread only pays for the lookups (or throws!) once per held type.
+    // Keyed by the held type's vtable - one per type (per allocator), and a pointer compare is cheaper than comparing
+    // type_infos (which can mean a strcmp of the names, for every entry that doesn't match).
+    template <typename T>
+    struct base_offset_cache
+    {
+        static constexpr std::ptrdiff_t not_a_base = std::numeric_limits<std::ptrdiff_t>::min();
+
+        struct Entry
         {
-            if constexpr (std::is_move_assignable_v<T>)
-                t = std::move(*reinterpret_cast<T *>(data));
-        }
-        virtual bool can_assign() const override
+            VTable const * held;
+            std::ptrdiff_t offset;
+        };
+
+        static std::vector<Entry> & entries()
         {
-            return std::is_move_assignable_v<T>;
+            static thread_local std::vector<Entry> cache;
+            return cache;
         }
-        virtual void youveGotToThrowItThrowIt() const
+
+        static bool find(VTable const * held, std::ptrdiff_t & offset)
         {
-            throw const_cast<T *>(reinterpret_cast<T const *>(getItem())); // so evil!
+            for (Entry const & e : entries())
+            {
+                if (e.held == held)
+                {
+                    offset = e.offset;
+                    return true;
+                }
+            }
+            return false;
         }
-        virtual bool isClass() const
+        static void add(VTable const * held, std::ptrdiff_t offset)
         {
-            return std::is_class_v<T>;
+            entries().push_back(Entry{ held, offset });
         }
     };
+}
 
-    Storage storage;
-    Base * ptr = nullptr;
+//
+// Is it OK to move a T by just copying its bytes somewhere else (and then forgetting about the original)?
+// That's true for almost every type (anything that doesn't point into itself),
+// but C++ has no way to ask, so we assume it only for the trivial cases.
+// Specialize this for your own types if you know better (and want faster moves):
+//
+//    template <> struct any_movable_trivially_relocatable<MyType> : std::true_type {};
+//
+template <typename T, typename = void>
+struct any_movable_trivially_relocatable
+    : std::bool_constant<std::is_trivially_move_constructible_v<T> && std::is_trivially_destructible_v<T>>
+{
+};
+
+template <std::size_t InlineBytes, std::size_t Align, typename Allocator, bool NothrowMoves>
+class basic_any_movable;
+
+template <bool IsConst>
+class basic_any_ref; // see any_ref.h
+
+namespace any_movable_detail
+{
+    template <typename T>
+    struct is_basic_any_movable : std::false_type
+    {
+    };
+    template <std::size_t InlineBytes, std::size_t Align, typename Allocator, bool NothrowMoves>
+    struct is_basic_any_movable<basic_any_movable<InlineBytes, Align, Allocator, NothrowMoves>> : std::true_type
+    {
+    };
+    template <typename T>
+    constexpr bool is_basic_any_movable_v = is_basic_any_movable<T>::value;
+
+    // The interface that any_movable will use to handle the held item.
+    // This used to be a virtual Base class (living inside the any's storage),
+    // but now it is a hand-rolled vtable - one static constexpr table per T, pointed to from *beside* the storage.
+    // So type() is a load (not a virtual call), and null entries mean "nothing to do" (ie skip the call entirely)
+    struct VTable
+    {
+        std::type_info const * type;
+        std::size_t size;
+        std::size_t align;
+        // move-construct into dst from src, then destroy src
+        // null means "trivially relocatable", ie just memcpy the storage
+        void (*move_to)(void * dst, void * src);
+        // move-construct into a new heap item (allocated from alloc) from src, then destroy src
+        // (for items that don't fit in the destination's storage, or came from a different allocator)
+        void * (*move_to_new)(void * src, void * alloc);
+        // destroy (but don't deallocate); null means trivially destructible
+        void (*destroy)(void * item);
+        // deallocate (after destroy) an item that was too big for the storage, back to alloc
+        void (*deallocate)(void * item, void * alloc);
+        // null means T is not move-assignable
+        void (*move_assign)(void * dst, void * src);
+        bool nothrowMoveAssign;
+        void (*youveGotToThrowItThrowIt)(void * item);
+        bool isClass; // is the type you are holding a class or non-class
+        // is the item always exactly a T (not part of something more derived)? - then where its bases are can be cached
+        bool mostDerived;
+        bool hasDeclaredBases;
+        void * (*findDeclaredBase)(void * item, std::type_info const & ti);
+        // null unless T is_hashable (below) - then std::hash<T> and operator== (both items are Ts)
+        std::size_t (*hash)(void const * item);
+        bool (*equal)(void const * a, void const * b);
+    };
+
+    // Has a std::hash<T> and an operator==, so can be (part of) a key.
+    // Only == for types that also hash: C++17's == for containers etc is declared whether or not it would compile,
+    // so asking about == on its own could turn "any_movable can't compare it" into "any_movable can't hold it".
+    template <typename T, typename = void>
+    struct is_hashable : std::false_type
+    {
+    };
+    template <typename T>
+    struct is_hashable<T, std::void_t<
+        decltype(std::size_t(std::hash<T>()(std::declval<T const &>()))),
+        decltype(bool(std::declval<T const &>() == std::declval<T const &>()))>> : std::true_type
+    {
+    };
+    template <typename T>
+    constexpr bool is_hashable_v = is_hashable<T>::value;
+
+    // Could a T be held (and so have a vtable)?
+    // Queries (has_type<T>, access_dynamic<T>, ...) can ask about anything - void, abstract bases, a Base with a protected destructor,
+    // std::mutex - and for those there is no vtable to compare with (and making one wouldn't compile), only type_infos.
+    template <typename T>
+    constexpr bool is_holdable_v = std::is_object_v<T> && !std::is_abstract_v<T>
+        && std::is_move_constructible_v<T> && std::is_destructible_v<T>;
+
+    template <typename T>
+    std::size_t hash_of(void const * item)
+    {
+        return std::hash<T>()(*static_cast<T const *>(item));
+    }
+    template <typename T>
+    bool equal_as(void const * a, void const * b)
+    {
+        return bool(*static_cast<T const *>(a) == *static_cast<T const *>(b));
+    }
+
+    // for the VTable (null when not is_hashable, without instantiating the above)
+    template <typename T>
+    constexpr auto hash_fn() -> std::size_t (*)(void const *)
+    {
+        if constexpr (is_hashable_v<T>)
+            return &hash_of<T>;
+        else
+            return nullptr;
+    }
+    template <typename T>
+    constexpr auto equal_fn() -> bool (*)(void const *, void const *)
+    {
+        if constexpr (is_hashable_v<T>)
+            return &equal_as<T>;
+        else
+            return nullptr;
+    }
 
     template<typename T>
-    T * try_as_base() const
+    T * try_as_base_by_throwing(VTable const * vtbl, void * ptr)
     {
         // What follows one of the more evil things I've done....
         // We would like to ask ptr, which holds some type X, whether X is derived from T
-        // But we can't ask that because ptr is not a template (so we can't pass <T>).
+        // But we can't ask that because we don't know X here (only vtbl does).
         // ie It is not possible to have a virtual template function (for sound reasons).
         // HOWEVER, what we can, magically, terribly, do is
-        // call a non-template function on ptr, asking it to throw a X * exception
+        // call a non-template function via vtbl, asking it to throw a X * exception
         // which we will attempt to catch here as a T *.
         // If the catch is successful, then X derives from T.
+        // (This is now only the fallback for types that don't declare their any_movable_bases.)
         try
         {
             if (ptr)
-                ptr->youveGotToThrowItThrowIt();
+                vtbl->youveGotToThrowItThrowIt(ptr);
         }
         catch (T * p)
         {
@@ -107,89 +273,503 @@ class any_movable
         return nullptr;
     }
 
+    // the T inside ptr (which holds whatever vtbl says), or null if T is not a base of it
+    template<typename T>
+    T * try_as_base(VTable const * vtbl, void * ptr)
+    {
+        if (!ptr)
+            return nullptr;
+
+        // The held type, X, is (for any_movable) always the most-derived type, so where T lives inside X is the same for every X.
+        // So we only need to figure it out once (per thread), and afterwards it is just a pointer adjustment.
+        // (Not so for an any_ref to an X & - that might be part of something more derived, and then a virtual base of X
+        // can be somewhere else each time. So no caching for those.)
+        using cache = base_offset_cache<T>;
+        char * item = (char *)ptr;
+        std::ptrdiff_t offset;
+        if (!vtbl->mostDerived)
+        {
+            void * p = vtbl->hasDeclaredBases
+                ? vtbl->findDeclaredBase(ptr, typeid(T))
+                : (void *)try_as_base_by_throwing<T>(vtbl, ptr);
+            return static_cast<T *>(p);
+        }
+        if (!cache::find(vtbl, offset))
+        {
+            void * p = vtbl->hasDeclaredBases
+                ? vtbl->findDeclaredBase(ptr, typeid(T))
+                : (void *)try_as_base_by_throwing<T>(vtbl, ptr);
+            offset = p ? (char *)p - item : cache::not_a_base;
+            cache::add(vtbl, offset);
+        }
+        if (offset == cache::not_a_base)
+            return nullptr;
+        return reinterpret_cast<T *>(item + offset);
+    }
+
+    // Implement the VTable for each T
+    // (and each Allocator, which is a type-erased Allocator * in the VTable functions that need it)
+    template <typename T, typename Allocator>
+    struct Derived
+    {
+        using TAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<T>;
+        using Traits = std::allocator_traits<TAllocator>;
+
+        static T * item(void * p)
+        {
+            return static_cast<T *>(p);
+        }
+        template <typename ...Args>
+        static T * make_new(void * alloc, Args &&... args)
+        {
+            TAllocator a(*static_cast<Allocator *>(alloc));
+            T * t = Traits::allocate(a, 1);
+            try
+            {
+                new (t) T(std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                Traits::deallocate(a, t, 1);
+                throw;
+            }
+            return t;
+        }
+        static void move_to(void * dst, void * src)
+        {
+            new (dst) T(std::move(*item(src)));
+            item(src)->~T();
+        }
+        static void * move_to_new(void * src, void * alloc)
+        {
+            T * t = make_new(alloc, std::move(*item(src)));
+            item(src)->~T();
+            return t;
+        }
+        static void destroy(void * p)
+        {
+            item(p)->~T();
+        }
+        static void deallocate(void * p, void * alloc)
+        {
+            TAllocator a(*static_cast<Allocator *>(alloc));
+            Traits::deallocate(a, item(p), 1);
+        }
+        static void move_assign(void * dst, void * src)
+        {
+            if constexpr (std::is_move_assignable_v<T>)
+                *item(dst) = std::move(*item(src));
+        }
+        static void youveGotToThrowItThrowIt(void * p)
+        {
+            throw item(p); // so evil!
+        }
+        static void * findDeclaredBase(void * p, std::type_info const & ti)
+        {
+            return find_declared_base(item(p), ti);
+        }
+
+        static constexpr VTable vtable = {
+            &typeid(T),
+            sizeof(T),
+            alignof(T),
+            any_movable_trivially_relocatable<T>::value ? nullptr : &move_to,
+            &move_to_new,
+            std::is_trivially_destructible_v<T> ? nullptr : &destroy,
+            &deallocate,
+            std::is_move_assignable_v<T> ? &move_assign : nullptr,
+            std::is_nothrow_move_assignable_v<T>,
+            &youveGotToThrowItThrowIt,
+            std::is_class_v<T>,
+            true, // mostDerived
+            is_declared_v<T>,
+            &findDeclaredBase,
+            hash_fn<T>(),
+            equal_fn<T>(),
+        };
+    };
+
+    // holds the Allocator, taking up no space when it is empty (ie std::allocator)
+    template <typename Allocator, bool = std::is_empty_v<Allocator> && !std::is_final_v<Allocator>>
+    struct AllocatorHolder : private Allocator
+    {
+        AllocatorHolder() = default;
+        AllocatorHolder(Allocator const & a) : Allocator(a) {}
+        Allocator & allocator() { return *this; }
+        Allocator const & allocator() const { return *this; }
+    };
+    // for visit()'s jump table
+    template <typename Q, typename R, typename F>
+    R invoke_as(void * item, F & f)
+    {
+        return f(*static_cast<Q *>(item));
+    }
+    template <typename F, typename ...Qs>
+    using visit_result_t = std::invoke_result_t<F &, std::tuple_element_t<0, std::tuple<Qs...>> &>;
+
+    template <typename Allocator>
+    struct AllocatorHolder<Allocator, false>
+    {
+        Allocator alloc;
+        AllocatorHolder() = default;
+        AllocatorHolder(Allocator const & a) : alloc(a) {}
+        Allocator & allocator() { return alloc; }
+        Allocator const & allocator() const { return alloc; }
+    };
+}
+
+//
+// The "allocator" for inline_any_movable (below): there is no heap.
+// basic_any_movable refuses, at compile time, to hold anything that would need one,
+// so allocate() is never actually called.
+//
+template <typename T = std::byte>
+struct any_movable_no_heap
+{
+    using value_type = T;
+    using is_always_equal = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+
+    any_movable_no_heap() = default;
+    template <typename U>
+    any_movable_no_heap(any_movable_no_heap<U> const &) noexcept
+    {
+    }
+
+    [[noreturn]] T * allocate(std::size_t)
+    {
+        throw std::bad_alloc();
+    }
+    void deallocate(T *, std::size_t) noexcept
+    {
+    }
+
+    template <typename U>
+    friend bool operator==(any_movable_no_heap const &, any_movable_no_heap<U> const &) { return true; }
+    template <typename U>
+    friend bool operator!=(any_movable_no_heap const &, any_movable_no_heap<U> const &) { return false; }
+};
+
+namespace any_movable_detail
+{
+    template <typename Allocator>
+    constexpr bool is_no_heap_v = false;
+    template <typename T>
+    constexpr bool is_no_heap_v<any_movable_no_heap<T>> = true;
+}
+
+//
+// InlineBytes and Align decide what can be held without allocating:
+// anything that fits (and isn't more aligned than Align) lives inside the any_movable,
+// anything else goes on the heap.
+// So size it for what you put in it:
+//
+//    using message_any = basic_any_movable<128, 64>; // our messages are up to 128 bytes, some are cache-line aligned
+//    using pointer_any = basic_any_movable<sizeof(void *)>; // we only ever hold pointers (or pointer-sized things)
+//
+// any_movable (see below) is the "just pick something reasonable" size.
+//
+// Allocator is where things that don't fit come from (and go back to).
+// (Its value_type doesn't matter, it gets rebound to whatever is being held.)
+// Like the std containers, moving an any_movable moves its allocator with it,
+// but move *assignment* only takes the other's allocator if propagate_on_container_move_assignment says so;
+// otherwise a heap item from an unequal allocator is moved into our own memory.
+// For example, pmr_any_movable (below) with a per-request arena:
+//
+//    std::pmr::monotonic_buffer_resource arena;
+//    pmr_any_movable a(std::allocator_arg, &arena, BigThing());
+//
+// Moving an any_movable moves the held item, if it is inline - so if the item's move can throw, so can the any_movable's.
+// NothrowMoves = true opts in to std::any's policy instead: only things that move without throwing
+// (or are any_movable_trivially_relocatable) are held inline, the rest go on the heap (even if small),
+// and then moves never throw - except for move assignment between unequal (ie non-propagating) allocators, which may allocate,
+// and moves to a smaller basic_any_movable (which may need to allocate).
+// (So std::vector<nothrow_any_movable> can move, not copy, when it grows. unique_function and inline_any_movable use it.)
+//
+template <std::size_t InlineBytes, std::size_t Align = alignof(std::max_align_t), typename Allocator = std::allocator<std::byte>,
+    bool NothrowMoves = false>
+class basic_any_movable : private any_movable_detail::AllocatorHolder<Allocator>
+{
+    static_assert(InlineBytes > 0, "basic_any_movable needs at least some storage");
+    static_assert((Align & (Align - 1)) == 0, "Align must be a power of 2");
+
+    template <std::size_t, std::size_t, typename, bool>
+    friend class basic_any_movable;
+    template <bool>
+    friend class basic_any_ref; // (to refer to our item, with our vtbl)
+
+    using AllocatorHolder = any_movable_detail::AllocatorHolder<Allocator>;
+    using AllocatorHolder::allocator;
+    using AllocTraits = std::allocator_traits<Allocator>;
+
+    struct Storage
+    {
+        alignas(Align) unsigned char data[InlineBytes];
+    };
+
+    // can moving a T (inline) throw?
+    template <typename T>
+    static constexpr bool moves_nothrow = std::is_nothrow_move_constructible_v<T> || any_movable_trivially_relocatable<T>::value;
+
+    // (with NothrowMoves, only things that can move without throwing, like std::any)
+    template <typename T>
+    static constexpr bool fits_inline = sizeof(T) <= InlineBytes && alignof(T) <= Align && (!NothrowMoves || moves_nothrow<T>);
+
+    // false for inline_any_movable - then anything that doesn't fit inline is a compile error, instead of a trip to the heap
+    static constexpr bool heap_allowed = !any_movable_detail::is_no_heap_v<Allocator>;
+
+    // could everything that fits in a basic_any_movable<OtherBytes, OtherAlign> also fit in us?
+    template <std::size_t OtherBytes, std::size_t OtherAlign>
+    static constexpr bool holds_all_of = OtherBytes <= InlineBytes && OtherAlign <= Align;
+
+    static bool fits_inline_at_runtime(any_movable_detail::VTable const * vt)
+    {
+        return vt->size <= InlineBytes && vt->align <= Align;
+    }
+
+    template <typename T>
+    using Derived = any_movable_detail::Derived<T, Allocator>;
+
+    // is vtbl T's vtable?
+    // (only if a T could be held at all - see is_holdable_v - otherwise there is no vtable to compare with)
+    template <typename T>
+    bool is_vtable_of() const
+    {
+        if constexpr (!any_movable_detail::is_holdable_v<T>)
+            return false;
+        else
+            return vtbl == &Derived<T>::vtable;
+    }
+
+    Storage storage;
+    any_movable_detail::VTable const * vtbl = nullptr;
+    void * ptr = nullptr; // the held item, either in storage (small items) or on the heap; null when empty
+
+    bool is_local() const
+    {
+        return ptr == (void const *)storage.data; // (so also not null)
+    }
+
+    template<typename T>
+    T * try_as_base() const
+    {
+        return any_movable_detail::try_as_base<T>(vtbl, ptr);
+    }
+
     template<typename T, typename ...Args>
     std::decay_t<T> & takeAndMake(Args &&... args)
     {
-        reset();
         using UT = std::decay_t<T>; // remove ref, etc
-        if (sizeof(Derived<UT>) <= sizeof(Storage))
-            ptr = new (storage.data) Derived<UT>(std::forward<Args>(args)...); // TODO: use C++20 std::construct_at for constexpr
+        if constexpr (!heap_allowed)
+        {
+            static_assert(sizeof(UT) <= InlineBytes, "inline_any_movable: too big to fit");
+            static_assert(alignof(UT) <= Align, "inline_any_movable: too aligned to fit");
+            static_assert(moves_nothrow<UT>, "inline_any_movable: moving it might throw (so it would have to go on the heap)");
+        }
+        reset();
+        if constexpr (fits_inline<UT>)
+            ptr = new (storage.data) UT(std::forward<Args>(args)...); // TODO: use C++20 std::construct_at for constexpr
+        else
+            ptr = Derived<UT>::make_new(&allocator(), std::forward<Args>(args)...);
+        vtbl = &Derived<UT>::vtable;
+        return *static_cast<UT *>(ptr);
+    }
+
+    bool same_allocator(Allocator const & other) const
+    {
+        if constexpr (AllocTraits::is_always_equal::value)
+            return true;
         else
-            ptr = new Derived<UT>(std::forward<Args>(args)...);
-        return access<UT>();
+            return allocator() == other;
     }
 
-    void take(any_movable && other)
+    template <std::size_t OtherBytes, std::size_t OtherAlign>
+    void take(basic_any_movable<OtherBytes, OtherAlign, Allocator, NothrowMoves> && other)
     {
         reset();
-        if ((void *)other.ptr == other.storage.data) // so not null either
+        if (other.is_local())
         {
             // we must transfer from one storage to another
-            // but we don't know how (we don't know what Derived is)
-            // so ask ptr to do it via a virtual function
-            ptr = other.ptr->move_to(storage.data);
-            other.ptr->~Base();
+            // but we don't know how (we don't know what T is)
+            // so ask vtbl to do it - or, for most types, just copy the bytes
+            if (!fits_inline_at_runtime(other.vtbl)) // (only possible when other is bigger than us)
+                ptr = other.vtbl->move_to_new(other.ptr, &allocator());
+            else
+            {
+                if (other.vtbl->move_to)
+                    other.vtbl->move_to(storage.data, other.ptr);
+                else if constexpr (sizeof(Storage) == sizeof(other.storage))
+                {
+                    // all of it, it's a fixed size so it's fast
+                    // (including the bytes past the item, and an empty lambda's one byte, which were never written - that's fine,
+                    // they're just copied, never looked at. But gcc can see that, and warns - and zeroing the storage up front
+                    // would cost every construction a memset, just to quiet it)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+                    std::memcpy(&storage, &other.storage, sizeof(Storage));
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+                }
+                else
+                    std::memcpy(storage.data, other.ptr, other.vtbl->size);
+                ptr = storage.data;
+            }
+        }
+        else if (other.ptr && !same_allocator(other.allocator()))
+        {
+            // we can't give it back to our allocator, so we need our own copy
+            ptr = other.vtbl->move_to_new(other.ptr, &allocator());
+            other.vtbl->deallocate(other.ptr, &other.allocator());
         }
         else
         {
             // take ownership (and might be null)
             ptr = other.ptr;
         }
+        vtbl = other.vtbl;
         other.ptr = nullptr;
+        other.vtbl = nullptr;
+    }
+
+    template <typename Self, typename ...Qs, typename F, typename Fallback>
+    static auto visit_impl(Self & self, F & f, Fallback * fallback) -> any_movable_detail::visit_result_t<F, Qs...>
+    {
+        using R = any_movable_detail::visit_result_t<F, Qs...>;
+        using Fn = R (*)(void *, F &);
+        static constexpr Fn table[] = { &any_movable_detail::invoke_as<Qs, R, F>... };
+
+        std::size_t i = self.template index_of<std::remove_const_t<Qs>...>();
+        if (i < sizeof...(Qs))
+            return table[i](self.ptr, f);
+        if (self.ptr && self.vtbl->hasDeclaredBases)
+        {
+            // the first of Qs that is a declared base
+            void * base = nullptr;
+            i = 0;
+            (void)(((base = self.vtbl->findDeclaredBase(self.ptr, typeid(Qs))) == nullptr && ++i) && ...);
+            if (base)
+                return table[i](base, f);
+        }
+        if constexpr (!std::is_same_v<Fallback, std::nullptr_t>)
+            return (*fallback)(self);
+        else
+            throw std::bad_any_cast();
+    }
+
+    template <std::size_t OtherBytes, std::size_t OtherAlign>
+    void assign(basic_any_movable<OtherBytes, OtherAlign, Allocator, NothrowMoves> && other)
+    {
+        if ((void *)this == (void *)&other)
+            return;
+        // (with NothrowMoves, only if that can't throw)
+        if (ptr && vtbl->move_assign && (!NothrowMoves || vtbl->nothrowMoveAssign) && type() == other.type()) { // we've already got one
+            vtbl->move_assign(ptr, other.ptr);
+            // we could just leave the moved-from T,
+            // but I suspect most people expect it to be reset
+            other.reset();
+        }
+        else {
+            reset(); // (with our current allocator)
+            if constexpr (AllocTraits::propagate_on_container_move_assignment::value)
+                allocator() = other.allocator();
+            take(std::move(other));
+        }
     }
 
 public:
 
     void reset()
     {
-        if ((void *)ptr == (void *)storage.data) // local? (also not null)
-            ptr->~Base();  // destroy (possibly Derived), but don't deallocate
-        else
-            delete ptr; // null is fine here
+        if (!ptr)
+            return;
+        if (vtbl->destroy) // no need to call trivial destructors
+            vtbl->destroy(ptr);
+        if (!is_local())
+            vtbl->deallocate(ptr, &allocator());
         ptr = nullptr;
+        vtbl = nullptr;
+    }
+
+    using allocator_type = Allocator;
+    Allocator get_allocator() const
+    {
+        return allocator();
     }
 
-    any_movable() {}
-    ~any_movable()
+    basic_any_movable() {}
+    explicit basic_any_movable(std::allocator_arg_t, Allocator const & alloc) : AllocatorHolder(alloc)
+    {
+    }
+    ~basic_any_movable()
     {
         reset();
     }
 
-    any_movable(any_movable &) = delete;
-    any_movable(any_movable const &) = delete;
-    any_movable & operator=(any_movable &) = delete;
-    any_movable & operator=(any_movable const &) = delete;
+    basic_any_movable(basic_any_movable &) = delete;
+    basic_any_movable(basic_any_movable const &) = delete;
+    basic_any_movable & operator=(basic_any_movable &) = delete;
+    basic_any_movable & operator=(basic_any_movable const &) = delete;
 
-    template<typename T>
-    any_movable(T && t)
+    template<typename T, typename = std::enable_if_t<!any_movable_detail::is_basic_any_movable_v<std::decay_t<T>>>>
+    basic_any_movable(T && t)
     {
         takeAndMake<T>(std::forward<T>(t));
     }
-    template<typename T>
-    any_movable & operator=(T && t)
+    template<typename T, typename = std::enable_if_t<!any_movable_detail::is_basic_any_movable_v<std::decay_t<T>>>>
+    basic_any_movable(std::allocator_arg_t, Allocator const & alloc, T && t) : AllocatorHolder(alloc)
     {
-        if (has_type<T>() && ptr->can_assign())
-            ptr->move_assign(&t); // we already hold a T, so assign it the new value
-        else
-            takeAndMake<T>(std::forward<T>(t));  // rebuild from the ground up
+        takeAndMake<T>(std::forward<T>(t));
+    }
+    template<typename T, typename = std::enable_if_t<!any_movable_detail::is_basic_any_movable_v<std::decay_t<T>>>>
+    basic_any_movable & operator=(T && t)
+    {
+        using UT = std::decay_t<T>;
+        if constexpr (std::is_assignable_v<UT &, T &&>)
+        {
+            if (has_type<UT>())
+            {
+                // we already hold a T, so assign it the new value
+                *static_cast<UT *>(ptr) = std::forward<T>(t);
+                return *this;
+            }
+        }
+        takeAndMake<T>(std::forward<T>(t));  // rebuild from the ground up
         return *this;
     }
 
-    any_movable(any_movable && other)
+    basic_any_movable(basic_any_movable && other) noexcept(NothrowMoves) : AllocatorHolder(other.allocator())
     {
         take(std::move(other));
     }
-    any_movable & operator=(any_movable && other)
+    // from other sizes (only allocates if the held item is too big for us, and wasn't already on the heap)
+    // (for inline_any_movable, only from the same size or smaller, and then it never throws)
+    template <std::size_t OtherBytes, std::size_t OtherAlign>
+    basic_any_movable(basic_any_movable<OtherBytes, OtherAlign, Allocator, NothrowMoves> && other) noexcept(!heap_allowed)
+        : AllocatorHolder(other.allocator())
     {
-        if (ptr && ptr->can_assign() && type() == other.type()) { // we've already got one
-            ptr->move_assign(other.ptr->getItem());
-            // we could just leave the moved-from T,
-            // but I suspect most people expect it to be reset
-            other.reset();
-        }
-        else {
-            take(std::move(other));
-        }
+        static_assert(heap_allowed || holds_all_of<OtherBytes, OtherAlign>, "inline_any_movable: can't move from a bigger one");
+        take(std::move(other));
+    }
+    template <std::size_t OtherBytes, std::size_t OtherAlign>
+    basic_any_movable(basic_any_movable<OtherBytes, OtherAlign, Allocator, NothrowMoves> & other) = delete;
+    template <std::size_t OtherBytes, std::size_t OtherAlign>
+    basic_any_movable(basic_any_movable<OtherBytes, OtherAlign, Allocator, NothrowMoves> const & other) = delete;
+
+    basic_any_movable & operator=(basic_any_movable && other)
+        noexcept(NothrowMoves && (AllocTraits::propagate_on_container_move_assignment::value || AllocTraits::is_always_equal::value))
+    {
+        assign(std::move(other));
+        return *this;
+    }
+    template <std::size_t OtherBytes, std::size_t OtherAlign>
+    basic_any_movable & operator=(basic_any_movable<OtherBytes, OtherAlign, Allocator, NothrowMoves> && other) noexcept(NothrowMoves && !heap_allowed)
+    {
+        static_assert(heap_allowed || holds_all_of<OtherBytes, OtherAlign>, "inline_any_movable: can't move from a bigger one");
+        assign(std::move(other));
         return *this;
     }
 
@@ -201,22 +781,63 @@ public:
 
     std::type_info const & type() const
     {
-        return ptr ? ptr->getTypeInfo() : typeid(void);
+        return ptr ? *vtbl->type : typeid(void);
     }
 
     bool has_value() const
     {
         return ptr != nullptr;
     }
+
+    // the held item, untyped (null when empty)
+    // For when you already know what it is (ie because you put it there, and remember what it was)
+    void * data()
+    {
+        return ptr;
+    }
+    void const * data() const
+    {
+        return ptr;
+    }
+    // For types with a std::hash and an operator== (see any_movable_detail::is_hashable) - ie to be a key (see any_key.h).
+    // Empty hashes as 0. hash() of an item that can't be hashed throws std::bad_any_cast.
+    bool hashable() const
+    {
+        return !ptr || vtbl->hash;
+    }
+    std::size_t hash() const
+    {
+        if (!ptr)
+            return 0;
+        if (!vtbl->hash)
+            throw std::bad_any_cast();
+        return vtbl->hash(ptr);
+    }
+    // Different types are never equal (and don't get as far as needing an operator==); two empties are equal.
+    // Same type, but it has no operator==: throws std::bad_any_cast.
+    template <std::size_t OtherBytes, std::size_t OtherAlign, typename OtherAllocator, bool OtherNothrowMoves>
+    bool equals(basic_any_movable<OtherBytes, OtherAlign, OtherAllocator, OtherNothrowMoves> const & other) const
+    {
+        if (!ptr || !other.ptr)
+            return !ptr && !other.ptr;
+        if ((void const *)vtbl != (void const *)other.vtbl && type() != other.type())
+            return false;
+        if (!vtbl->equal)
+            throw std::bad_any_cast();
+        return vtbl->equal(ptr, other.ptr);
+    }
+
     template <typename T>
     bool has_type() const
     {
-        return ptr && ptr->getTypeInfo() == typeid(T);
+        // comparing vtables is cheaper than comparing type_infos, and almost always enough
+        // (but there might be more than one vtable per T if there is more than one DLL/.so)
+        return is_vtable_of<std::remove_cv_t<std::remove_reference_t<T>>>() || (ptr && *vtbl->type == typeid(T));
     }
     template<typename T>
     bool has_dynamic_type() const
     {
-        // try_as_base is slow, last resort
+        // try_as_base is slower, last resort
         return has_type<T>() || (try_as_base<T>() != nullptr);
     }
 
@@ -224,7 +845,7 @@ public:
     T const * access_ptr() const
     {
         if (has_type<T>()) {
-            return reinterpret_cast<T const *>(ptr->getItem());
+            return static_cast<T const *>(ptr);
         }
         return nullptr;
     }
@@ -232,7 +853,7 @@ public:
     T * access_ptr()
     {
         if (has_type<T>()) {
-            return reinterpret_cast<T *>(ptr->getItem());
+            return static_cast<T *>(ptr);
         }
         return nullptr;
     }
@@ -254,7 +875,7 @@ public:
     template <typename T>
     T const * access_ptr_dynamic() const
     {
-        if (T * p = access_ptr<T>())
+        if (T const * p = access_ptr<T>())
             return p;
         return try_as_base<T>();
     }
@@ -280,67 +901,147 @@ public:
         throw std::bad_any_cast();
     }
 
+    // index of the held type in Ts..., or sizeof...(Ts) if it isn't one of them (or is empty)
+    template <typename ...Ts>
+    std::size_t index_of() const
+    {
+        std::size_t i = 0;
+        // compare vtables first (cheap), then type_infos (in case there is more than one vtable per T, ie DLLs)
+        (void)((!is_vtable_of<Ts>() && ++i) && ...);
+        if (i == sizeof...(Ts) && ptr)
+        {
+            i = 0;
+            (void)((*vtbl->type != typeid(Ts) && ++i) && ...);
+        }
+        return i;
+    }
+
+    //
+    // Calls f(t) where t is the held item as whichever of Ts... it is,
+    // via a jump table (ie not a chain of has_type<T>() checks).
+    // If it is none of those, but declares (see any_movable_bases) one of Ts as a base, f(base) for the first such.
+    // (Undeclared bases are not looked for - that is what access_dynamic is for.)
+    // Otherwise throws std::bad_any_cast, or, if you gave one, calls fallback(*this)
+    //
+    template <typename ...Ts, typename F>
+    decltype(auto) visit(F && f)
+    {
+        static_assert(sizeof...(Ts) > 0, "visit needs at least one type");
+        return visit_impl<basic_any_movable, Ts...>(*this, f, (std::nullptr_t *)nullptr);
+    }
+    template <typename ...Ts, typename F>
+    decltype(auto) visit(F && f) const
+    {
+        static_assert(sizeof...(Ts) > 0, "visit needs at least one type");
+        return visit_impl<basic_any_movable const, Ts const...>(*this, f, (std::nullptr_t *)nullptr);
+    }
+    template <typename ...Ts, typename F, typename Fallback>
+    decltype(auto) visit(F && f, Fallback && fallback)
+    {
+        static_assert(sizeof...(Ts) > 0, "visit needs at least one type");
+        return visit_impl<basic_any_movable, Ts...>(*this, f, &fallback);
+    }
+    template <typename ...Ts, typename F, typename Fallback>
+    decltype(auto) visit(F && f, Fallback && fallback) const
+    {
+        static_assert(sizeof...(Ts) > 0, "visit needs at least one type");
+        return visit_impl<basic_any_movable const, Ts const...>(*this, f, &fallback);
+    }
 };
 
-template <typename T>
-[[nodiscard]] T const * any_dynamic_cast(any_movable const * a)
+using any_movable = basic_any_movable<6 * sizeof(void *), alignof(long double)>; // approx same size as std::function's buffer
+
+// same size as any_movable, but big things come from a std::pmr::memory_resource
+using pmr_any_movable = basic_any_movable<6 * sizeof(void *), alignof(long double), std::pmr::polymorphic_allocator<std::byte>>;
+
+// same size as any_movable, but moves never throw (things whose moves might throw go on the heap, however small - like std::any)
+using nothrow_any_movable = basic_any_movable<6 * sizeof(void *), alignof(long double), std::allocator<std::byte>, true>;
+
+// never allocates: holding anything that doesn't fit (or whose move might throw) is a compile error,
+// and all of its moves are noexcept - for realtime threads, where a surprise trip to the heap is a bug
+template <std::size_t InlineBytes, std::size_t Align = alignof(std::max_align_t)>
+using inline_any_movable = basic_any_movable<InlineBytes, Align, any_movable_no_heap<>, true>;
+
+template <typename T, std::size_t N, std::size_t A, typename Al, bool NM>
+[[nodiscard]] T const * any_dynamic_cast(basic_any_movable<N, A, Al, NM> const * a)
 {
-    return a->access_ptr_dynamic<T>();
+    return a->template access_ptr_dynamic<T>();
 }
-template <typename T>
-[[nodiscard]] T * any_dynamic_cast(any_movable * a)
+template <typename T, std::size_t N, std::size_t A, typename Al, bool NM>
+[[nodiscard]] T * any_dynamic_cast(basic_any_movable<N, A, Al, NM> * a)
 {
-    return a->access_ptr_dynamic<T>();
+    return a->template access_ptr_dynamic<T>();
 }
 
-template <typename T>
-[[nodiscard]] T const & any_dynamic_cast(any_movable const & a)
+template <typename T, std::size_t N, std::size_t A, typename Al, bool NM>
+[[nodiscard]] T const & any_dynamic_cast(basic_any_movable<N, A, Al, NM> const & a)
 {
-    return a.access_dynamic<T>();
+    return a.template access_dynamic<T>();
 }
-template <typename T>
-[[nodiscard]] T & any_dynamic_cast(any_movable & a)
+template <typename T, std::size_t N, std::size_t A, typename Al, bool NM>
+[[nodiscard]] T & any_dynamic_cast(basic_any_movable<N, A, Al, NM> & a)
 {
-    return a.access_dynamic<T>();
+    return a.template access_dynamic<T>();
 }
-template <typename T>
-[[nodiscard]] T && any_dynamic_cast(any_movable && a)
+template <typename T, std::size_t N, std::size_t A, typename Al, bool NM>
+[[nodiscard]] T && any_dynamic_cast(basic_any_movable<N, A, Al, NM> && a)
 {
-    return std::move(a.access_dynamic<T>());
+    return std::move(a.template access_dynamic<T>());
+}
+
+template <typename ...Ts, std::size_t N, std::size_t A, typename Al, bool NM, typename F>
+decltype(auto) visit(basic_any_movable<N, A, Al, NM> & a, F && f)
+{
+    return a.template visit<Ts...>(std::forward<F>(f));
+}
+template <typename ...Ts, std::size_t N, std::size_t A, typename Al, bool NM, typename F>
+decltype(auto) visit(basic_any_movable<N, A, Al, NM> const & a, F && f)
+{
+    return a.template visit<Ts...>(std::forward<F>(f));
+}
+template <typename ...Ts, std::size_t N, std::size_t A, typename Al, bool NM, typename F, typename Fallback>
+decltype(auto) visit(basic_any_movable<N, A, Al, NM> & a, F && f, Fallback && fallback)
+{
+    return a.template visit<Ts...>(std::forward<F>(f), std::forward<Fallback>(fallback));
+}
+template <typename ...Ts, std::size_t N, std::size_t A, typename Al, bool NM, typename F, typename Fallback>
+decltype(auto) visit(basic_any_movable<N, A, Al, NM> const & a, F && f, Fallback && fallback)
+{
+    return a.template visit<Ts...>(std::forward<F>(f), std::forward<Fallback>(fallback));
 }
 
 
 // it is (somewhat) OK to open std namespace when you are overloading on your own type
 namespace std
 {
-    template <typename T>
-    [[nodiscard]] T const * any_cast(any_movable const * a)
+    template <typename T, std::size_t N, std::size_t A, typename Al, bool NM>
+    [[nodiscard]] T const * any_cast(basic_any_movable<N, A, Al, NM> const * a)
     {
-        return a ? a->access_ptr<T>() : nullptr;
+        return a ? a->template access_ptr<T>() : nullptr;
     }
-    template <typename T>
-    [[nodiscard]] T * any_cast(any_movable * a)
+    template <typename T, std::size_t N, std::size_t A, typename Al, bool NM>
+    [[nodiscard]] T * any_cast(basic_any_movable<N, A, Al, NM> * a)
     {
-        return a ? a->access_ptr<T>() : nullptr;
+        return a ? a->template access_ptr<T>() : nullptr;
     }
 
     //
     // for references, std::any returns a copy of T, but I think T & makes more sense
     //
-    template <typename T>
-    [[nodiscard]] T const & any_cast(any_movable const & a)
+    template <typename T, std::size_t N, std::size_t A, typename Al, bool NM>
+    [[nodiscard]] T const & any_cast(basic_any_movable<N, A, Al, NM> const & a)
     {
-        return a.access<T>();
+        return a.template access<T>();
     }
-    template <typename T>
-    [[nodiscard]] T & any_cast(any_movable & a)
+    template <typename T, std::size_t N, std::size_t A, typename Al, bool NM>
+    [[nodiscard]] T & any_cast(basic_any_movable<N, A, Al, NM> & a)
     {
-        return a.access<T>();
+        return a.template access<T>();
     }
-    template <typename T>
-    [[nodiscard]] T && any_cast(any_movable && a)
+    template <typename T, std::size_t N, std::size_t A, typename Al, bool NM>
+    [[nodiscard]] T && any_cast(basic_any_movable<N, A, Al, NM> && a)
     {
-        return std::move(a.access<T>());
+        return std::move(a.template access<T>());
     }
 }
 
@@ -0,0 +1,364 @@
+#ifndef any_movable_pool_h_INCLUDED
+#define any_movable_pool_h_INCLUDED
+
+#include "any_movable.h"
+
+#include <new> // operator new with align_val_t
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <array>
+#include <cstddef> // std::size_t, std::byte
+#include <type_traits>
+
+//
+// An opt-in pool for the things that are too big to fit inside an any_movable.
+//
+// Instead of threading an allocator through every call site, just use pooled_any_movable
+// (or basic_any_movable<N, A, any_movable_pool_allocator<>>) and big items come from here:
+//
+// - blocks are grouped into power-of-2 size classes (64 bytes to 4K)
+// - each thread keeps its own freelist per size class (so no locking in the common case)
+// - when a thread has too many free blocks, it gives a batch of them back to a shared pool,
+//   and when it runs out, it takes a whole batch from the shared pool (so locking is rare)
+// - anything bigger than 4K (or more aligned than 64) just goes to operator new
+// - at thread exit, the thread's cache goes to the shared pool; anything freed after that (ie by another thread_local's destructor)
+//   goes straight to the shared pool too
+//
+// Blocks are never given back to operator delete, except via trim().
+//
+// stats() tells you how well it is working - ie hits (served from the pool) vs misses (had to call operator new).
+// (Each thread counts its own, so counting doesn't put a shared cache line on the hot path; stats() adds them up.)
+//
+namespace any_movable_pool
+{
+    constexpr std::size_t min_block_size = 64;
+    constexpr std::size_t max_block_size = 4096;
+    constexpr std::size_t num_size_classes = 7; // 64, 128, ..., 4096
+    constexpr std::size_t max_align = 64; // all blocks are (at least) cache-line aligned
+    constexpr std::size_t thread_cache_limit = 64; // per size class
+    constexpr std::size_t batch_size = 32; // moved to/from the shared pool at a time
+
+    struct size_class_stats
+    {
+        std::size_t block_size = 0;
+        std::size_t hits = 0; // allocations served from a freelist
+        std::size_t misses = 0; // allocations that needed a new block from operator new
+        std::size_t blocks_in_use = 0;
+        std::size_t bytes_in_use() const { return blocks_in_use * block_size; }
+    };
+    struct pool_stats
+    {
+        std::array<size_class_stats, num_size_classes> size_classes;
+        std::size_t unpooled = 0; // allocations too big (or too aligned) for the pool
+    };
+
+    namespace detail
+    {
+        inline std::size_t size_class(std::size_t bytes)
+        {
+            std::size_t c = 0;
+            while ((min_block_size << c) < bytes)
+                c++;
+            return c;
+        }
+        inline std::size_t block_size(std::size_t sizeClass)
+        {
+            return min_block_size << sizeClass;
+        }
+
+        // an intrusive singly-linked list of free blocks (the "next" pointer lives in the free block itself)
+        struct FreeList
+        {
+            void * head = nullptr;
+            std::size_t count = 0;
+
+            void push(void * block)
+            {
+                *static_cast<void **>(block) = head;
+                head = block;
+                count++;
+            }
+            void * pop()
+            {
+                void * block = head;
+                head = *static_cast<void **>(block);
+                count--;
+                return block;
+            }
+            // take the first n blocks off this list, as their own list
+            FreeList split(std::size_t n)
+            {
+                FreeList batch;
+                while (batch.count < n && count)
+                    batch.push(pop());
+                return batch;
+            }
+        };
+
+        // Each thread counts in its own cache (so the hot path doesn't share a cache line with every other thread),
+        // and folds its counts into the shared ones at exit. stats() adds up the shared ones and every live thread's.
+        // (in_use can "go negative" in a thread that frees what others allocated - it wraps, and the sum comes out right)
+        struct Counters
+        {
+            std::atomic<std::size_t> hits{ 0 };
+            std::atomic<std::size_t> misses{ 0 };
+            std::atomic<std::size_t> in_use{ 0 };
+        };
+        // only the owning thread writes its counters, so no need for a (locked) read-modify-write - just don't tear for stats()
+        inline void bump(std::atomic<std::size_t> & counter, std::size_t by)
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+        }
+
+        struct ThreadCache;
+
+        struct SharedPool
+        {
+            struct alignas(64) SizeClass
+            {
+                std::mutex mutex;
+                std::vector<FreeList> batches;
+            };
+            SizeClass sizeClasses[num_size_classes];
+            Counters counters[num_size_classes]; // (exited threads', and frees after a thread's cache is gone)
+            std::atomic<std::size_t> unpooled{ 0 };
+
+            std::mutex threadsMutex;
+            std::vector<ThreadCache *> threads; // (live ones - for stats())
+
+            void give(std::size_t c, FreeList batch)
+            {
+                std::lock_guard<std::mutex> lock(sizeClasses[c].mutex);
+                sizeClasses[c].batches.push_back(batch);
+            }
+            bool take(std::size_t c, FreeList & into)
+            {
+                std::lock_guard<std::mutex> lock(sizeClasses[c].mutex);
+                if (sizeClasses[c].batches.empty())
+                    return false;
+                into = sizeClasses[c].batches.back();
+                sizeClasses[c].batches.pop_back();
+                return true;
+            }
+            void trim()
+            {
+                for (std::size_t c = 0; c < num_size_classes; c++)
+                {
+                    std::vector<FreeList> batches;
+                    {
+                        std::lock_guard<std::mutex> lock(sizeClasses[c].mutex);
+                        batches.swap(sizeClasses[c].batches);
+                    }
+                    for (FreeList & batch : batches)
+                        while (batch.count)
+                            ::operator delete(batch.pop(), std::align_val_t(max_align));
+                }
+            }
+        };
+
+        inline SharedPool & shared()
+        {
+            // never destroyed - statics (and thread_locals of threads still running at exit) can free into it until the very end
+            static SharedPool & pool = *new SharedPool;
+            return pool;
+        }
+
+        // set when this thread's cache has been destroyed (at thread exit)
+        // - a plain bool, so it is still there for other thread_locals' destructors that free things after that
+        inline bool & thread_cache_gone()
+        {
+            static thread_local bool gone = false;
+            return gone;
+        }
+
+        struct ThreadCache
+        {
+            FreeList lists[num_size_classes];
+            Counters counters[num_size_classes];
+
+            ThreadCache()
+            {
+                SharedPool & pool = shared();
+                std::lock_guard<std::mutex> lock(pool.threadsMutex);
+                pool.threads.push_back(this);
+            }
+            void flush()
+            {
+                for (std::size_t c = 0; c < num_size_classes; c++)
+                    while (lists[c].count)
+                        shared().give(c, lists[c].split(batch_size));
+            }
+            ~ThreadCache()
+            {
+                flush();
+                SharedPool & pool = shared();
+                {
+                    std::lock_guard<std::mutex> lock(pool.threadsMutex);
+                    for (std::size_t c = 0; c < num_size_classes; c++)
+                    {
+                        pool.counters[c].hits.fetch_add(counters[c].hits.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                        pool.counters[c].misses.fetch_add(counters[c].misses.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                        pool.counters[c].in_use.fetch_add(counters[c].in_use.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                    }
+                    for (std::size_t i = 0; i < pool.threads.size(); i++)
+                        if (pool.threads[i] == this)
+                        {
+                            pool.threads[i] = pool.threads.back();
+                            pool.threads.pop_back();
+                            break;
+                        }
+                }
+                thread_cache_gone() = true;
+            }
+        };
+
+        // null once this thread's cache is gone - then go straight to the shared pool
+        inline ThreadCache * thread_cache()
+        {
+            if (thread_cache_gone())
+                return nullptr;
+            static thread_local ThreadCache cache;
+            return &cache;
+        }
+    }
+
+    inline void * allocate(std::size_t bytes, std::size_t align)
+    {
+        using namespace detail;
+        if (bytes > max_block_size || align > max_align)
+        {
+            shared().unpooled.fetch_add(1, std::memory_order_relaxed);
+            return ::operator new(bytes, std::align_val_t(align));
+        }
+
+        std::size_t c = size_class(bytes);
+        if (ThreadCache * cache = thread_cache())
+        {
+            Counters & counters = cache->counters[c];
+            bump(counters.in_use, 1);
+            FreeList & list = cache->lists[c];
+            if (list.count || shared().take(c, list))
+            {
+                bump(counters.hits, 1);
+                return list.pop();
+            }
+            bump(counters.misses, 1);
+        }
+        else
+        {
+            Counters & counters = shared().counters[c];
+            counters.in_use.fetch_add(1, std::memory_order_relaxed);
+            FreeList batch;
+            if (shared().take(c, batch))
+            {
+                counters.hits.fetch_add(1, std::memory_order_relaxed);
+                void * block = batch.pop();
+                if (batch.count)
+                    shared().give(c, batch); // (the rest of it)
+                return block;
+            }
+            counters.misses.fetch_add(1, std::memory_order_relaxed);
+        }
+        return ::operator new(block_size(c), std::align_val_t(max_align));
+    }
+
+    inline void deallocate(void * p, std::size_t bytes, std::size_t align)
+    {
+        using namespace detail;
+        if (bytes > max_block_size || align > max_align)
+        {
+            ::operator delete(p, std::align_val_t(align));
+            return;
+        }
+
+        std::size_t c = size_class(bytes);
+        ThreadCache * cache = thread_cache();
+        if (!cache)
+        {
+            shared().counters[c].in_use.fetch_sub(1, std::memory_order_relaxed);
+            // a batch of one
+            FreeList one;
+            one.push(p);
+            shared().give(c, one);
+            return;
+        }
+        bump(cache->counters[c].in_use, std::size_t(-1));
+        FreeList & list = cache->lists[c];
+        list.push(p);
+        if (list.count > thread_cache_limit)
+            shared().give(c, list.split(batch_size));
+    }
+
+    inline pool_stats stats()
+    {
+        pool_stats s;
+        detail::SharedPool & pool = detail::shared();
+        auto add = [&s](detail::Counters const (&counters)[num_size_classes]) {
+            for (std::size_t c = 0; c < num_size_classes; c++)
+            {
+                s.size_classes[c].hits += counters[c].hits.load(std::memory_order_relaxed);
+                s.size_classes[c].misses += counters[c].misses.load(std::memory_order_relaxed);
+                s.size_classes[c].blocks_in_use += counters[c].in_use.load(std::memory_order_relaxed);
+            }
+        };
+        {
+            std::lock_guard<std::mutex> lock(pool.threadsMutex); // (so a thread exiting right now is counted once)
+            add(pool.counters);
+            for (detail::ThreadCache const * cache : pool.threads)
+                add(cache->counters);
+        }
+        for (std::size_t c = 0; c < num_size_classes; c++)
+            s.size_classes[c].block_size = detail::block_size(c);
+        s.unpooled = pool.unpooled.load(std::memory_order_relaxed);
+        return s;
+    }
+
+    // give this thread's free blocks back to the shared pool (happens automatically at thread exit)
+    inline void flush_thread_cache()
+    {
+        if (detail::ThreadCache * cache = detail::thread_cache())
+            cache->flush();
+    }
+
+    // give the shared pool's free blocks back to operator delete
+    // (blocks still sitting in threads' caches are not touched - flush_thread_cache() first)
+    inline void trim()
+    {
+        detail::shared().trim();
+    }
+}
+
+// A std-style allocator that gets its memory from any_movable_pool
+template <typename T = std::byte>
+struct any_movable_pool_allocator
+{
+    using value_type = T;
+    using is_always_equal = std::true_type; // there's only one pool
+    using propagate_on_container_move_assignment = std::true_type;
+
+    any_movable_pool_allocator() = default;
+    template <typename U>
+    any_movable_pool_allocator(any_movable_pool_allocator<U> const &)
+    {
+    }
+
+    T * allocate(std::size_t n)
+    {
+        return static_cast<T *>(any_movable_pool::allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T * p, std::size_t n)
+    {
+        any_movable_pool::deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    template <typename U>
+    friend bool operator==(any_movable_pool_allocator const &, any_movable_pool_allocator<U> const &) { return true; }
+    template <typename U>
+    friend bool operator!=(any_movable_pool_allocator const &, any_movable_pool_allocator<U> const &) { return false; }
+};
+
+// same size as any_movable, but big things come from any_movable_pool
+using pooled_any_movable = basic_any_movable<6 * sizeof(void *), alignof(long double), any_movable_pool_allocator<>>;
+
+#endif // _h
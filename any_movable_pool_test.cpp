@@ -0,0 +1,203 @@
+#include "any_movable_pool.h"
+
+#include <gtest/gtest.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    template <std::size_t size>
+    struct Big
+    {
+        char buf[size];
+        int val = 17;
+    };
+
+    // the pool is global, so tests look at differences
+    any_movable_pool::size_class_stats statsFor(std::size_t bytes)
+    {
+        return any_movable_pool::stats().size_classes[any_movable_pool::detail::size_class(bytes)];
+    }
+}
+
+TEST(any_movable_pool, size_classes)
+{
+    using namespace any_movable_pool::detail;
+    EXPECT_EQ(0u, size_class(1));
+    EXPECT_EQ(0u, size_class(64));
+    EXPECT_EQ(1u, size_class(65));
+    EXPECT_EQ(1u, size_class(128));
+    EXPECT_EQ(6u, size_class(4096));
+    EXPECT_EQ(4096u, block_size(6));
+}
+
+TEST(any_movable_pool, small_items_do_not_use_pool)
+{
+    auto before = any_movable_pool::stats();
+    {
+        pooled_any_movable a = 17;
+    }
+    auto after = any_movable_pool::stats();
+    for (std::size_t c = 0; c < any_movable_pool::num_size_classes; c++)
+    {
+        EXPECT_EQ(before.size_classes[c].hits, after.size_classes[c].hits);
+        EXPECT_EQ(before.size_classes[c].misses, after.size_classes[c].misses);
+    }
+}
+
+TEST(any_movable_pool, freed_blocks_are_reused)
+{
+    using Item = Big<200>;
+    auto before = statsFor(sizeof(Item));
+    void * first;
+    {
+        pooled_any_movable a = Item();
+        first = a.access_ptr<Item>();
+        EXPECT_EQ(before.blocks_in_use + 1, statsFor(sizeof(Item)).blocks_in_use);
+        EXPECT_EQ(256u, statsFor(sizeof(Item)).block_size);
+    }
+    EXPECT_EQ(before.blocks_in_use, statsFor(sizeof(Item)).blocks_in_use);
+
+    auto middle = statsFor(sizeof(Item));
+    {
+        pooled_any_movable b = Item();
+        EXPECT_EQ(first, b.access_ptr<Item>()); // last freed, first reused
+        EXPECT_EQ(17, b.access<Item>().val);
+    }
+    auto after = statsFor(sizeof(Item));
+    EXPECT_EQ(middle.hits + 1, after.hits);
+    EXPECT_EQ(middle.misses, after.misses);
+}
+
+TEST(any_movable_pool, moves_do_not_allocate)
+{
+    using Item = Big<1000>;
+    pooled_any_movable a = Item();
+    auto before = statsFor(sizeof(Item));
+
+    pooled_any_movable b = std::move(a);
+    pooled_any_movable c;
+    c = std::move(b);
+
+    auto after = statsFor(sizeof(Item));
+    EXPECT_EQ(before.hits, after.hits);
+    EXPECT_EQ(before.misses, after.misses);
+    EXPECT_EQ(before.blocks_in_use, after.blocks_in_use);
+    EXPECT_TRUE(c.has_type<Item>());
+}
+
+TEST(any_movable_pool, too_big_is_unpooled)
+{
+    auto before = any_movable_pool::stats().unpooled;
+    {
+        pooled_any_movable a = Big<10000>();
+        EXPECT_EQ(17, a.access<Big<10000>>().val);
+    }
+    EXPECT_EQ(before + 1, any_movable_pool::stats().unpooled);
+}
+
+TEST(any_movable_pool, overflow_goes_to_shared_pool)
+{
+    using Item = Big<2000>;
+    const std::size_t count = any_movable_pool::thread_cache_limit * 3;
+    {
+        std::vector<pooled_any_movable> items;
+        for (std::size_t i = 0; i < count; i++)
+            items.push_back(Item());
+    } // frees more than the thread cache holds, so batches go to the shared pool
+
+    // another thread gets them
+    auto before = statsFor(sizeof(Item));
+    std::thread t([count] {
+        std::vector<pooled_any_movable> items;
+        for (std::size_t i = 0; i < count - any_movable_pool::thread_cache_limit; i++)
+            items.push_back(Item());
+    });
+    t.join();
+    auto after = statsFor(sizeof(Item));
+    EXPECT_EQ(before.misses, after.misses);
+    EXPECT_EQ(before.hits + count - any_movable_pool::thread_cache_limit, after.hits);
+}
+
+TEST(any_movable_pool, freed_on_other_thread)
+{
+    using Item = Big<500>;
+    auto before = statsFor(sizeof(Item));
+    {
+        pooled_any_movable a = Item();
+        std::thread t([&a] { a.reset(); });
+        t.join();
+    }
+    EXPECT_EQ(before.blocks_in_use, statsFor(sizeof(Item)).blocks_in_use);
+}
+
+TEST(any_movable_pool, stats_count_live_threads)
+{
+    // (each thread counts in its own cache - stats() has to find them)
+    using Item = Big<700>;
+    auto before = statsFor(sizeof(Item));
+    std::mutex m;
+    std::condition_variable cv;
+    bool allocated = false, checked = false;
+    std::thread t([&] {
+        pooled_any_movable a = Item();
+        std::unique_lock<std::mutex> lock(m);
+        allocated = true;
+        cv.notify_all();
+        cv.wait(lock, [&] { return checked; });
+    });
+    {
+        std::unique_lock<std::mutex> lock(m);
+        cv.wait(lock, [&] { return allocated; });
+        auto during = statsFor(sizeof(Item));
+        EXPECT_EQ(before.blocks_in_use + 1, during.blocks_in_use);
+        EXPECT_EQ(before.hits + before.misses + 1, during.hits + during.misses);
+        checked = true;
+        cv.notify_all();
+    }
+    t.join();
+    auto after = statsFor(sizeof(Item));
+    EXPECT_EQ(before.blocks_in_use, after.blocks_in_use);
+    EXPECT_EQ(before.hits + before.misses + 1, after.hits + after.misses); // (folded in at thread exit)
+}
+
+TEST(any_movable_pool, trim_empties_shared_pool)
+{
+    using Item = Big<3000>;
+    {
+        pooled_any_movable a = Item();
+    }
+    any_movable_pool::flush_thread_cache();
+    any_movable_pool::trim();
+
+    auto before = statsFor(sizeof(Item));
+    {
+        pooled_any_movable a = Item();
+    }
+    EXPECT_EQ(before.misses + 1, statsFor(sizeof(Item)).misses);
+}
+
+TEST(any_movable_pool, freed_after_thread_cache_is_gone)
+{
+    using Item = Big<100>;
+    // start with nothing free anywhere (that we can see)
+    any_movable_pool::flush_thread_cache();
+    any_movable_pool::trim();
+
+    auto before = statsFor(sizeof(Item));
+    std::thread t([] {
+        // constructed before this thread's cache, so destroyed after it (thread_locals go in reverse order)
+        static thread_local pooled_any_movable late;
+        late = Item();
+    });
+    t.join();
+    EXPECT_EQ(before.blocks_in_use, statsFor(sizeof(Item)).blocks_in_use);
+
+    // the block went to the shared pool (not into the cache that was already gone), so we get it back
+    auto middle = statsFor(sizeof(Item));
+    pooled_any_movable a = Item();
+    EXPECT_EQ(middle.hits + 1, statsFor(sizeof(Item)).hits);
+}
@@ -0,0 +1,256 @@
+#ifndef any_movable_queue_h_INCLUDED
+#define any_movable_queue_h_INCLUDED
+
+#include "any_movable.h"
+
+#include <atomic>
+#include <memory> // unique_ptr
+#include <cstddef>
+#include <utility>
+
+//
+// Bounded lock-free queues of "anything", where each slot *is* an any_movable (or whatever basic_any_movable you choose).
+// Producers construct their message right in the slot:
+//
+//    q.try_emplace<Message>(args...);
+//
+// and consumers look at it right in the slot, before giving the slot back:
+//
+//    q.try_consume([](any_movable & msg) { ... });
+//
+// So there is no moving in and moving out - zero copies if the message fits in the slot
+// (if it doesn't fit, it is allocated as any_movable does, and only the pointer is handed off).
+//
+// Slots and indexes are each on their own cache line, so producers and consumers don't fight over them.
+// Capacity is rounded up to a power of 2.
+//
+namespace any_movable_queue_detail
+{
+    constexpr std::size_t cache_line = 64;
+
+    inline std::size_t round_up_pow2(std::size_t n)
+    {
+        std::size_t p = 1;
+        while (p < n)
+            p <<= 1;
+        return p;
+    }
+}
+
+//
+// Single producer, single consumer
+// (ie one thread may call try_emplace/try_push, and one (other) thread may call try_consume)
+//
+template <typename Any = any_movable>
+class any_spsc_queue
+{
+    static constexpr std::size_t cache_line = any_movable_queue_detail::cache_line;
+
+    struct alignas(cache_line) Slot
+    {
+        Any value;
+    };
+
+    std::size_t const mask;
+    std::unique_ptr<Slot[]> slots;
+
+    // consumer's
+    alignas(cache_line) std::atomic<std::size_t> head{ 0 };
+    std::size_t tailCache = 0; // the last tail the consumer saw (so it doesn't need to look every time)
+    // producer's
+    alignas(cache_line) std::atomic<std::size_t> tail{ 0 };
+    std::size_t headCache = 0; // the last head the producer saw
+
+public:
+    explicit any_spsc_queue(std::size_t capacity)
+        : mask(any_movable_queue_detail::round_up_pow2(capacity ? capacity : 1) - 1)
+        , slots(new Slot[mask + 1])
+    {
+    }
+    any_spsc_queue(any_spsc_queue const &) = delete;
+    any_spsc_queue & operator=(any_spsc_queue const &) = delete;
+
+    std::size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+    // constructs a T in the next slot; returns false (and constructs nothing) if the queue is full
+    template <typename T, typename ...Args>
+    bool try_emplace(Args &&... args)
+    {
+        std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t - headCache > mask)
+        {
+            headCache = head.load(std::memory_order_acquire);
+            if (t - headCache > mask)
+                return false;
+        }
+        slots[t & mask].value.template emplace<T>(std::forward<Args>(args)...); // if this throws, nothing was published
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+    template <typename T>
+    bool try_push(T && t)
+    {
+        return try_emplace<std::decay_t<T>>(std::forward<T>(t));
+    }
+
+    // calls f(Any &) on the oldest message, in place, then destroys it and frees the slot
+    // returns false if the queue was empty
+    template <typename F>
+    bool try_consume(F && f)
+    {
+        std::size_t h = head.load(std::memory_order_relaxed);
+        if (h == tailCache)
+        {
+            tailCache = tail.load(std::memory_order_acquire);
+            if (h == tailCache)
+                return false;
+        }
+        Any & value = slots[h & mask].value;
+        struct Release // even if f throws
+        {
+            any_spsc_queue & q;
+            Any & value;
+            std::size_t h;
+            ~Release()
+            {
+                value.reset();
+                q.head.store(h + 1, std::memory_order_release);
+            }
+        } release{ *this, value, h };
+        f(value);
+        return true;
+    }
+
+    // only a hint, unless called by the consumer (then, if false, it stays false)
+    bool empty() const
+    {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+};
+
+//
+// Multiple producers, multiple consumers
+// (Dmitry Vyukov's bounded MPMC queue - each slot has a sequence number saying whose turn it is)
+//
+template <typename Any = any_movable>
+class any_mpmc_queue
+{
+    static constexpr std::size_t cache_line = any_movable_queue_detail::cache_line;
+
+    struct alignas(cache_line) Slot
+    {
+        std::atomic<std::size_t> sequence;
+        Any value;
+    };
+
+    std::size_t const mask;
+    std::unique_ptr<Slot[]> slots;
+
+    alignas(cache_line) std::atomic<std::size_t> tail{ 0 }; // producers
+    alignas(cache_line) std::atomic<std::size_t> head{ 0 }; // consumers
+
+    // finds a slot that is ready (for producers, ready == pos; for consumers, ready == pos + 1)
+    // and claims it by advancing index; returns null if full/empty
+    Slot * claim(std::atomic<std::size_t> & index, std::size_t ready_offset, std::size_t & pos)
+    {
+        pos = index.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Slot & slot = slots[pos & mask];
+            std::size_t seq = slot.sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = (std::ptrdiff_t)seq - (std::ptrdiff_t)(pos + ready_offset);
+            if (diff == 0)
+            {
+                if (index.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    return &slot;
+                // else pos was updated, try again
+            }
+            else if (diff < 0)
+                return nullptr; // full (for producers) or empty (for consumers)
+            else
+                pos = index.load(std::memory_order_relaxed); // someone beat us to it
+        }
+    }
+
+public:
+    explicit any_mpmc_queue(std::size_t capacity)
+        : mask(any_movable_queue_detail::round_up_pow2(capacity < 2 ? 2 : capacity) - 1)
+        , slots(new Slot[mask + 1])
+    {
+        for (std::size_t i = 0; i <= mask; i++)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    any_mpmc_queue(any_mpmc_queue const &) = delete;
+    any_mpmc_queue & operator=(any_mpmc_queue const &) = delete;
+
+    std::size_t capacity() const
+    {
+        return mask + 1;
+    }
+
+    // constructs a T in the next slot; returns false (and constructs nothing) if the queue is full
+    // If T's constructor throws, the slot is published empty (and skipped by consumers), and the exception is rethrown
+    template <typename T, typename ...Args>
+    bool try_emplace(Args &&... args)
+    {
+        std::size_t pos;
+        Slot * slot = claim(tail, 0, pos);
+        if (!slot)
+            return false;
+        struct Publish // even if T's constructor throws
+        {
+            Slot & slot;
+            std::size_t pos;
+            ~Publish()
+            {
+                slot.sequence.store(pos + 1, std::memory_order_release);
+            }
+        } publish{ *slot, pos };
+        slot->value.template emplace<T>(std::forward<Args>(args)...);
+        return true;
+    }
+    template <typename T>
+    bool try_push(T && t)
+    {
+        return try_emplace<std::decay_t<T>>(std::forward<T>(t));
+    }
+
+    // calls f(Any &) on the oldest message, in place, then destroys it and frees the slot
+    // returns false if the queue was empty
+    template <typename F>
+    bool try_consume(F && f)
+    {
+        for (;;)
+        {
+            std::size_t pos;
+            Slot * slot = claim(head, 1, pos);
+            if (!slot)
+                return false;
+            struct Release // even if f throws
+            {
+                Slot & slot;
+                std::size_t next;
+                ~Release()
+                {
+                    slot.value.reset();
+                    slot.sequence.store(next, std::memory_order_release);
+                }
+            } release{ *slot, pos + mask + 1 };
+            if (!slot->value.has_value())
+                continue; // a producer's constructor threw
+            f(slot->value);
+            return true;
+        }
+    }
+
+    // only a hint
+    bool empty() const
+    {
+        return head.load(std::memory_order_acquire) >= tail.load(std::memory_order_acquire);
+    }
+};
+
+#endif // _h
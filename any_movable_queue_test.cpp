@@ -0,0 +1,161 @@
+#include "any_movable_queue.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    // any_movable needs its items to be movable, so count the moves instead
+    struct NoMoves
+    {
+        static inline int moves = 0;
+        int val;
+        explicit NoMoves(int v) : val(v) {}
+        NoMoves(NoMoves && other) noexcept : val(other.val) { moves++; }
+    };
+
+    struct ThrowsOnConstruct
+    {
+        ThrowsOnConstruct() { throw 17; }
+    };
+}
+
+TEST(any_spsc_queue, capacity_is_power_of_2)
+{
+    any_spsc_queue<> q(5);
+    EXPECT_EQ(8u, q.capacity());
+}
+
+TEST(any_spsc_queue, empty_consume_fails)
+{
+    any_spsc_queue<> q(4);
+    EXPECT_TRUE(q.empty());
+    EXPECT_FALSE(q.try_consume([](any_movable &) { FAIL(); }));
+}
+
+TEST(any_spsc_queue, fifo_and_full)
+{
+    any_spsc_queue<> q(4);
+    EXPECT_TRUE(q.try_push(1));
+    EXPECT_TRUE(q.try_push(std::string("two")));
+    EXPECT_TRUE(q.try_push(3));
+    EXPECT_TRUE(q.try_push(std::make_unique<int>(4)));
+    EXPECT_FALSE(q.try_push(5)); // full
+
+    EXPECT_TRUE(q.try_consume([](any_movable & a) { EXPECT_EQ(1, a.access<int>()); }));
+    EXPECT_TRUE(q.try_consume([](any_movable & a) { EXPECT_EQ("two", a.access<std::string>()); }));
+    EXPECT_TRUE(q.try_push(5)); // room again
+    EXPECT_TRUE(q.try_consume([](any_movable & a) { EXPECT_EQ(3, a.access<int>()); }));
+    EXPECT_TRUE(q.try_consume([](any_movable & a) { EXPECT_EQ(4, *a.access<std::unique_ptr<int>>()); }));
+    EXPECT_TRUE(q.try_consume([](any_movable & a) { EXPECT_EQ(5, a.access<int>()); }));
+    EXPECT_TRUE(q.empty());
+}
+
+TEST(any_spsc_queue, constructs_in_place)
+{
+    NoMoves::moves = 0;
+    any_spsc_queue<> q(2);
+    EXPECT_TRUE(q.try_emplace<NoMoves>(17));
+    EXPECT_TRUE(q.try_consume([](any_movable & a) { EXPECT_EQ(17, a.access<NoMoves>().val); }));
+    EXPECT_EQ(0, NoMoves::moves);
+}
+
+TEST(any_spsc_queue, consume_releases_slot)
+{
+    auto sp = std::make_shared<int>(17);
+    any_spsc_queue<> q(2);
+    q.try_push(sp);
+    EXPECT_EQ(2, sp.use_count());
+    q.try_consume([](any_movable &) {});
+    EXPECT_EQ(1, sp.use_count());
+}
+
+TEST(any_spsc_queue, throwing_constructor_publishes_nothing)
+{
+    any_spsc_queue<> q(2);
+    EXPECT_THROW(q.try_emplace<ThrowsOnConstruct>(), int);
+    EXPECT_TRUE(q.empty());
+}
+
+TEST(any_spsc_queue, threads)
+{
+    const int count = 20000;
+    any_spsc_queue<basic_any_movable<sizeof(long long)>> q(64);
+    std::thread producer([&q] {
+        for (long long i = 0; i < count; )
+            if (q.try_push(i))
+                i++;
+    });
+    long long expected = 0;
+    bool inOrder = true;
+    while (expected < count)
+    {
+        q.try_consume([&](auto & a) {
+            inOrder = inOrder && a.template access<long long>() == expected;
+            expected++;
+        });
+    }
+    producer.join();
+    EXPECT_TRUE(inOrder);
+}
+
+TEST(any_mpmc_queue, fifo_and_full)
+{
+    NoMoves::moves = 0;
+    any_mpmc_queue<> q(2);
+    EXPECT_EQ(2u, q.capacity());
+    EXPECT_TRUE(q.try_push(1));
+    EXPECT_TRUE(q.try_emplace<NoMoves>(2));
+    EXPECT_FALSE(q.try_push(3));
+    EXPECT_TRUE(q.try_consume([](any_movable & a) { EXPECT_EQ(1, a.access<int>()); }));
+    EXPECT_TRUE(q.try_consume([](any_movable & a) { EXPECT_EQ(2, a.access<NoMoves>().val); }));
+    EXPECT_FALSE(q.try_consume([](any_movable &) { FAIL(); }));
+    EXPECT_EQ(0, NoMoves::moves);
+}
+
+TEST(any_mpmc_queue, throwing_constructor_is_skipped)
+{
+    any_mpmc_queue<> q(4);
+    EXPECT_THROW(q.try_emplace<ThrowsOnConstruct>(), int);
+    q.try_push(17);
+    int calls = 0;
+    EXPECT_TRUE(q.try_consume([&calls](any_movable & a) { calls++; EXPECT_EQ(17, a.access<int>()); }));
+    EXPECT_EQ(1, calls);
+    EXPECT_FALSE(q.try_consume([](any_movable &) { FAIL(); }));
+}
+
+TEST(any_mpmc_queue, threads)
+{
+    const int producers = 4;
+    const int consumers = 4;
+    const int perProducer = 10000;
+    any_mpmc_queue<> q(128);
+    std::atomic<long long> sum{ 0 };
+    std::atomic<int> consumed{ 0 };
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++)
+        threads.emplace_back([&q] {
+            for (int i = 1; i <= perProducer; )
+                if (q.try_push(i))
+                    i++;
+        });
+    for (int c = 0; c < consumers; c++)
+        threads.emplace_back([&] {
+            while (consumed.load() < producers * perProducer)
+                q.try_consume([&](any_movable & a) {
+                    sum += a.access<int>();
+                    consumed++;
+                });
+        });
+    for (auto & t : threads)
+        t.join();
+
+    EXPECT_EQ(producers * perProducer, consumed.load());
+    EXPECT_EQ((long long)producers * perProducer * (perProducer + 1) / 2, sum.load());
+}
@@ -1,8 +1,15 @@
 #include "any_movable.h"
+#include "alloc_trace.h"
 
 #include <gtest/gtest.h>
 
 #include <type_traits>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
 
 namespace
 {
@@ -26,71 +33,54 @@ namespace
         char b[1000];
     };
 
-}
-
-
-//
-// Can't believe I'm doing this.
-// This replaces global new/delete for EVERY cpp file in this exe.
-// What exe is this?  Hopefully just CommonTest.
-// Maybe any_movable should have its own test exe?
-//
-static int largeNew = 0;
-static int largeDelete = 0;
-static std::atomic<void *> largeNewObjects[128];
-static const int LargeSize = 4096;
-static bool newTracking_tooManyLargeObjects = false;
-
-void * operator new(std::size_t sz) // no inline, required by [replacement.functions]/3
-{
-    // use good old malloc
-    if (sz == 0) ++sz; // avoid std::malloc(0) which may return nullptr on success
-    void * ptr = std::malloc(sz);
-
-    if (ptr == nullptr)
-        throw std::bad_alloc{}; // required by [new.delete.single]/3
-
+    // a declared hierarchy (see any_movable_bases specializations below)
+    struct DeclaredBase { int b = 1; virtual ~DeclaredBase() = default; };
+    struct DeclaredOther { int o = 2; };
+    struct DeclaredMiddle : DeclaredBase { int m = 3; };
+    struct DeclaredDerived : DeclaredOther, DeclaredMiddle { int d = 4; };
+    struct NotListed { int n = 5; };
+    struct PartlyDeclared : DeclaredBase, NotListed { };
+    struct AbstractShape { virtual ~AbstractShape() = default; virtual int sides() const = 0; };
+    struct Square : AbstractShape { int sides() const override { return 4; } };
+
+    // counts moves, but says it can be relocated with memcpy
+    struct Relocatable
+    {
+        static int moves;
+        int val = 17;
+        Relocatable() = default;
+        Relocatable(Relocatable && other) : val(other.val) { moves++; }
+    };
+    int Relocatable::moves = 0;
 
-    if (sz >= LargeSize && !newTracking_tooManyLargeObjects)
+    // small, but its moves might throw
+    struct ThrowingMove
     {
-        // we are tracking large objects because operator delete doesn't give us a size
-        // so instead we need to remember that it was a big object...
+        int x = 17;
+        ThrowingMove() = default;
+        ThrowingMove(ThrowingMove && other) noexcept(false) : x(other.x) {}
+        ThrowingMove & operator=(ThrowingMove && other) noexcept(false) { x = other.x; return *this; }
+    };
 
-        // find a place for it
-        bool found = false;
-        for (auto & atom_ptr : largeNewObjects)
-        {
-            void * tmp = nullptr;
-            if (atom_ptr.compare_exchange_strong(tmp, ptr))  // was null, now "ours"
-            {
-                found = true;
-                break;
-            }
-        }
-        if (found)
-            largeNew++;
-        else
-            newTracking_tooManyLargeObjects = true;
+    // is p inside a (ie held inline)?
+    template <typename Any>
+    bool is_inside(Any const & a, void const * p)
+    {
+        return p >= (void const *)&a && p < (void const *)(&a + 1);
     }
-
-    return ptr;
 }
 
-void operator delete(void * ptr) noexcept
-{
-    // was this being tracked?
-    for (auto & atom_ptr : largeNewObjects)
-    {
-        if (atom_ptr == ptr) // at least memory_order_acquire
-        {
-            // found a large object!
-            largeDelete++;
-            atom_ptr = nullptr; // at least _release
-        }
-    }
+template <> struct any_movable_trivially_relocatable<Relocatable> : std::true_type {};
+
+// these must be at global scope (where any_movable_bases lives)
+template <> struct any_movable_bases<DeclaredMiddle> { using type = any_bases<DeclaredBase>; };
+template <> struct any_movable_bases<DeclaredDerived> { using type = any_bases<DeclaredOther, DeclaredMiddle>; };
+template <> struct any_movable_bases<PartlyDeclared> { using type = any_bases<DeclaredBase>; };
+template <> struct any_movable_bases<Square> { using type = any_bases<AbstractShape>; };
 
-    std::free(ptr);
-}
+
+// link with alloc_trace.cpp (which replaces global new/delete, so we can see what any_movable allocates)
+static const int LargeSize = 4096;
 
 
 
@@ -337,8 +327,8 @@ namespace UnitTestCommon
     };
 
     using Counter1 = Counter<1, 4>;
-    int Counter1::ctors = 0;
-    int Counter1::dtors = 0;
+    template <> int Counter1::ctors = 0;
+    template <> int Counter1::dtors = 0;
 
     TEST(any_movable, reset_cleans_small_objects)
     {
@@ -349,81 +339,55 @@ namespace UnitTestCommon
     }
 
     using Counter2 = Counter<2, LargeSize>;
-    int Counter2::ctors = 0;
-    int Counter2::dtors = 0;
+    template <> int Counter2::ctors = 0;
+    template <> int Counter2::dtors = 0;
     TEST(any_movable, reset_cleans_big_objects)
     {
-        // technically, there could be a race condition here
-        // if something large is being allocated in another thread somewhere...
-        int prevLargeNew = largeNew;
-        int prevLargeDelete = largeDelete;
+        alloc_trace::scope heap; // (only counts this thread)
 
         any_movable a = Counter2();
         a.reset();
         EXPECT_EQ(2, Counter2::ctors);   // there was a temporary Counter, and one in the any
         EXPECT_EQ(2, Counter2::dtors);   // there was a temporary Counter, and one in the any
 
-        int diffNew = largeNew - prevLargeNew;
-        int diffDelete = largeDelete - prevLargeDelete;
-
         // Only one Counter2 was allocated (inside the any)
         // The other one (above) was a temporary, not on the heap
-        EXPECT_EQ(1, diffNew);
-        EXPECT_EQ(1, diffDelete);
+        EXPECT_EQ(1u, heap.so_far().allocations);
+        EXPECT_EQ(1u, heap.so_far().deallocations);
+        EXPECT_EQ(sizeof(Counter2), heap.so_far().bytes_allocated);
     }
 
     using Counter3 = Counter<3, LargeSize>;
-    int Counter3::ctors = 0;
-    int Counter3::dtors = 0;
+    template <> int Counter3::ctors = 0;
+    template <> int Counter3::dtors = 0;
     TEST(any_movable, move_cleans_big_objects)
     {
-        // technically, there could be a race condition here
-        // if something large is being allocated in another thread somewhere...
-        int prevLargeNew = largeNew;
-        int prevLargeDelete = largeDelete;
-        int diffNew;
-        int diffDelete;
-
+        alloc_trace::scope heap;
         {
             any_movable a = Counter3();
 
-            diffNew = largeNew - prevLargeNew;
-            diffDelete = largeDelete - prevLargeDelete;
-            // Only one Counter2 was allocated (inside the any)
+            // Only one Counter3 was allocated (inside the any)
             // The other one (above) was a temporary, not on the heap
-            EXPECT_EQ(1, diffNew);
-            EXPECT_EQ(0, diffDelete);  // not yet deleted
-            // update:
-            prevLargeNew = largeNew;
-            prevLargeDelete = largeDelete;
+            EXPECT_EQ(1u, heap.so_far().allocations);
+            EXPECT_EQ(0u, heap.so_far().deallocations);  // not yet deleted
+            heap.restart();
 
             {
                 any_movable b = std::move(a);
 
-                diffNew = largeNew - prevLargeNew;
-                diffDelete = largeDelete - prevLargeDelete;
-
                 // nothing allocated or deleted; only moved!
-                EXPECT_EQ(0, diffNew);
-                EXPECT_EQ(0, diffDelete);
-                // update:
-                prevLargeNew = largeNew;
-                prevLargeDelete = largeDelete;
+                EXPECT_EQ(0u, heap.so_far().allocations);
+                EXPECT_EQ(0u, heap.so_far().deallocations);
+                heap.restart();
             } // now b calls delete here
 
-            diffNew = largeNew - prevLargeNew;
-            diffDelete = largeDelete - prevLargeDelete;
-            EXPECT_EQ(0, diffNew);
-            EXPECT_EQ(1, diffDelete);
-            // update:
-            prevLargeNew = largeNew;
-            prevLargeDelete = largeDelete;
+            EXPECT_EQ(0u, heap.so_far().allocations);
+            EXPECT_EQ(1u, heap.so_far().deallocations);
+            heap.restart();
         }
         // now a calls ... nothing, because it was moved-from and is empty
-        diffNew = largeNew - prevLargeNew;
-        diffDelete = largeDelete - prevLargeDelete;
-        EXPECT_EQ(0, diffNew);
-        EXPECT_EQ(0, diffDelete);
+        EXPECT_EQ(0u, heap.so_far().allocations);
+        EXPECT_EQ(0u, heap.so_far().deallocations);
     }
 
     TEST(any_movable, any_cast_const_ptr_returns_const_ptr)
@@ -513,7 +477,7 @@ namespace UnitTestCommon
 
         any_movable a = Derived(x);
 
-        Base & b = any_dynamic_cast<Base>(std::move(a));
+        Base && b = any_dynamic_cast<Base>(std::move(a));
         b.set();
         EXPECT_EQ(23, x);
     }
@@ -609,8 +573,491 @@ namespace UnitTestCommon
         EXPECT_FALSE(a.has_dynamic_type<double>());
     }
 
+    TEST(any_movable, declared_bases_finds_direct_base)
+    {
+        any_movable a = DeclaredDerived();
+        EXPECT_TRUE(a.has_dynamic_type<DeclaredMiddle>());
+        EXPECT_TRUE(a.has_dynamic_type<DeclaredOther>());
+        EXPECT_EQ(3, a.access_dynamic<DeclaredMiddle>().m);
+        EXPECT_EQ(2, a.access_dynamic<DeclaredOther>().o);
+    }
+    TEST(any_movable, declared_bases_finds_base_of_base)
+    {
+        any_movable a = DeclaredDerived();
+        EXPECT_TRUE(a.has_dynamic_type<DeclaredBase>());
+        EXPECT_EQ(1, any_dynamic_cast<DeclaredBase>(a).b);
+    }
+    TEST(any_movable, declared_bases_adjusts_pointer)
+    {
+        // DeclaredMiddle is not the first base, so its address differs from the held object's
+        any_movable a = DeclaredDerived();
+        DeclaredDerived & d = a.access<DeclaredDerived>();
+        EXPECT_EQ(static_cast<DeclaredMiddle *>(&d), a.access_ptr_dynamic<DeclaredMiddle>());
+        EXPECT_EQ(static_cast<DeclaredBase *>(&d), a.access_ptr_dynamic<DeclaredBase>());
+
+        // again, with a different object (ie from the cache)
+        any_movable b = DeclaredDerived();
+        DeclaredDerived & e = b.access<DeclaredDerived>();
+        EXPECT_EQ(static_cast<DeclaredMiddle *>(&e), b.access_ptr_dynamic<DeclaredMiddle>());
+    }
+    TEST(any_movable, declared_bases_does_not_find_non_base)
+    {
+        any_movable a = DeclaredMiddle();
+        EXPECT_FALSE(a.has_dynamic_type<DeclaredOther>());
+        EXPECT_FALSE(a.has_dynamic_type<DeclaredDerived>());
+        EXPECT_THROW((void)any_dynamic_cast<DeclaredOther>(a), std::bad_any_cast);
+    }
+    TEST(any_movable, declared_bases_are_trusted)
+    {
+        // PartlyDeclared derives from NotListed, but didn't say so,
+        // so it is not found (ie we didn't fall back to throwing)
+        any_movable a = PartlyDeclared();
+        EXPECT_TRUE(a.has_dynamic_type<DeclaredBase>());
+        EXPECT_FALSE(a.has_dynamic_type<NotListed>());
+    }
+    TEST(any_movable, abstract_bases)
+    {
+        any_movable a = Square();
+        EXPECT_FALSE(a.has_type<AbstractShape>());
+        EXPECT_TRUE(a.has_dynamic_type<AbstractShape>());
+        EXPECT_EQ(4, a.access_dynamic<AbstractShape>().sides());
+        EXPECT_EQ(4, a.visit<AbstractShape>([](AbstractShape & s) { return s.sides(); }));
+
+        any_movable empty;
+        EXPECT_FALSE(empty.has_type<AbstractShape>());
+        EXPECT_EQ(1u, empty.index_of<AbstractShape>());
+    }
+    TEST(any_movable, queries_about_types_that_cant_be_held)
+    {
+        // these can't be held, but asking about them should still compile (and say no, or find them as bases)
+        struct ProtectedDtor { int x = 3; protected: ~ProtectedDtor() = default; };
+        struct Concrete : ProtectedDtor { };
+        struct NonMovable { NonMovable(NonMovable &&) = delete; };
+
+        any_movable a = Concrete();
+        EXPECT_EQ(3, a.access_dynamic<ProtectedDtor>().x);
+        EXPECT_FALSE(a.has_type<ProtectedDtor>());
+        EXPECT_FALSE(a.has_dynamic_type<NonMovable>());
+        EXPECT_FALSE(a.has_type<void>());
+        EXPECT_FALSE(a.has_type<std::mutex>());
+        EXPECT_EQ(2u, (a.index_of<std::mutex, NonMovable>()));
+
+        any_movable empty;
+        EXPECT_FALSE(empty.has_type<void>());
+        EXPECT_FALSE(empty.has_dynamic_type<NonMovable>());
+    }
+    TEST(any_movable, undeclared_bases_are_cached)
+    {
+        struct Base { int b = 17; };
+        struct Other { int o = 19; };
+        struct Derived : Other, Base { };
 
+        for (int i = 0; i < 3; i++)
+        {
+            any_movable a = Derived();
+            Derived & d = a.access<Derived>();
+            EXPECT_EQ(static_cast<Base *>(&d), a.access_ptr_dynamic<Base>());
+            EXPECT_EQ(17, any_dynamic_cast<Base>(a).b);
+            EXPECT_FALSE(a.has_dynamic_type<NotListed>());
+        }
+    }
 
+    TEST(any_movable, trivially_relocatable_moves_without_move_ctor)
+    {
+        any_movable a = Relocatable(); // one move, into the any
+        EXPECT_EQ(1, Relocatable::moves);
 
-}
+        any_movable b = std::move(a);
+        any_movable c;
+        c = std::move(b);
+        EXPECT_EQ(1, Relocatable::moves); // just memcpy'd
+        EXPECT_FALSE(a.has_value());
+        EXPECT_FALSE(b.has_value());
+        EXPECT_EQ(17, c.access<Relocatable>().val);
+    }
+
+    TEST(any_movable, vector_growth_keeps_values)
+    {
+        std::vector<any_movable> v;
+        for (int i = 0; i < 100; i++)
+        {
+            if (i % 2)
+                v.push_back(i);
+            else
+                v.push_back(std::make_unique<int>(i));
+        }
+        for (int i = 0; i < 100; i++)
+        {
+            if (i % 2)
+                EXPECT_EQ(i, v[i].access<int>());
+            else
+                EXPECT_EQ(i, *v[i].access<std::unique_ptr<int>>());
+        }
+    }
+
+    TEST(any_movable, assign_same_type_assigns)
+    {
+        any_movable a = std::make_unique<int>(17);
+        int * p = &*a.access<std::unique_ptr<int>>();
+        auto q = std::make_unique<int>(23);
+        a = std::move(q);
+        EXPECT_EQ(23, *a.access<std::unique_ptr<int>>());
+        EXPECT_EQ(nullptr, q);
+        EXPECT_NE(p, &*a.access<std::unique_ptr<int>>());
+    }
+
+    TEST(any_movable, basic_any_movable_sizes)
+    {
+        // storage + vtable pointer + item pointer
+        static_assert(sizeof(basic_any_movable<sizeof(void *), alignof(void *)>) == 3 * sizeof(void *));
+        static_assert(sizeof(basic_any_movable<128, 64>) == 192);
+        static_assert(alignof(basic_any_movable<128, 64>) == 64);
+    }
+
+    TEST(any_movable, small_items_never_touch_the_heap)
+    {
+        auto heap = alloc_trace::count([] {
+            any_movable a = 17;
+            any_movable b = std::move(a);
+            a = std::string(); // (empty strings don't allocate)
+            b = 18; // same type
+            b.emplace<double>(1.5);
+            EXPECT_EQ(1.5, b.access<double>());
+            std::swap(a, b);
+            a.reset();
+        });
+        EXPECT_EQ(0u, heap.allocations);
+    }
+
+    using Counter4 = Counter<4, LargeSize>;
+    template <> int Counter4::ctors = 0;
+    template <> int Counter4::dtors = 0;
+    TEST(any_movable, basic_any_movable_big_storage_does_not_allocate)
+    {
+        alloc_trace::scope heap;
+        {
+            basic_any_movable<LargeSize> a = Counter4();
+            basic_any_movable<LargeSize> b = std::move(a);
+            EXPECT_TRUE(b.has_type<Counter4>());
+        }
+        EXPECT_EQ(0u, heap.so_far().allocations);
+        EXPECT_EQ(Counter4::ctors, Counter4::dtors);
+    }
+
+    TEST(any_movable, basic_any_movable_over_aligned_inline)
+    {
+        struct alignas(64) CacheLine { int x = 17; };
+
+        basic_any_movable<128, 64> a = CacheLine();
+        EXPECT_EQ(0u, (std::uintptr_t)a.access_ptr<CacheLine>() % 64);
+        EXPECT_TRUE((void *)a.access_ptr<CacheLine>() >= (void *)&a && (void *)a.access_ptr<CacheLine>() < (void *)(&a + 1)); // inline
+
+        basic_any_movable<128, 64> b = std::move(a);
+        EXPECT_EQ(0u, (std::uintptr_t)b.access_ptr<CacheLine>() % 64);
+        EXPECT_EQ(17, b.access<CacheLine>().x);
+    }
+
+    TEST(any_movable, basic_any_movable_over_aligned_goes_to_heap)
+    {
+        struct alignas(64) CacheLine { int x = 17; };
+
+        any_movable a = CacheLine();
+        EXPECT_EQ(0u, (std::uintptr_t)a.access_ptr<CacheLine>() % 64);
+        EXPECT_FALSE((void *)a.access_ptr<CacheLine>() >= (void *)&a && (void *)a.access_ptr<CacheLine>() < (void *)(&a + 1)); // not inline
+    }
+
+    using Counter5 = Counter<5, LargeSize>;
+    template <> int Counter5::ctors = 0;
+    template <> int Counter5::dtors = 0;
+    TEST(any_movable, basic_any_movable_converts_between_sizes)
+    {
+        alloc_trace::scope heap;
+        {
+            basic_any_movable<LargeSize> big = Counter5();
+            any_movable small = std::move(big); // doesn't fit, so allocates
+            EXPECT_FALSE(big.has_value());
+            EXPECT_TRUE(small.has_type<Counter5>());
+            EXPECT_EQ(1u, heap.so_far().allocations);
+
+            basic_any_movable<LargeSize> big2 = std::move(small); // was already on the heap, so just takes it
+            EXPECT_TRUE(big2.has_type<Counter5>());
+            EXPECT_EQ(1u, heap.so_far().allocations);
+
+            any_movable i = 17;
+            basic_any_movable<sizeof(int), alignof(int)> tiny;
+            tiny = std::move(i);
+            EXPECT_EQ(17, tiny.access<int>());
+            EXPECT_FALSE(i.has_value());
+        }
+        EXPECT_EQ(Counter5::ctors, Counter5::dtors);
+    }
+
+    TEST(any_movable, basic_any_movable_converts_non_trivial_between_sizes)
+    {
+        basic_any_movable<256> a = std::string(100, 'x');
+        any_movable b = std::move(a);
+        basic_any_movable<sizeof(std::string), alignof(std::string)> c = std::move(b);
+        EXPECT_EQ(std::string(100, 'x'), c.access<std::string>());
+    }
+
+    // counts what it hands out, and gets it from new_delete_resource
+    struct CountingResource : std::pmr::memory_resource
+    {
+        int allocs = 0;
+        int deallocs = 0;
+
+        void * do_allocate(std::size_t bytes, std::size_t align) override
+        {
+            allocs++;
+            return std::pmr::new_delete_resource()->allocate(bytes, align);
+        }
+        void do_deallocate(void * p, std::size_t bytes, std::size_t align) override
+        {
+            deallocs++;
+            std::pmr::new_delete_resource()->deallocate(p, bytes, align);
+        }
+        bool do_is_equal(std::pmr::memory_resource const & other) const noexcept override
+        {
+            return this == &other;
+        }
+    };
 
+    using Counter6 = Counter<6, LargeSize>;
+    template <> int Counter6::ctors = 0;
+    template <> int Counter6::dtors = 0;
+    TEST(any_movable, pmr_big_items_come_from_resource)
+    {
+        CountingResource res;
+        alloc_trace::scope heap;
+        {
+            pmr_any_movable a(std::allocator_arg, &res, Counter6());
+            EXPECT_EQ(1, res.allocs);
+            EXPECT_EQ(&res, a.get_allocator().resource());
+
+            pmr_any_movable small(std::allocator_arg, &res, 17);
+            EXPECT_EQ(1, res.allocs); // small things stay inline
+        }
+        EXPECT_EQ(1, res.deallocs);
+        EXPECT_EQ(std::size_t(res.allocs), heap.so_far().allocations); // global new was only called by the resource
+    }
+
+    using Counter7 = Counter<7, LargeSize>;
+    template <> int Counter7::ctors = 0;
+    template <> int Counter7::dtors = 0;
+    TEST(any_movable, pmr_move_with_same_resource_does_not_reallocate)
+    {
+        CountingResource res;
+        {
+            pmr_any_movable a(std::allocator_arg, &res, Counter7());
+            Counter7 * p = a.access_ptr<Counter7>();
+
+            pmr_any_movable b = std::move(a); // move ctor takes allocator too
+            EXPECT_EQ(&res, b.get_allocator().resource());
+            EXPECT_EQ(p, b.access_ptr<Counter7>());
+
+            pmr_any_movable c(std::allocator_arg, &res);
+            c = std::move(b);
+            EXPECT_EQ(p, c.access_ptr<Counter7>());
+            EXPECT_EQ(1, res.allocs);
+        }
+        EXPECT_EQ(1, res.deallocs);
+        EXPECT_EQ(Counter7::ctors, Counter7::dtors);
+    }
+
+    using Counter8 = Counter<8, LargeSize>;
+    template <> int Counter8::ctors = 0;
+    template <> int Counter8::dtors = 0;
+    TEST(any_movable, pmr_move_assign_with_different_resource_reallocates)
+    {
+        CountingResource res1;
+        CountingResource res2;
+        {
+            pmr_any_movable a(std::allocator_arg, &res1, Counter8());
+            pmr_any_movable b(std::allocator_arg, &res2);
+
+            b = std::move(a); // pmr allocators don't propagate on move-assign
+            EXPECT_EQ(&res2, b.get_allocator().resource());
+            EXPECT_TRUE(b.has_type<Counter8>());
+            EXPECT_FALSE(a.has_value());
+            EXPECT_EQ(1, res1.allocs);
+            EXPECT_EQ(1, res1.deallocs);
+            EXPECT_EQ(1, res2.allocs);
+        }
+        EXPECT_EQ(1, res2.deallocs);
+        EXPECT_EQ(Counter8::ctors, Counter8::dtors);
+    }
+
+    TEST(any_movable, default_allocator_takes_no_space)
+    {
+        static_assert(sizeof(any_movable) == sizeof(basic_any_movable<6 * sizeof(void *), alignof(long double), std::allocator<int>>));
+        static_assert(sizeof(pmr_any_movable) > sizeof(any_movable));
+    }
+
+    TEST(any_movable, visit_calls_matching_handler)
+    {
+        struct Visitor
+        {
+            int operator()(int i) { return i; }
+            int operator()(std::string const & s) { return (int)s.size(); }
+            int operator()(moveonly & m) { return m.val; }
+        };
+
+        any_movable a = 5;
+        EXPECT_EQ(5, (visit<int, std::string, moveonly>(a, Visitor())));
+        a = std::string("hello there");
+        EXPECT_EQ(11, (visit<int, std::string, moveonly>(a, Visitor())));
+        a = moveonly();
+        EXPECT_EQ(17, (visit<int, std::string, moveonly>(a, Visitor())));
+    }
+
+    TEST(any_movable, visit_index_of)
+    {
+        any_movable a = std::string();
+        EXPECT_EQ(1u, (a.index_of<int, std::string, double>()));
+        EXPECT_EQ(2u, (a.index_of<int, double>()));
+        any_movable empty;
+        EXPECT_EQ(2u, (empty.index_of<int, double>()));
+    }
+
+    TEST(any_movable, visit_can_modify)
+    {
+        any_movable a = 5;
+        a.visit<int, double>([](auto & x) { x *= 2; });
+        EXPECT_EQ(10, a.access<int>());
+    }
+
+    TEST(any_movable, visit_const)
+    {
+        const any_movable a = 5;
+        bool wasConst = a.visit<int>([](auto & x) { return std::is_const_v<std::remove_reference_t<decltype(x)>>; });
+        EXPECT_TRUE(wasConst);
+    }
+
+    TEST(any_movable, visit_falls_back)
+    {
+        auto onInt = [](int) { return std::string("int"); };
+        auto other = [](any_movable & a) { return std::string(a.has_value() ? "other" : "empty"); };
+        any_movable a = 3.5;
+        EXPECT_EQ("other", (visit<int>(a, onInt, other)));
+        any_movable empty;
+        EXPECT_EQ("empty", (visit<int>(empty, onInt, other)));
+        any_movable i = 3;
+        EXPECT_EQ("int", (visit<int>(i, onInt, other)));
+    }
+
+    TEST(any_movable, visit_without_fallback_throws)
+    {
+        any_movable a = 3.5;
+        EXPECT_THROW(visit<int>(a, [](int) {}), std::bad_any_cast);
+    }
+
+    TEST(any_movable, visit_dispatches_to_declared_base)
+    {
+        struct Visitor
+        {
+            int operator()(int) { return 0; }
+            int operator()(DeclaredBase & b) { return b.b; }
+            int operator()(DeclaredOther & o) { return o.o; }
+        };
+        any_movable a = DeclaredDerived();
+        // DeclaredOther is listed first in DeclaredDerived's any_movable_bases, but Ts order decides
+        EXPECT_EQ(1, (visit<int, DeclaredBase, DeclaredOther>(a, Visitor())));
+        EXPECT_EQ(2, (visit<int, DeclaredOther, DeclaredBase>(a, Visitor())));
+
+        // correctly adjusted
+        DeclaredDerived & d = a.access<DeclaredDerived>();
+        a.visit<DeclaredBase>([&d](DeclaredBase & b) { EXPECT_EQ(static_cast<DeclaredBase *>(&d), &b); });
+    }
+
+    TEST(any_movable, nothrow_moves_are_opt_in)
+    {
+        static_assert(!std::is_nothrow_move_constructible_v<any_movable>); // (it might hold a ThrowingMove inline)
+        static_assert(!std::is_nothrow_move_assignable_v<any_movable>);
+        static_assert(std::is_nothrow_move_constructible_v<nothrow_any_movable>);
+        static_assert(std::is_nothrow_move_assignable_v<nothrow_any_movable>);
+
+        using pmr_nothrow_any_movable = basic_any_movable<48, 16, std::pmr::polymorphic_allocator<std::byte>, true>;
+        static_assert(std::is_nothrow_move_constructible_v<pmr_nothrow_any_movable>);
+        static_assert(!std::is_nothrow_move_assignable_v<pmr_nothrow_any_movable>); // might need to allocate
+    }
+
+    TEST(any_movable, throwing_move_is_still_inline)
+    {
+        any_movable a = ThrowingMove();
+        EXPECT_TRUE(is_inside(a, a.data()));
+
+        any_movable b = std::move(a);
+        EXPECT_TRUE(is_inside(b, b.data()));
+        EXPECT_EQ(17, b.access<ThrowingMove>().x);
+
+        // same type, so it is move-assigned
+        any_movable c = ThrowingMove();
+        void const * where = c.data();
+        c = std::move(b);
+        EXPECT_EQ(where, c.data());
+    }
+
+    TEST(any_movable, nothrow_any_movable_puts_throwing_move_on_heap)
+    {
+        nothrow_any_movable a = ThrowingMove();
+        EXPECT_FALSE(is_inside(a, a.data()));
+        nothrow_any_movable small = 17;
+        EXPECT_TRUE(is_inside(small, small.data())); // (nothrow moves are still inline)
+
+        void const * where = a.data();
+        nothrow_any_movable b = std::move(a); // just takes the pointer
+        EXPECT_EQ(where, b.data());
+        EXPECT_EQ(17, b.access<ThrowingMove>().x);
+
+        // same type, but its move assignment might throw, so it takes the pointer instead of move-assigning
+        nothrow_any_movable c = ThrowingMove();
+        c = std::move(b);
+        EXPECT_EQ(where, c.data());
+        EXPECT_FALSE(b.has_value());
+    }
+
+    TEST(any_movable, data_is_the_held_item)
+    {
+        any_movable a = 17;
+        EXPECT_EQ(a.access_ptr<int>(), a.data());
+        any_movable empty;
+        EXPECT_EQ(nullptr, empty.data());
+    }
+
+    TEST(any_movable, inline_any_movable_moves_are_noexcept)
+    {
+        using Small = inline_any_movable<16>;
+        using Big = inline_any_movable<64, 16>;
+        static_assert(std::is_nothrow_move_constructible_v<Small>);
+        static_assert(std::is_nothrow_move_assignable_v<Small>);
+        static_assert(std::is_nothrow_constructible_v<Big, Small &&>);
+        static_assert(std::is_nothrow_assignable_v<Big &, Small &&>);
+    }
+
+    TEST(any_movable, inline_any_movable_never_allocates)
+    {
+        std::vector<inline_any_movable<32>> v;
+        v.reserve(10); // (that allocates, of course)
+        auto heap = alloc_trace::count([&v] {
+            inline_any_movable<32> a = std::string("short");
+            inline_any_movable<32> b = std::move(a);
+            a = 17;
+            a = std::move(b);
+            EXPECT_EQ("short", a.access<std::string>());
+
+            inline_any_movable<64> big = std::move(a); // smaller into bigger is fine
+            EXPECT_EQ("short", big.access<std::string>());
+
+            for (int i = 0; i < 10; i++)
+                v.emplace_back(i);
+            v.erase(v.begin());
+            EXPECT_EQ(1, v.front().access<int>());
+        });
+        EXPECT_EQ(0u, heap.allocations);
+
+        // and these don't compile:
+        //    inline_any_movable<8> tooBig = std::string(); // "too big to fit"
+        //    inline_any_movable<64> throws = ThrowingMove(); // "moving it might throw"
+        //    inline_any_movable<32> c = inline_any_movable<64>(); // "can't move from a bigger one"
+    }
+}
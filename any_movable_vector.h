@@ -0,0 +1,338 @@
+#ifndef any_movable_vector_h_INCLUDED
+#define any_movable_vector_h_INCLUDED
+
+#include "any_movable.h"
+#include "dense_type_id.h"
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <typeinfo>
+#include <type_traits>
+#include <new> // placement new
+#include <utility>
+
+//
+// A container of "anything" (like std::vector<any_movable>) but
+// items of the same type are stored together, contiguously, in a std::vector<T> per type (a "segment").
+// So visiting all the Foos is a linear walk through memory, with no indirect calls:
+//
+//    any_movable_vector v;
+//    v.push_back(Foo());
+//    v.push_back(Bar());
+//    v.for_each<Foo>([](Foo & foo) { ... });
+//    v.for_each<Foo, Bar>([](auto & fooOrBar) { ... });
+//
+// The price is that there is no overall order (ie no v[i]) - items are only ordered within their segment
+// (and erase() moves the last item of the segment into the erased spot, so not even that).
+// Instead, each inserted item gets a handle, which stays valid (ie keeps finding the same item) until that item is erased.
+//
+// Items must be move-constructible, and either move-assignable or nothrow move-constructible (that's how erase() moves them).
+//
+// Finding a type's segment is an array index, by a (process-wide, dense) type id - not a search through the types.
+//
+class any_movable_vector
+{
+public:
+    struct handle
+    {
+        std::uint32_t slot = invalid;
+        std::uint32_t generation = 0; // so a handle to an erased item doesn't find a new item in the same slot
+
+        static constexpr std::uint32_t invalid = ~std::uint32_t(0);
+
+        friend bool operator==(handle a, handle b) { return a.slot == b.slot && a.generation == b.generation; }
+        friend bool operator!=(handle a, handle b) { return !(a == b); }
+    };
+
+    template <typename T>
+    struct segment_view
+    {
+        T * first = nullptr;
+        std::size_t count = 0;
+
+        T * begin() const { return first; }
+        T * end() const { return first + count; }
+        T * data() const { return first; }
+        std::size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        T & operator[](std::size_t i) const { return first[i]; }
+    };
+
+private:
+    struct Segment
+    {
+        std::type_info const * type; // (just for type() and for_each_type())
+        any_movable items; // holds a std::vector<T>
+        std::vector<std::uint32_t> owners; // owners[i] is the slot (ie handle) of items[i]
+        // erase items[i] by moving the last item into its place
+        void (*swap_and_pop)(any_movable & items, std::size_t i);
+    };
+    struct Slot
+    {
+        std::uint32_t segment;
+        std::uint32_t index; // in the segment, or next free slot when free
+        std::uint32_t generation;
+        bool used;
+    };
+
+    std::vector<Segment> segments;
+    std::vector<std::uint32_t> segmentOf; // segmentOf[type_id<T>()] is the index of T's segment (or noSegment)
+    std::vector<Slot> slots;
+    std::uint32_t freeSlots = handle::invalid; // head of free list (through Slot::index)
+    std::size_t count = 0;
+
+    template <typename T>
+    static void swap_and_pop(any_movable & items, std::size_t i)
+    {
+        std::vector<T> & vec = items.access<std::vector<T>>();
+        if (i + 1 != vec.size())
+        {
+            if constexpr (std::is_move_assignable_v<T>)
+                vec[i] = std::move(vec.back());
+            else
+            {
+                // (no going back once vec[i] is destroyed - so the move can't be allowed to throw)
+                static_assert(std::is_nothrow_move_constructible_v<T>,
+                    "any_movable_vector items must be move-assignable, or nothrow move-constructible (for erase)");
+                vec[i].~T();
+                new (&vec[i]) T(std::move(vec.back()));
+            }
+        }
+        vec.pop_back();
+    }
+
+    static constexpr std::uint32_t noSegment = ~std::uint32_t(0);
+
+    template <typename T>
+    static std::size_t type_id()
+    {
+        return dense_type_id<any_movable_vector, std::remove_cv_t<T>>();
+    }
+
+    template <typename T>
+    Segment const * find_segment() const
+    {
+        std::size_t id = type_id<T>();
+        if (id < segmentOf.size() && segmentOf[id] != noSegment)
+            return &segments[segmentOf[id]];
+        return nullptr;
+    }
+    template <typename T>
+    Segment * find_segment()
+    {
+        return const_cast<Segment *>(static_cast<any_movable_vector const *>(this)->find_segment<T>());
+    }
+    template <typename T>
+    Segment & get_segment()
+    {
+        if (Segment * seg = find_segment<T>())
+            return *seg;
+        std::size_t id = type_id<T>();
+        if (id >= segmentOf.size())
+            segmentOf.resize(id + 1, noSegment);
+        segments.push_back(Segment{ &typeid(T), std::vector<T>(), {}, &swap_and_pop<T> });
+        segmentOf[id] = (std::uint32_t)(segments.size() - 1);
+        return segments.back();
+    }
+
+    handle new_handle(std::uint32_t segment, std::uint32_t index)
+    {
+        std::uint32_t slot;
+        if (freeSlots != handle::invalid)
+        {
+            slot = freeSlots;
+            freeSlots = slots[slot].index;
+        }
+        else
+        {
+            slot = (std::uint32_t)slots.size();
+            slots.push_back(Slot{ 0, 0, 0, false });
+        }
+        Slot & s = slots[slot];
+        s.segment = segment;
+        s.index = index;
+        s.used = true;
+        return handle{ slot, s.generation };
+    }
+
+    // (growing geometrically, like push_back would)
+    template <typename V>
+    static void room_for_one_more(V & v)
+    {
+        if (v.size() == v.capacity())
+            v.reserve(v.capacity() ? v.capacity() * 2 : 8);
+    }
+
+    Slot const * find_slot(handle h) const
+    {
+        if (h.slot >= slots.size())
+            return nullptr;
+        Slot const & s = slots[h.slot];
+        return s.used && s.generation == h.generation ? &s : nullptr;
+    }
+
+public:
+    any_movable_vector() = default;
+
+    any_movable_vector(any_movable_vector &&) = default;
+    any_movable_vector & operator=(any_movable_vector &&) = default;
+    any_movable_vector(any_movable_vector const &) = delete;
+    any_movable_vector & operator=(any_movable_vector const &) = delete;
+
+    template <typename T, typename ...Args>
+    handle emplace(Args &&... args)
+    {
+        Segment & seg = get_segment<T>();
+        std::vector<T> & vec = seg.items.access<std::vector<T>>();
+        // make room first, so that once the T is in, nothing below can throw (and leave vec, owners and slots out of sync)
+        room_for_one_more(seg.owners);
+        if (freeSlots == handle::invalid)
+            room_for_one_more(slots);
+        vec.emplace_back(std::forward<Args>(args)...);
+        handle h = new_handle((std::uint32_t)(&seg - segments.data()), (std::uint32_t)(vec.size() - 1));
+        seg.owners.push_back(h.slot);
+        count++;
+        return h;
+    }
+    template <typename T>
+    handle push_back(T && t)
+    {
+        return emplace<std::decay_t<T>>(std::forward<T>(t));
+    }
+
+    // returns false if h was already erased (or never valid)
+    bool erase(handle h)
+    {
+        Slot const * s = find_slot(h);
+        if (!s)
+            return false;
+        Segment & seg = segments[s->segment];
+        std::uint32_t index = s->index;
+        seg.swap_and_pop(seg.items, index);
+        // whoever was last is now at index
+        std::uint32_t moved = seg.owners.back();
+        seg.owners[index] = moved;
+        seg.owners.pop_back();
+        slots[moved].index = index;
+
+        Slot & freed = slots[h.slot];
+        freed.used = false;
+        freed.generation++;
+        freed.index = freeSlots;
+        freeSlots = h.slot;
+        count--;
+        return true;
+    }
+
+    bool contains(handle h) const
+    {
+        return find_slot(h) != nullptr;
+    }
+
+    std::type_info const & type(handle h) const
+    {
+        Slot const * s = find_slot(h);
+        return s ? *segments[s->segment].type : typeid(void);
+    }
+
+    // null if h was erased, or isn't a T
+    template <typename T>
+    T * get(handle h)
+    {
+        Slot const * s = find_slot(h);
+        if (!s)
+            return nullptr;
+        if (std::vector<T> * vec = segments[s->segment].items.access_ptr<std::vector<T>>())
+            return &(*vec)[s->index];
+        return nullptr;
+    }
+    template <typename T>
+    T const * get(handle h) const
+    {
+        return const_cast<any_movable_vector *>(this)->get<T>(h);
+    }
+
+    // all the Ts, contiguously
+    template <typename T>
+    segment_view<T> segment()
+    {
+        if (Segment * seg = find_segment<T>())
+        {
+            std::vector<T> & vec = seg->items.access<std::vector<T>>();
+            return segment_view<T>{ vec.data(), vec.size() };
+        }
+        return segment_view<T>{};
+    }
+    template <typename T>
+    segment_view<T const> segment() const
+    {
+        segment_view<T> seg = const_cast<any_movable_vector *>(this)->segment<T>();
+        return segment_view<T const>{ seg.first, seg.count };
+    }
+
+    // f(T &) for each T, then each of the next type, etc
+    template <typename ...Ts, typename F>
+    void for_each(F && f)
+    {
+        (for_each_one<Ts>(f), ...);
+    }
+    template <typename ...Ts, typename F>
+    void for_each(F && f) const
+    {
+        (const_cast<any_movable_vector *>(this)->for_each_one<Ts const, std::remove_const_t<Ts>>(f), ...);
+    }
+
+    // f(std::type_info const &, std::size_t count) for each type held
+    template <typename F>
+    void for_each_type(F && f) const
+    {
+        for (Segment const & seg : segments)
+            if (!seg.owners.empty())
+                f(*seg.type, seg.owners.size());
+    }
+
+    template <typename T>
+    std::size_t count_of() const
+    {
+        Segment const * seg = find_segment<T>();
+        return seg ? seg->owners.size() : 0;
+    }
+
+    std::size_t size() const
+    {
+        return count;
+    }
+    bool empty() const
+    {
+        return count == 0;
+    }
+
+    // all handles are now erased (ie contains(h) is false)
+    void clear()
+    {
+        segments.clear();
+        segmentOf.clear();
+        freeSlots = handle::invalid;
+        for (std::uint32_t i = (std::uint32_t)slots.size(); i-- > 0; )
+        {
+            Slot & s = slots[i];
+            if (s.used)
+                s.generation++;
+            s.used = false;
+            s.index = freeSlots;
+            freeSlots = i;
+        }
+        count = 0;
+    }
+
+private:
+    template <typename T, typename U = T, typename F>
+    void for_each_one(F & f)
+    {
+        for (T & t : segment<U>())
+            f(t);
+    }
+};
+
+#endif // _h
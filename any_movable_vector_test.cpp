@@ -0,0 +1,210 @@
+#include "any_movable_vector.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace
+{
+    struct Foo
+    {
+        int x;
+    };
+    struct Bar
+    {
+        std::string s;
+    };
+}
+
+TEST(any_movable_vector, empty)
+{
+    any_movable_vector v;
+    EXPECT_TRUE(v.empty());
+    EXPECT_EQ(0u, v.size());
+    EXPECT_EQ(0u, v.count_of<Foo>());
+    EXPECT_TRUE(v.segment<Foo>().empty());
+}
+
+TEST(any_movable_vector, same_types_are_contiguous)
+{
+    any_movable_vector v;
+    for (int i = 0; i < 10; i++)
+    {
+        v.push_back(Foo{ i });
+        v.push_back(Bar{ std::to_string(i) });
+    }
+    EXPECT_EQ(20u, v.size());
+    EXPECT_EQ(10u, v.count_of<Foo>());
+
+    auto foos = v.segment<Foo>();
+    ASSERT_EQ(10u, foos.size());
+    for (int i = 0; i < 10; i++)
+    {
+        EXPECT_EQ(i, foos[i].x);
+        EXPECT_EQ(&foos[0] + i, &foos[i]);
+    }
+}
+
+TEST(any_movable_vector, for_each)
+{
+    any_movable_vector v;
+    for (int i = 0; i < 10; i++)
+    {
+        v.push_back(Foo{ i });
+        v.push_back(Bar{ std::to_string(i) });
+        v.push_back(i);
+    }
+
+    int sum = 0;
+    v.for_each<Foo>([&sum](Foo & foo) { sum += foo.x; });
+    EXPECT_EQ(45, sum);
+
+    std::string all;
+    int foos = 0;
+    struct Visitor
+    {
+        std::string & all;
+        int & foos;
+        void operator()(Bar const & bar) { all += bar.s; }
+        void operator()(Foo const &) { foos++; }
+    };
+    v.for_each<Bar, Foo>(Visitor{ all, foos });
+    EXPECT_EQ("0123456789", all);
+    EXPECT_EQ(10, foos);
+
+    any_movable_vector const & cv = v;
+    int ints = 0;
+    cv.for_each<int>([&ints](int const & i) { ints += i; });
+    EXPECT_EQ(45, ints);
+}
+
+TEST(any_movable_vector, handles_find_items)
+{
+    any_movable_vector v;
+    auto f = v.push_back(Foo{ 17 });
+    auto b = v.push_back(Bar{ "bar" });
+
+    EXPECT_TRUE(v.contains(f));
+    EXPECT_EQ(typeid(Foo), v.type(f));
+    ASSERT_NE(nullptr, v.get<Foo>(f));
+    EXPECT_EQ(17, v.get<Foo>(f)->x);
+    EXPECT_EQ(nullptr, v.get<Bar>(f)); // wrong type
+    EXPECT_EQ("bar", v.get<Bar>(b)->s);
+}
+
+TEST(any_movable_vector, handles_are_stable_across_erase)
+{
+    any_movable_vector v;
+    std::vector<any_movable_vector::handle> handles;
+    for (int i = 0; i < 10; i++)
+        handles.push_back(v.emplace<Foo>(Foo{ i }));
+
+    EXPECT_TRUE(v.erase(handles[3]));
+    EXPECT_TRUE(v.erase(handles[0]));
+    EXPECT_FALSE(v.erase(handles[3])); // already gone
+
+    EXPECT_EQ(8u, v.size());
+    EXPECT_FALSE(v.contains(handles[3]));
+    EXPECT_EQ(nullptr, v.get<Foo>(handles[0]));
+    for (int i = 0; i < 10; i++)
+    {
+        if (i == 0 || i == 3)
+            continue;
+        ASSERT_NE(nullptr, v.get<Foo>(handles[i]));
+        EXPECT_EQ(i, v.get<Foo>(handles[i])->x);
+    }
+
+    // reused slots don't revive old handles
+    auto h = v.push_back(Foo{ 100 });
+    EXPECT_FALSE(v.contains(handles[0]));
+    EXPECT_FALSE(v.contains(handles[3]));
+    EXPECT_EQ(100, v.get<Foo>(h)->x);
+}
+
+TEST(any_movable_vector, move_only_items)
+{
+    any_movable_vector v;
+    auto h = v.push_back(std::make_unique<int>(17));
+    v.push_back(std::make_unique<int>(23));
+    v.erase(h);
+    ASSERT_EQ(1u, v.count_of<std::unique_ptr<int>>());
+    EXPECT_EQ(23, *v.segment<std::unique_ptr<int>>()[0]);
+}
+
+TEST(any_movable_vector, for_each_type)
+{
+    any_movable_vector v;
+    v.push_back(Foo{ 1 });
+    v.push_back(Foo{ 2 });
+    v.push_back(Bar{});
+
+    int types = 0;
+    std::size_t total = 0;
+    v.for_each_type([&](std::type_info const & ti, std::size_t n) {
+        types++;
+        total += n;
+        if (ti == typeid(Foo)) {
+            EXPECT_EQ(2u, n);
+        }
+    });
+    EXPECT_EQ(2, types);
+    EXPECT_EQ(3u, total);
+}
+
+TEST(any_movable_vector, clear_erases_handles)
+{
+    any_movable_vector v;
+    auto h = v.push_back(Foo{ 1 });
+    v.clear();
+    EXPECT_TRUE(v.empty());
+    EXPECT_FALSE(v.contains(h));
+    auto h2 = v.push_back(Foo{ 2 });
+    EXPECT_FALSE(v.contains(h));
+    EXPECT_EQ(2, v.get<Foo>(h2)->x);
+}
+
+TEST(any_movable_vector, throwing_constructor_changes_nothing)
+{
+    struct Picky
+    {
+        int x;
+        explicit Picky(int x) : x(x) { if (x < 0) throw std::invalid_argument("negative"); }
+    };
+    any_movable_vector v;
+    for (int i = 0; i < 20; i++) // (enough to need to grow a few times)
+    {
+        auto h = v.emplace<Picky>(i);
+        EXPECT_THROW(v.emplace<Picky>(-1), std::invalid_argument);
+        EXPECT_EQ(i, v.get<Picky>(h)->x);
+    }
+    EXPECT_EQ(20u, v.size());
+    EXPECT_EQ(20u, v.count_of<Picky>());
+
+    // and the bookkeeping still works
+    auto h = v.emplace<Picky>(100);
+    EXPECT_TRUE(v.erase(h));
+    EXPECT_EQ(20u, v.size());
+}
+
+TEST(any_movable_vector, erase_without_move_assignment)
+{
+    struct Fixed
+    {
+        int const id; // (so not assignable)
+        std::unique_ptr<int> p;
+    };
+    static_assert(!std::is_move_assignable_v<Fixed>);
+    any_movable_vector v;
+    any_movable_vector::handle h[3];
+    for (int i = 0; i < 3; i++)
+        h[i] = v.push_back(Fixed{ i, std::make_unique<int>(i * 10) });
+    EXPECT_TRUE(v.erase(h[0])); // the last one moves into its place
+    EXPECT_EQ(2u, v.count_of<Fixed>());
+    EXPECT_EQ(2, v.get<Fixed>(h[2])->id);
+    EXPECT_EQ(20, *v.get<Fixed>(h[2])->p);
+    EXPECT_EQ(1, v.get<Fixed>(h[1])->id);
+}
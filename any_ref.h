@@ -0,0 +1,225 @@
+#ifndef any_ref_h_INCLUDED
+#define any_ref_h_INCLUDED
+
+#include "any_movable.h"
+
+#include <memory> // addressof
+#include <type_traits>
+#include <typeinfo>
+#include <any> // bad_any_cast
+
+//
+// A reference to "anything" - like any_movable, but it doesn't own (or move, or copy) what it refers to.
+// It is just a pointer and a type descriptor (two words, trivially copyable), so it is cheap to pass by value:
+//
+//    void handle(any_const_ref msg)
+//    {
+//        if (Ping const * ping = msg.access_ptr<Ping>()) ...
+//    }
+//
+//    handle(Ping{ 17 });     // refers to the temporary, for the duration of the call
+//    handle(someAnyMovable); // refers to the item inside the any_movable (no moving)
+//
+// any_ref can change what it refers to, any_const_ref can't (and any_ref converts to any_const_ref).
+// Like a pointer, it is only good while the thing it refers to is alive (and, for an any_movable, still holds the same thing).
+//
+// Referring directly to an object records its *static* type - ie via a Base & it is a Base,
+// found by has_type<Base>, and its derived type is not known (any_dynamic_cast finds bases of Base, not derived classes).
+//
+namespace any_ref_detail
+{
+    // all an any_ref needs to know about a T - it never moves or destroys it, so those are left out
+    template <typename T>
+    struct Ref
+    {
+        using D = any_movable_detail::Derived<T, std::allocator<std::byte>>;
+        static constexpr any_movable_detail::VTable vtable = {
+            &typeid(T),
+            sizeof(T),
+            alignof(T),
+            nullptr, // move_to
+            nullptr, // move_to_new
+            nullptr, // destroy
+            nullptr, // deallocate
+            nullptr, // move_assign
+            false, // nothrowMoveAssign
+            &D::youveGotToThrowItThrowIt,
+            std::is_class_v<T>,
+            false, // mostDerived - a T & might be part of something more derived (so don't cache where its bases are)
+            any_movable_detail::is_declared_v<T>,
+            &D::findDeclaredBase,
+            any_movable_detail::hash_fn<T>(),
+            any_movable_detail::equal_fn<T>(),
+        };
+    };
+}
+
+template <bool IsConst>
+class basic_any_ref
+{
+    template <bool>
+    friend class basic_any_ref;
+
+    template <typename T>
+    using ref_t = std::conditional_t<IsConst, T const, T>;
+    using pointer = ref_t<void> *;
+
+    pointer ptr = nullptr;
+    any_movable_detail::VTable const * vtbl = nullptr;
+
+    template <typename T>
+    static constexpr bool is_any_v = any_movable_detail::is_basic_any_movable_v<T>
+        || std::is_same_v<T, basic_any_ref<true>> || std::is_same_v<T, basic_any_ref<false>>;
+
+    template <typename T>
+    T * as_base() const
+    {
+        return any_movable_detail::try_as_base<T>(vtbl, const_cast<void *>(static_cast<void const *>(ptr)));
+    }
+
+public:
+    basic_any_ref() = default;
+
+    // refers to t (as a T)
+    template <typename T, typename = std::enable_if_t<!is_any_v<std::remove_cv_t<T>> && (IsConst || !std::is_const_v<T>)>>
+    basic_any_ref(T & t) noexcept
+        : ptr(std::addressof(t)), vtbl(&any_ref_detail::Ref<std::remove_cv_t<T>>::vtable)
+    {
+    }
+    // any_const_ref can also refer to a temporary (ie a function argument) - just don't keep it longer than that
+    template <typename T, typename = std::enable_if_t<IsConst && !std::is_lvalue_reference_v<T> && !is_any_v<std::remove_cv_t<T>>>>
+    basic_any_ref(T && t) noexcept
+        : ptr(std::addressof(t)), vtbl(&any_ref_detail::Ref<std::remove_cv_t<T>>::vtable)
+    {
+    }
+
+    // refers to whatever a holds (empty if a is empty) - without moving it
+    template <std::size_t N, std::size_t A, typename Al, bool NM>
+    basic_any_ref(basic_any_movable<N, A, Al, NM> & a) noexcept
+        : ptr(a.ptr), vtbl(a.ptr ? a.vtbl : nullptr)
+    {
+    }
+    template <std::size_t N, std::size_t A, typename Al, bool NM, bool C = IsConst, typename = std::enable_if_t<C>>
+    basic_any_ref(basic_any_movable<N, A, Al, NM> const & a) noexcept
+        : ptr(a.ptr), vtbl(a.ptr ? a.vtbl : nullptr)
+    {
+    }
+
+    // any_ref -> any_const_ref
+    template <bool C = IsConst, typename = std::enable_if_t<C>>
+    basic_any_ref(basic_any_ref<false> other) noexcept
+        : ptr(other.ptr), vtbl(other.vtbl)
+    {
+    }
+
+    bool has_value() const
+    {
+        return ptr != nullptr;
+    }
+    std::type_info const & type() const
+    {
+        return ptr ? *vtbl->type : typeid(void);
+    }
+    pointer data() const
+    {
+        return ptr;
+    }
+
+    template <typename T>
+    bool has_type() const
+    {
+        using U = std::remove_cv_t<std::remove_reference_t<T>>;
+        // (void, functions... can't be referred to - and there's no Ref<U>::vtable to compare with)
+        if constexpr (!std::is_object_v<U>)
+            return false;
+        else
+            // (when referring to an any_movable's item, vtbl is the any_movable's, so it's the type_info compare that finds it)
+            return vtbl == &any_ref_detail::Ref<U>::vtable || (ptr && *vtbl->type == typeid(T));
+    }
+    template <typename T>
+    bool has_dynamic_type() const
+    {
+        return has_type<T>() || as_base<T>() != nullptr;
+    }
+
+    template <typename T>
+    ref_t<T> * access_ptr() const
+    {
+        return has_type<T>() ? static_cast<ref_t<T> *>(ptr) : nullptr;
+    }
+    template <typename T>
+    ref_t<T> & access() const
+    {
+        if (ref_t<T> * p = access_ptr<T>())
+            return *p;
+        throw std::bad_any_cast();
+    }
+
+    template <typename T>
+    ref_t<T> * access_ptr_dynamic() const
+    {
+        if (ref_t<T> * p = access_ptr<T>())
+            return p;
+        return as_base<T>();
+    }
+    template <typename T>
+    ref_t<T> & access_dynamic() const
+    {
+        if (ref_t<T> * p = access_ptr_dynamic<T>())
+            return *p;
+        throw std::bad_any_cast();
+    }
+};
+
+using any_ref = basic_any_ref<false>;
+using any_const_ref = basic_any_ref<true>;
+
+static_assert(sizeof(any_ref) == 2 * sizeof(void *) && std::is_trivially_copyable_v<any_ref>);
+static_assert(sizeof(any_const_ref) == 2 * sizeof(void *) && std::is_trivially_copyable_v<any_const_ref>);
+
+template <typename T>
+[[nodiscard]] T * any_dynamic_cast(any_ref const * r)
+{
+    return r->template access_ptr_dynamic<T>();
+}
+template <typename T>
+[[nodiscard]] T const * any_dynamic_cast(any_const_ref const * r)
+{
+    return r->template access_ptr_dynamic<T>();
+}
+template <typename T>
+[[nodiscard]] T & any_dynamic_cast(any_ref r)
+{
+    return r.template access_dynamic<T>();
+}
+template <typename T>
+[[nodiscard]] T const & any_dynamic_cast(any_const_ref r)
+{
+    return r.template access_dynamic<T>();
+}
+
+namespace std
+{
+    template <typename T>
+    [[nodiscard]] T * any_cast(any_ref const * r)
+    {
+        return r ? r->template access_ptr<T>() : nullptr;
+    }
+    template <typename T>
+    [[nodiscard]] T const * any_cast(any_const_ref const * r)
+    {
+        return r ? r->template access_ptr<T>() : nullptr;
+    }
+    template <typename T>
+    [[nodiscard]] T & any_cast(any_ref r)
+    {
+        return r.template access<T>();
+    }
+    template <typename T>
+    [[nodiscard]] T const & any_cast(any_const_ref r)
+    {
+        return r.template access<T>();
+    }
+}
+
+#endif // _h
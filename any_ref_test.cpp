@@ -0,0 +1,183 @@
+#include "any_ref.h"
+#include "alloc_trace.h"
+
+#include <gtest/gtest.h>
+
+#include <memory_resource>
+#include <mutex>
+#include <string>
+#include <type_traits>
+
+// link with alloc_trace.cpp
+
+namespace
+{
+    struct Base { int b = 1; virtual ~Base() = default; };
+    struct Derived : Base { int d = 2; };
+    struct Undeclared : Base { int u = 3; };
+    struct Abstract { virtual int f() const = 0; virtual ~Abstract() = default; };
+    struct Concrete : Abstract { int f() const override { return 17; } };
+    struct VirtualBase { int v = 1; virtual ~VirtualBase() = default; };
+    struct HasVirtualBase : virtual VirtualBase { int h = 2; };
+    struct MoreDerived : HasVirtualBase { int m[8] = {}; };
+
+    struct MoveCounter
+    {
+        static int moves;
+        int val = 17;
+        MoveCounter() = default;
+        MoveCounter(MoveCounter && other) noexcept : val(other.val) { moves++; }
+    };
+    int MoveCounter::moves = 0;
+
+    int read(any_const_ref r)
+    {
+        if (int const * i = r.access_ptr<int>())
+            return *i;
+        if (std::string const * s = r.access_ptr<std::string>())
+            return (int)s->size();
+        return -1;
+    }
+}
+
+template <> struct any_movable_bases<Derived> { using type = any_bases<Base>; };
+
+TEST(any_ref, two_words_trivially_copyable)
+{
+    static_assert(sizeof(any_ref) == 2 * sizeof(void *));
+    static_assert(std::is_trivially_copyable_v<any_ref>);
+    static_assert(std::is_trivially_copyable_v<any_const_ref>);
+    static_assert(std::is_convertible_v<any_ref, any_const_ref>);
+    static_assert(!std::is_convertible_v<any_const_ref, any_ref>);
+    static_assert(!std::is_constructible_v<any_ref, int const &>);
+    static_assert(!std::is_constructible_v<any_ref, int &&>);
+    static_assert(std::is_constructible_v<any_const_ref, int &&>);
+    static_assert(!std::is_constructible_v<any_ref, any_movable const &>);
+}
+
+TEST(any_ref, empty)
+{
+    any_ref r;
+    EXPECT_FALSE(r.has_value());
+    EXPECT_EQ(typeid(void), r.type());
+    EXPECT_FALSE(r.has_type<int>());
+    EXPECT_THROW(r.access<int>(), std::bad_any_cast);
+
+    any_movable empty;
+    any_ref e = empty;
+    EXPECT_FALSE(e.has_value());
+}
+
+TEST(any_ref, refers_to_object)
+{
+    int x = 17;
+    any_ref r = x;
+    EXPECT_TRUE(r.has_type<int>());
+    EXPECT_FALSE(r.has_type<long>());
+    EXPECT_EQ(typeid(int), r.type());
+    EXPECT_EQ(&x, r.data());
+    r.access<int>() = 23;
+    EXPECT_EQ(23, x);
+    EXPECT_EQ(23, std::any_cast<int>(r));
+    EXPECT_EQ(nullptr, std::any_cast<long>(&r));
+}
+
+TEST(any_ref, const_ref_to_temporaries)
+{
+    EXPECT_EQ(17, read(17));
+    EXPECT_EQ(5, read(std::string("hello")));
+    EXPECT_EQ(-1, read(1.5));
+}
+
+TEST(any_ref, refers_to_any_movable_item_without_moving)
+{
+    MoveCounter::moves = 0;
+    any_movable a = MoveCounter();
+    int movesBefore = MoveCounter::moves;
+
+    any_ref r = a;
+    EXPECT_EQ(movesBefore, MoveCounter::moves);
+    EXPECT_EQ(a.data(), r.data());
+    EXPECT_TRUE(r.has_type<MoveCounter>());
+    r.access<MoveCounter>().val = 5;
+    EXPECT_EQ(5, a.access<MoveCounter>().val);
+
+    any_movable const & ca = a;
+    any_const_ref cr = ca;
+    EXPECT_EQ(5, cr.access<MoveCounter>().val);
+}
+
+TEST(any_ref, any_movable_with_other_allocator)
+{
+    pmr_any_movable a(std::allocator_arg, std::pmr::new_delete_resource(), std::string(100, 'x'));
+    any_const_ref r = a;
+    EXPECT_TRUE(r.has_type<std::string>());
+    EXPECT_EQ(100, read(a));
+}
+
+TEST(any_ref, never_allocates)
+{
+    any_movable a = std::string("in an any");
+    int x = 1;
+    auto heap = alloc_trace::count([&] {
+        any_ref r1 = x;
+        any_ref r2 = a;
+        any_const_ref r3 = r2;
+        EXPECT_EQ(9, read(r3));
+        EXPECT_EQ(1, read(r1));
+    });
+    EXPECT_EQ(0u, heap.allocations);
+}
+
+TEST(any_ref, dynamic)
+{
+    Derived d;
+    any_ref r = d;
+    EXPECT_TRUE(r.has_dynamic_type<Base>());
+    EXPECT_FALSE(r.has_type<Base>());
+    EXPECT_EQ(static_cast<Base *>(&d), &any_dynamic_cast<Base>(r));
+    EXPECT_EQ(static_cast<Base *>(&d), any_dynamic_cast<Base>(&r));
+    EXPECT_THROW((void)any_dynamic_cast<std::string>(r), std::bad_any_cast);
+
+    any_movable u = Undeclared();
+    any_const_ref ur = u;
+    EXPECT_EQ(1, any_dynamic_cast<Base>(ur).b);
+}
+
+TEST(any_ref, virtual_base_of_a_base)
+{
+    // r refers to it as a HasVirtualBase, but the VirtualBase is where MoreDerived put it,
+    // which isn't where a plain HasVirtualBase has it
+    MoreDerived md;
+    any_ref r = static_cast<HasVirtualBase &>(md);
+    EXPECT_EQ(static_cast<VirtualBase *>(&md), r.access_ptr_dynamic<VirtualBase>());
+
+    HasVirtualBase h;
+    any_ref hr = h;
+    EXPECT_EQ(static_cast<VirtualBase *>(&h), hr.access_ptr_dynamic<VirtualBase>());
+    EXPECT_EQ(static_cast<VirtualBase *>(&md), r.access_ptr_dynamic<VirtualBase>());
+}
+
+TEST(any_ref, abstract_and_immovable)
+{
+    Concrete c;
+    Abstract & a = c;
+    any_const_ref r = a; // refers to it as an Abstract
+    EXPECT_TRUE(r.has_type<Abstract>());
+    EXPECT_EQ(17, r.access<Abstract>().f());
+
+    std::mutex m;
+    any_ref mr = m;
+    EXPECT_EQ(&m, mr.access_ptr<std::mutex>());
+}
+
+TEST(any_ref, has_type_of_things_that_cant_be_referred_to)
+{
+    int i = 17;
+    any_ref r = i;
+    EXPECT_FALSE(r.has_type<void>());
+    EXPECT_FALSE(r.has_type<void const>());
+    EXPECT_FALSE(r.has_type<int(int)>());
+    EXPECT_FALSE(any_const_ref().has_type<void>());
+    EXPECT_TRUE(r.has_type<int>());
+}
@@ -0,0 +1,454 @@
+#ifndef any_shared_h_INCLUDED
+#define any_shared_h_INCLUDED
+
+#include "any_movable.h"
+
+#include <atomic>
+#include <new> // placement new, align_val_t
+#include <cstring> // memcpy
+#include <cstddef>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <any> // bad_any_cast
+
+//
+// Like any_movable, but copyable - cheaply.
+// Copies share the held item (a copy is just a reference count increment),
+// and the item is only really copied when you change it while it is shared ("copy on write"):
+//
+//    any_shared a = BigThing();
+//    any_shared b = a;                  // the same BigThing, not a copy
+//    b.access<BigThing>().x = 17;       // now b gets its own BigThing (a's is unchanged)
+//
+// So one big (mostly read-only) thing can be fanned out to lots of consumers.
+// The reference count lives in the same allocation as the item, right in front of it,
+// so there is one allocation and one pointer to follow (not shared_ptr<any>'s two of each).
+// Small trivially-copyable things (ints, small PODs) are held inline and just copied.
+//
+// access<T>, access_dynamic<T>, any_dynamic_cast, std::any_cast etc work like they do for any_movable, except that
+// the non-const versions hand out something you can change, so they first make the item unshared (ie copy it, if shared).
+// The const versions never copy - use std::as_const(a).access<T>() when you only want to look.
+// Held types must be copy-constructible (so there is a way to unshare them).
+//
+template <std::size_t InlineBytes, std::size_t Align>
+class basic_any_shared;
+
+namespace any_shared_detail
+{
+    using RefCount = std::atomic<std::size_t>;
+
+    // (any of them, whatever the size - those are never held as items)
+    template <typename T>
+    struct is_any_shared : std::false_type
+    {
+    };
+    template <std::size_t InlineBytes, std::size_t Align>
+    struct is_any_shared<basic_any_shared<InlineBytes, Align>> : std::true_type
+    {
+    };
+    template <typename T>
+    constexpr bool is_any_shared_v = is_any_shared<T>::value;
+
+    struct VTable
+    {
+        any_movable_detail::VTable const * item; // the held type's type, size, bases, etc
+        // a new (unshared) copy of item; null for inline items (which are just memcpy'd)
+        void * (*clone)(void const * item);
+        // destroys item and frees its block (once no one references it); null for inline items
+        void (*destroy)(void * item);
+    };
+
+    template <typename T>
+    using item_vtable = any_movable_detail::Derived<T, std::allocator<std::byte>>;
+
+    // one block: [ padding | RefCount | T ] - the count is right before the item, so it can be found from the item pointer
+    template <typename T>
+    struct Shared
+    {
+        static constexpr std::size_t align = alignof(T) > alignof(RefCount) ? alignof(T) : alignof(RefCount);
+        static constexpr std::size_t header = (sizeof(RefCount) + alignof(T) - 1) / alignof(T) * alignof(T);
+
+        template <typename ...Args>
+        static void * make(Args &&... args)
+        {
+            char * block = static_cast<char *>(::operator new(header + sizeof(T), std::align_val_t(align)));
+            new (block + header - sizeof(RefCount)) RefCount(1);
+            try
+            {
+                return new (block + header) T(std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                ::operator delete(block, std::align_val_t(align));
+                throw;
+            }
+        }
+        static void * clone(void const * item)
+        {
+            return make(*static_cast<T const *>(item));
+        }
+        static void destroy(void * item)
+        {
+            static_cast<T *>(item)->~T();
+            ::operator delete(static_cast<char *>(item) - header, std::align_val_t(align));
+        }
+
+        static constexpr VTable vtable = { &item_vtable<T>::vtable, &clone, &destroy };
+    };
+
+    template <typename T>
+    struct Inline
+    {
+        static constexpr VTable vtable = { &item_vtable<T>::vtable, nullptr, nullptr };
+    };
+
+    inline RefCount & ref_count(void const * item)
+    {
+        return *reinterpret_cast<RefCount *>(const_cast<char *>(static_cast<char const *>(item)) - sizeof(RefCount));
+    }
+}
+
+template <std::size_t InlineBytes, std::size_t Align = alignof(void *)>
+class basic_any_shared
+{
+    static_assert(InlineBytes > 0, "basic_any_shared needs at least some storage");
+
+    template <typename T>
+    static constexpr bool fits_inline = std::is_trivially_copyable_v<T> && sizeof(T) <= InlineBytes && alignof(T) <= Align;
+
+    template <typename T>
+    static constexpr any_shared_detail::VTable const * vtable_for()
+    {
+        if constexpr (fits_inline<T>)
+            return &any_shared_detail::Inline<T>::vtable;
+        else
+            return &any_shared_detail::Shared<T>::vtable;
+    }
+
+    struct Storage
+    {
+        alignas(Align) unsigned char data[InlineBytes];
+    };
+
+    Storage storage;
+    any_shared_detail::VTable const * vtbl = nullptr;
+    void * ptr = nullptr; // the held item, either in storage (small trivially-copyable items) or in a shared block; null when empty
+
+    bool is_local() const
+    {
+        return ptr == (void const *)storage.data; // (so also not null)
+    }
+
+    // (abstract and non-copyable types can't be held - abstract ones are only found as bases)
+    template <typename T>
+    bool is_vtable_of() const
+    {
+        if constexpr (std::is_abstract_v<T> || !std::is_copy_constructible_v<T>)
+            return false;
+        else
+            return vtbl == vtable_for<T>();
+    }
+
+    template <typename T>
+    T * as_base() const
+    {
+        return ptr ? any_movable_detail::try_as_base<T>(vtbl->item, ptr) : nullptr;
+    }
+
+    // let go of the item (and destroy it, if we were the last one holding it)
+    void release() noexcept
+    {
+        if (ptr && !is_local() && any_shared_detail::ref_count(ptr).fetch_sub(1, std::memory_order_acq_rel) == 1)
+            vtbl->destroy(ptr);
+        ptr = nullptr;
+        vtbl = nullptr;
+    }
+
+    void take(basic_any_shared & other) noexcept
+    {
+        vtbl = other.vtbl;
+        if (other.is_local())
+        {
+            std::memcpy(&storage, &other.storage, sizeof(Storage));
+            ptr = storage.data;
+        }
+        else
+            ptr = other.ptr;
+        other.ptr = nullptr;
+        other.vtbl = nullptr;
+    }
+
+    // make the item ours alone (copying it if it is shared), before handing out something that can change it
+    void unshare()
+    {
+        if (!ptr || is_local())
+            return;
+        any_shared_detail::RefCount & count = any_shared_detail::ref_count(ptr);
+        if (count.load(std::memory_order_acquire) == 1)
+            return;
+        void * mine = vtbl->clone(ptr);
+        if (count.fetch_sub(1, std::memory_order_acq_rel) == 1) // the others let go of it in the meantime
+            vtbl->destroy(ptr);
+        ptr = mine;
+    }
+
+    template <typename T, typename ...Args>
+    std::decay_t<T> & make(Args &&... args)
+    {
+        using UT = std::decay_t<T>;
+        static_assert(std::is_copy_constructible_v<UT>, "any_shared needs to be able to copy what it holds");
+        static_assert(!any_shared_detail::is_any_shared_v<UT>, "an any_shared doesn't hold another any_shared");
+        // make the new one before letting go of the old one, in case args refer to the old one
+        if constexpr (fits_inline<UT>)
+        {
+            UT item(std::forward<Args>(args)...);
+            release();
+            ptr = new (storage.data) UT(item);
+        }
+        else
+        {
+            void * item = any_shared_detail::Shared<UT>::make(std::forward<Args>(args)...);
+            release();
+            ptr = item;
+        }
+        vtbl = vtable_for<UT>();
+        return *static_cast<UT *>(ptr);
+    }
+
+public:
+    basic_any_shared() {}
+    ~basic_any_shared()
+    {
+        release();
+    }
+
+    basic_any_shared(basic_any_shared const & other) noexcept
+        : vtbl(other.vtbl)
+    {
+        if (other.is_local())
+        {
+            std::memcpy(&storage, &other.storage, sizeof(Storage));
+            ptr = storage.data;
+        }
+        else if ((ptr = other.ptr) != nullptr)
+            any_shared_detail::ref_count(ptr).fetch_add(1, std::memory_order_relaxed);
+    }
+    basic_any_shared(basic_any_shared && other) noexcept
+    {
+        take(other);
+    }
+    basic_any_shared & operator=(basic_any_shared const & other) noexcept
+    {
+        if (this != &other)
+        {
+            basic_any_shared copy(other);
+            release();
+            take(copy);
+        }
+        return *this;
+    }
+    basic_any_shared & operator=(basic_any_shared && other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            take(other);
+        }
+        return *this;
+    }
+
+    template <typename T, typename = std::enable_if_t<!any_shared_detail::is_any_shared_v<std::decay_t<T>>>>
+    basic_any_shared(T && t)
+    {
+        make<T>(std::forward<T>(t));
+    }
+    template <typename T, typename = std::enable_if_t<!any_shared_detail::is_any_shared_v<std::decay_t<T>>>>
+    basic_any_shared & operator=(T && t)
+    {
+        make<T>(std::forward<T>(t));
+        return *this;
+    }
+
+    template <typename T, typename ...Args>
+    std::decay_t<T> & emplace(Args &&... args)
+    {
+        return make<T>(std::forward<Args>(args)...);
+    }
+
+    void reset() noexcept
+    {
+        release();
+    }
+
+    void swap(basic_any_shared & other) noexcept
+    {
+        basic_any_shared tmp(std::move(other));
+        other = std::move(*this);
+        *this = std::move(tmp);
+    }
+    friend void swap(basic_any_shared & a, basic_any_shared & b) noexcept
+    {
+        a.swap(b);
+    }
+
+    bool has_value() const
+    {
+        return ptr != nullptr;
+    }
+    std::type_info const & type() const
+    {
+        return ptr ? *vtbl->item->type : typeid(void);
+    }
+
+    // how many any_shareds hold this same item (0 when empty, and always 1 for inline items)
+    std::size_t use_count() const
+    {
+        if (!ptr)
+            return 0;
+        return is_local() ? 1 : any_shared_detail::ref_count(ptr).load(std::memory_order_relaxed);
+    }
+    bool is_shared() const
+    {
+        return use_count() > 1;
+    }
+
+    // the held item, untyped (null when empty) - const only, since changing it would change it for everyone
+    void const * data() const
+    {
+        return ptr;
+    }
+
+    template <typename T>
+    bool has_type() const
+    {
+        // like any_movable, compare vtables first (cheap), then type_infos (in case of DLLs)
+        return is_vtable_of<std::remove_cv_t<std::remove_reference_t<T>>>() || (ptr && *vtbl->item->type == typeid(T));
+    }
+    template <typename T>
+    bool has_dynamic_type() const
+    {
+        return has_type<T>() || as_base<T>() != nullptr;
+    }
+
+    template <typename T>
+    T const * access_ptr() const
+    {
+        return has_type<T>() ? static_cast<T const *>(ptr) : nullptr;
+    }
+    // unshares (ie copies) the item if it is shared
+    template <typename T>
+    T * access_ptr()
+    {
+        if (!has_type<T>())
+            return nullptr;
+        unshare();
+        return static_cast<T *>(ptr);
+    }
+    template <typename T>
+    T const & access() const
+    {
+        if (T const * p = access_ptr<T>())
+            return *p;
+        throw std::bad_any_cast();
+    }
+    template <typename T>
+    T & access()
+    {
+        if (T * p = access_ptr<T>())
+            return *p;
+        throw std::bad_any_cast();
+    }
+
+    template <typename T>
+    T const * access_ptr_dynamic() const
+    {
+        if (T const * p = access_ptr<T>())
+            return p;
+        return as_base<T>();
+    }
+    template <typename T>
+    T * access_ptr_dynamic()
+    {
+        if (has_type<T>())
+            return access_ptr<T>();
+        if (!as_base<T>())
+            return nullptr;
+        unshare();
+        return as_base<T>(); // (in our own copy)
+    }
+    template <typename T>
+    T const & access_dynamic() const
+    {
+        if (T const * p = access_ptr_dynamic<T>())
+            return *p;
+        throw std::bad_any_cast();
+    }
+    template <typename T>
+    T & access_dynamic()
+    {
+        if (T * p = access_ptr_dynamic<T>())
+            return *p;
+        throw std::bad_any_cast();
+    }
+};
+
+// small trivially-copyable things (up to 2 pointers worth) are held inline
+using any_shared = basic_any_shared<2 * sizeof(void *)>;
+
+template <typename T, std::size_t N, std::size_t A>
+[[nodiscard]] T const * any_dynamic_cast(basic_any_shared<N, A> const * a)
+{
+    return a->template access_ptr_dynamic<T>();
+}
+template <typename T, std::size_t N, std::size_t A>
+[[nodiscard]] T * any_dynamic_cast(basic_any_shared<N, A> * a)
+{
+    return a->template access_ptr_dynamic<T>();
+}
+template <typename T, std::size_t N, std::size_t A>
+[[nodiscard]] T const & any_dynamic_cast(basic_any_shared<N, A> const & a)
+{
+    return a.template access_dynamic<T>();
+}
+template <typename T, std::size_t N, std::size_t A>
+[[nodiscard]] T & any_dynamic_cast(basic_any_shared<N, A> & a)
+{
+    return a.template access_dynamic<T>();
+}
+template <typename T, std::size_t N, std::size_t A>
+[[nodiscard]] T && any_dynamic_cast(basic_any_shared<N, A> && a)
+{
+    return std::move(a.template access_dynamic<T>());
+}
+
+namespace std
+{
+    template <typename T, std::size_t N, std::size_t A>
+    [[nodiscard]] T const * any_cast(basic_any_shared<N, A> const * a)
+    {
+        return a ? a->template access_ptr<T>() : nullptr;
+    }
+    template <typename T, std::size_t N, std::size_t A>
+    [[nodiscard]] T * any_cast(basic_any_shared<N, A> * a)
+    {
+        return a ? a->template access_ptr<T>() : nullptr;
+    }
+    template <typename T, std::size_t N, std::size_t A>
+    [[nodiscard]] T const & any_cast(basic_any_shared<N, A> const & a)
+    {
+        return a.template access<T>();
+    }
+    template <typename T, std::size_t N, std::size_t A>
+    [[nodiscard]] T & any_cast(basic_any_shared<N, A> & a)
+    {
+        return a.template access<T>();
+    }
+    template <typename T, std::size_t N, std::size_t A>
+    [[nodiscard]] T && any_cast(basic_any_shared<N, A> && a)
+    {
+        return std::move(a.template access<T>());
+    }
+}
+
+#endif // _h
@@ -0,0 +1,211 @@
+#include "any_shared.h"
+#include "alloc_trace.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// link with alloc_trace.cpp
+
+namespace
+{
+    struct Big
+    {
+        static int copies;
+        static int alive;
+        std::vector<int> data = std::vector<int>(1000, 17);
+        Big() { alive++; }
+        Big(Big const & other) : data(other.data) { copies++; alive++; }
+        Big & operator=(Big const &) = default;
+        ~Big() { alive--; }
+    };
+    int Big::copies = 0;
+    int Big::alive = 0;
+
+    struct Point
+    {
+        int x, y;
+    };
+
+    struct Base { int b = 1; virtual ~Base() = default; };
+    struct Derived : Base { int d = 2; };
+    struct Undeclared : Base { };
+
+    struct alignas(64) Aligned
+    {
+        std::string s = "aligned";
+    };
+}
+
+template <> struct any_movable_bases<Derived> { using type = any_bases<Base>; };
+
+TEST(any_shared, empty)
+{
+    any_shared a;
+    EXPECT_FALSE(a.has_value());
+    EXPECT_EQ(typeid(void), a.type());
+    EXPECT_EQ(0u, a.use_count());
+    EXPECT_FALSE(a.has_type<int>());
+    EXPECT_THROW(a.access<int>(), std::bad_any_cast);
+}
+
+TEST(any_shared, copies_share)
+{
+    Big::copies = 0;
+    {
+        any_shared a = Big();
+        Big::copies = 0;
+        any_shared b = a;
+        any_shared c;
+        c = b;
+        EXPECT_EQ(0, Big::copies);
+        EXPECT_EQ(3u, a.use_count());
+        EXPECT_TRUE(c.is_shared());
+        EXPECT_EQ(a.data(), c.data());
+        EXPECT_EQ(1, Big::alive);
+    }
+    EXPECT_EQ(0, Big::alive);
+}
+
+TEST(any_shared, copy_is_one_allocation_then_none)
+{
+    alloc_trace::scope heap;
+    any_shared a = std::string(100, 'x');
+    EXPECT_EQ(2u, heap.so_far().allocations); // the block (count + string), and the string's chars
+    heap.restart();
+    std::vector<any_shared> consumers(10, a);
+    EXPECT_EQ(1u, heap.so_far().allocations); // just the vector
+    EXPECT_EQ(11u, a.use_count());
+}
+
+TEST(any_shared, const_access_does_not_copy)
+{
+    any_shared a = Big();
+    any_shared b = a;
+    Big::copies = 0;
+    EXPECT_EQ(17, std::as_const(b).access<Big>().data[0]);
+    EXPECT_EQ(17, std::any_cast<Big>(&std::as_const(b))->data[5]);
+    EXPECT_EQ(0, Big::copies);
+    EXPECT_EQ(2u, a.use_count());
+}
+
+TEST(any_shared, writing_unshares)
+{
+    any_shared a = Big();
+    any_shared b = a;
+    Big::copies = 0;
+    b.access<Big>().data[0] = 23;
+    EXPECT_EQ(1, Big::copies);
+    EXPECT_EQ(17, std::as_const(a).access<Big>().data[0]);
+    EXPECT_EQ(23, std::as_const(b).access<Big>().data[0]);
+    EXPECT_EQ(1u, a.use_count());
+    EXPECT_EQ(1u, b.use_count());
+
+    // not shared anymore, so no more copies
+    b.access<Big>().data[1] = 23;
+    EXPECT_EQ(1, Big::copies);
+}
+
+TEST(any_shared, small_trivial_things_are_inline)
+{
+    auto heap = alloc_trace::count([] {
+        any_shared a = 17;
+        any_shared b = Point{ 1, 2 };
+        any_shared c = b;
+        c.access<Point>().x = 3;
+        EXPECT_EQ(1, std::as_const(b).access<Point>().x);
+        EXPECT_EQ(3, std::as_const(c).access<Point>().x);
+        EXPECT_EQ(1u, b.use_count());
+        EXPECT_NE(b.data(), c.data());
+        a = 18;
+        EXPECT_EQ(18, std::any_cast<int>(std::as_const(a)));
+    });
+    EXPECT_EQ(0u, heap.allocations);
+}
+
+TEST(any_shared, over_aligned)
+{
+    any_shared a = Aligned();
+    any_shared b = a;
+    EXPECT_EQ(0u, reinterpret_cast<std::uintptr_t>(a.data()) % 64);
+    b.access<Aligned>().s = "mine";
+    EXPECT_EQ(0u, reinterpret_cast<std::uintptr_t>(b.data()) % 64);
+    EXPECT_EQ("aligned", std::as_const(a).access<Aligned>().s);
+}
+
+TEST(any_shared, moves)
+{
+    any_shared a = std::string("hello");
+    any_shared b = std::move(a);
+    EXPECT_FALSE(a.has_value());
+    EXPECT_EQ(1u, b.use_count());
+    a = std::move(b);
+    EXPECT_EQ("hello", std::as_const(a).access<std::string>());
+
+    any_shared i = 17;
+    any_shared j = std::move(i);
+    EXPECT_EQ(17, std::as_const(j).access<int>());
+
+    swap(a, j);
+    EXPECT_TRUE(a.has_type<int>());
+    EXPECT_TRUE(j.has_type<std::string>());
+}
+
+TEST(any_shared, assign_from_own_item)
+{
+    any_shared a = std::string("self");
+    a = std::as_const(a).access<std::string>();
+    EXPECT_EQ("self", std::as_const(a).access<std::string>());
+}
+
+TEST(any_shared, dynamic)
+{
+    any_shared a = Derived();
+    any_shared b = a;
+    EXPECT_TRUE(a.has_dynamic_type<Base>());
+    EXPECT_FALSE(a.has_type<Base>());
+    EXPECT_EQ(1, any_dynamic_cast<Base>(std::as_const(a)).b);
+    EXPECT_EQ(2u, a.use_count());
+
+    any_dynamic_cast<Base>(b).b = 5; // unshares
+    EXPECT_EQ(1, any_dynamic_cast<Base const>(std::as_const(a)).b);
+    EXPECT_EQ(5, std::as_const(b).access<Derived>().b);
+
+    any_shared u = Undeclared();
+    EXPECT_NE(nullptr, any_dynamic_cast<Base>(&u));
+    EXPECT_THROW((void)any_dynamic_cast<std::string>(u), std::bad_any_cast);
+}
+
+TEST(any_shared, other_sizes_are_not_items)
+{
+    using bigger_any_shared = basic_any_shared<64>;
+    static_assert(!std::is_constructible_v<any_shared, bigger_any_shared>);
+    static_assert(!std::is_constructible_v<any_shared, bigger_any_shared const &>);
+    static_assert(!std::is_assignable_v<any_shared &, bigger_any_shared>);
+    static_assert(!std::is_constructible_v<bigger_any_shared, any_shared &>);
+    static_assert(std::is_constructible_v<any_shared, std::string>);
+}
+
+TEST(any_shared, threads)
+{
+    any_shared a = Big();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++)
+        threads.emplace_back([a]() mutable {
+            for (int i = 0; i < 1000; i++)
+            {
+                any_shared copy = a;
+                EXPECT_EQ(17, std::as_const(copy).access<Big>().data[0]);
+            }
+            a.access<Big>().data[0] = 1; // each thread's own
+        });
+    for (auto & t : threads)
+        t.join();
+    EXPECT_EQ(1u, a.use_count());
+    EXPECT_EQ(17, std::as_const(a).access<Big>().data[0]);
+}
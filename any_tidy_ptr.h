@@ -2,8 +2,162 @@
 #define any_tidy_ptr_h_INCLUDED
 
 #include <memory> // std::unique_ptr
-#include <functional>  // std::function
+#include <new> // placement new, launder
+#include <cstddef> // std::nullptr_t
 #include <type_traits> // std::remove_extent
+#include <utility>
+
+//
+// The deleter for any_tidy_ptr<T> - holds *any* callable that can delete a T (pointer)
+// (like std::function<void(pointer)>, but smaller, and only allocates for big deleters).
+//
+// It is one function pointer plus 2 words of inline space for the callable, so
+// lambdas that capture a pointer or two, function pointers, and the shared_ptr any_tidy_ptr uses below all fit (no allocation).
+// A default-constructed one is std::default_delete<T> (and doesn't even need the function pointer called).
+// Moving one leaves the moved-from one as std::default_delete<T> (not "empty" - calling it never throws).
+//
+template <typename T>
+class tidy_deleter
+{
+public:
+    using pointer = std::remove_extent_t<T> *;
+
+private:
+    struct Context
+    {
+        alignas(void *) unsigned char bytes[2 * sizeof(void *)];
+    };
+    enum class Op { call, move, destroy };
+    // one function for everything (like a vtable, but just one pointer)
+    // call: arg is a pointer *; move: arg is the Context to move from (and then destroy); destroy: arg is unused
+    using Manager = void (*)(Op op, Context & self, void * arg);
+
+    Manager manage = nullptr; // null means std::default_delete<T>
+    Context ctx;
+
+    template <typename F>
+    static constexpr bool fits_inline = sizeof(F) <= sizeof(Context) && alignof(F) <= alignof(Context)
+        && std::is_nothrow_move_constructible_v<F>;
+
+    template <typename F>
+    static F & inline_item(Context & c)
+    {
+        return *std::launder(reinterpret_cast<F *>(c.bytes));
+    }
+    template <typename F>
+    static void manage_inline(Op op, Context & self, void * arg)
+    {
+        F & f = inline_item<F>(self);
+        switch (op)
+        {
+        case Op::call:
+            f(*static_cast<pointer *>(arg));
+            break;
+        case Op::move:
+        {
+            F & from = inline_item<F>(*static_cast<Context *>(arg));
+            new (self.bytes) F(std::move(from));
+            from.~F();
+            break;
+        }
+        case Op::destroy:
+            f.~F();
+            break;
+        }
+    }
+
+    // too big (or throwing moves) - the callable lives on the heap, and the Context just holds the F *
+    template <typename F>
+    static void manage_heap(Op op, Context & self, void * arg)
+    {
+        F *& f = inline_item<F *>(self);
+        switch (op)
+        {
+        case Op::call:
+            (*f)(*static_cast<pointer *>(arg));
+            break;
+        case Op::move:
+            new (self.bytes) F *(inline_item<F *>(*static_cast<Context *>(arg)));
+            break;
+        case Op::destroy:
+            delete f;
+            break;
+        }
+    }
+
+    static void manage_nothing(Op, Context &, void *)
+    {
+    }
+
+    void take(tidy_deleter & other) noexcept
+    {
+        manage = other.manage;
+        if (manage)
+            manage(Op::move, ctx, &other.ctx);
+        other.manage = nullptr;
+    }
+    void destroy() noexcept
+    {
+        if (manage)
+            manage(Op::destroy, ctx, nullptr);
+        manage = nullptr;
+    }
+
+public:
+    tidy_deleter() noexcept = default;
+
+    template <typename F, typename D = std::decay_t<F>,
+        typename = std::enable_if_t<!std::is_same_v<D, tidy_deleter> && std::is_invocable_v<D &, pointer>>>
+    tidy_deleter(F && f)
+    {
+        if constexpr (std::is_same_v<D, std::default_delete<T>>)
+            return; // (manage = nullptr is already that)
+        else if constexpr (fits_inline<D>)
+        {
+            new (ctx.bytes) D(std::forward<F>(f));
+            manage = &manage_inline<D>;
+        }
+        else
+        {
+            new (ctx.bytes) D *(new D(std::forward<F>(f)));
+            manage = &manage_heap<D>;
+        }
+    }
+
+    // a deleter that doesn't delete (for pointers that belong to someone else)
+    static tidy_deleter nothing() noexcept
+    {
+        tidy_deleter d;
+        d.manage = &manage_nothing;
+        return d;
+    }
+
+    tidy_deleter(tidy_deleter && other) noexcept
+    {
+        take(other);
+    }
+    tidy_deleter & operator=(tidy_deleter && other) noexcept
+    {
+        if (this != &other)
+        {
+            destroy();
+            take(other);
+        }
+        return *this;
+    }
+    ~tidy_deleter()
+    {
+        destroy();
+    }
+
+    void operator()(pointer p)
+    {
+        if (!manage)
+            std::default_delete<T>()(p);
+        else
+            manage(Op::call, ctx, &p);
+    }
+};
 
 //
 // a unique_ptr with *any* deleter (ie deleter can change at runtime, not just compile time)
@@ -17,28 +171,32 @@
 // It can also hold shared_ptrs (to share pixels)
 // or raw pointers that you don't want to delete (pass in a deleter that does nothing)
 //
+// (It used to be a unique_ptr<T, std::function>, which is 5 words and can allocate;
+// with tidy_deleter it is 4 words, and the common deleters never allocate.)
+//
 template <class T>
-struct any_tidy_ptr : public std::unique_ptr<T, std::function<void(std::remove_extent_t<T> *)>>
+struct any_tidy_ptr : public std::unique_ptr<T, tidy_deleter<T>>
 {
-    using pointer = std::remove_extent_t<T> *;  // if T is an array, say int[], pointer is still a pointer, ie int * 
-    using base_unique = std::unique_ptr<T, std::function<void(pointer)>>;
+    using pointer = std::remove_extent_t<T> *;  // if T is an array, say int[], pointer is still a pointer, ie int *
+    using base_unique = std::unique_ptr<T, tidy_deleter<T>>;
 
-    using base_unique::element_type;
-    using base_unique::deleter_type;
+    using typename base_unique::element_type;
+    using typename base_unique::deleter_type;
 
     // we want all of our base unique_ptr's constructors
-    using std::unique_ptr<T, std::function<void(std::remove_extent_t<T> *)>>::unique_ptr;
+    using std::unique_ptr<T, tidy_deleter<T>>::unique_ptr;
     // we want all of unique_ptr's constructors
     //using base_unique::base_unique;
 
     any_tidy_ptr() = default;
 
-    explicit any_tidy_ptr(pointer ptr) : base_unique(ptr, std::default_delete<T>())
+    // (a default tidy_deleter is std::default_delete<T>)
+    explicit any_tidy_ptr(pointer ptr) : base_unique(ptr)
     {
     }
 
     // a pointer you don't want any_tidy_ptr to delete:
-    any_tidy_ptr(pointer ptr, std::nullptr_t) : base_unique(ptr, [](pointer){})
+    any_tidy_ptr(pointer ptr, std::nullptr_t) : base_unique(ptr, deleter_type::nothing())
     {
     }
 
@@ -55,4 +213,7 @@ struct any_tidy_ptr : public std::unique_ptr<T, std::function<void(std::remove_e
     pointer * get_deleter() = delete;
 };
 
+static_assert(sizeof(tidy_deleter<int>) == 3 * sizeof(void *));
+static_assert(sizeof(any_tidy_ptr<int>) == 4 * sizeof(void *));
+
 #endif // _h
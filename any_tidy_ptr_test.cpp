@@ -1,9 +1,13 @@
 #include "any_tidy_ptr.h"
+#include "alloc_trace.h"
 
 #include <gtest/gtest.h>
 
+#include <array>
 #include <type_traits>
 
+// link with alloc_trace.cpp
+
 namespace
 {
     struct Tracker
@@ -108,7 +112,7 @@ TEST(any_tidy_ptr, ctor_ptr_zero)
         {
             // I don't think anyone should construct with 0 or NULL (use nullptr!)
             // but this is here to check that it calls the nullptr constructor,
-            // and not the std::function constructor (which would make std::function null, and throw on destruction)
+            // and not the deleter constructor (back when the deleter was a std::function, that made it null, and throw on destruction)
             any_tidy_ptr<Tracker> p(&tracker, 0);  // will not delete!
             EXPECT_EQ(1, Tracker::aliveCount);
             bool threw = false;
@@ -350,13 +354,14 @@ TEST(any_tidy_ptr, operator_array)
 
 TEST(any_tidy_ptr, member_typedefs)
 {
-    // same as unique_ptr<T, std::function>
+    // same as unique_ptr<T, tidy_deleter<T>>
     static_assert(std::is_same<any_tidy_ptr<int>::pointer, int *>::value, "any_tidy_ptr<T>::pointer should be T*");
     static_assert(std::is_same<any_tidy_ptr<int[]>::pointer, int *>::value, "any_tidy_ptr<T[]>::pointer should be T*");
     static_assert(std::is_same<any_tidy_ptr<int>::element_type, int>::value, "any_tidy_ptr<T>::element_type should be T");
     static_assert(std::is_same<any_tidy_ptr<int[]>::element_type, int>::value, "any_tidy_ptr<T[]>::element_type should be T");
-    static_assert(std::is_same<any_tidy_ptr<int>::deleter_type, std::function<void(int *)> >::value, "any_tidy_ptr<T>::deleter_type should be std::function<void(T*)>");
-    static_assert(std::is_same<any_tidy_ptr<int[]>::deleter_type, std::function<void(int *)> >::value, "any_tidy_ptr<T[]>::deleter_type should be std::function<void(T*)>");
+    static_assert(std::is_same<any_tidy_ptr<int>::deleter_type, tidy_deleter<int> >::value, "any_tidy_ptr<T>::deleter_type should be tidy_deleter<T>");
+    static_assert(std::is_same<any_tidy_ptr<int[]>::deleter_type, tidy_deleter<int[]> >::value, "any_tidy_ptr<T[]>::deleter_type should be tidy_deleter<T[]>");
+    static_assert(std::is_same<tidy_deleter<int[]>::pointer, int *>::value, "tidy_deleter<T[]> deletes T*s");
 }
 
 
@@ -389,3 +394,55 @@ TEST(any_tidy_ptr, operator_compare)
     EXPECT_TRUE(q >= r);
     EXPECT_TRUE(r >= q);
 }
+
+
+TEST(any_tidy_ptr, small)
+{
+    static_assert(sizeof(any_tidy_ptr<int>) == 4 * sizeof(void *), "pointer + function pointer + 2 words of deleter");
+}
+
+TEST(any_tidy_ptr, common_deleters_dont_allocate)
+{
+    int x = 17;
+    int deleted = 0;
+    std::shared_ptr<Tracker> sp = std::make_shared<Tracker>();
+    auto c = alloc_trace::count([&] {
+        any_tidy_ptr<Tracker> def;
+        any_tidy_ptr<int> none(&x, nullptr);
+        any_tidy_ptr<int> lambda(&x, [&deleted](int *) { deleted++; });
+        any_tidy_ptr<Tracker> shared(sp);
+        any_tidy_ptr<Tracker> moved = std::move(shared);
+        any_tidy_ptr<int> assigned;
+        assigned = std::move(lambda);
+    });
+    EXPECT_EQ(0u, c.allocations);
+    EXPECT_EQ(1, deleted);
+    EXPECT_EQ(1, sp.use_count());
+}
+
+TEST(any_tidy_ptr, big_deleters)
+{
+    // too big to fit inline, so it goes on the heap - but still works
+    std::array<int, 10> big{};
+    big[9] = 17;
+    int seen = 0;
+    {
+        any_tidy_ptr<Tracker> p(new Tracker, [big, &seen](Tracker * t) { seen = big[9]; delete t; });
+        any_tidy_ptr<Tracker> q = std::move(p);
+        EXPECT_EQ(1, Tracker::aliveCount);
+    }
+    EXPECT_EQ(0, Tracker::aliveCount);
+    EXPECT_EQ(17, seen);
+}
+
+TEST(any_tidy_ptr, moved_from_deleter_is_default_delete)
+{
+    int deleted = 0;
+    any_tidy_ptr<Tracker> p(nullptr, [&deleted](Tracker *) { deleted++; });
+    any_tidy_ptr<Tracker> q = std::move(p);
+    p.reset(new Tracker); // p's (moved-from) deleter is std::default_delete
+    EXPECT_EQ(1, Tracker::aliveCount);
+    p.reset();
+    EXPECT_EQ(0, Tracker::aliveCount);
+    EXPECT_EQ(0, deleted);
+}
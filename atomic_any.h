@@ -0,0 +1,276 @@
+#ifndef atomic_any_h_INCLUDED
+#define atomic_any_h_INCLUDED
+
+#include "any_movable.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+#include <type_traits>
+#include <algorithm> // remove_if
+
+//
+// For read-mostly things (ie config) that are read all the time, by lots of threads, and replaced now and then:
+//
+//    atomic_any config = Config{ ... };
+//
+//    // readers - no lock, no shared reference count to fight over
+//    auto snap = config.load();
+//    Config const & c = snap.access<Config>();
+//
+//    // writers - build the new one, then swap it in
+//    config.store(Config{ ... });
+//
+// A snapshot pins the item it was given (it stays alive, and unchanged, while the snapshot is alive)
+// even if a writer replaces it meanwhile - so readers see a consistent item, never a half-updated one.
+//
+// How: epoch-based reclamation.
+// Each reading thread has its own record (on its own cache line) where it says "I'm reading, since epoch E".
+// A replaced item is "retired" at the current epoch, and only deleted once the epoch has moved on twice -
+// which it can only do once every thread that was reading has finished.
+// So all a reader does is write its own record (and then clear it), which is why readers scale with cores.
+// Writers take a mutex (there are few of them) and do the bookkeeping.
+//
+// Keep snapshots short - a long-lived snapshot holds back the deletion of everything replaced after it started.
+// And a snapshot belongs to the thread that loaded it (don't hand it to another thread).
+//
+namespace atomic_any_detail
+{
+    struct alignas(64) Record // one per thread that has ever read (reused after the thread exits)
+    {
+        std::atomic<std::uint64_t> epoch{ 0 }; // 0 when not reading
+        std::atomic<bool> owned{ false };
+        Record * next = nullptr;
+    };
+
+    // process-wide, so one thread reading two atomic_anys is still one record
+    struct Domain
+    {
+        std::atomic<std::uint64_t> epoch{ 1 };
+        std::atomic<Record *> records{ nullptr }; // never shrinks (records are tiny, and reused)
+
+        Record * acquire()
+        {
+            for (Record * r = records.load(std::memory_order_acquire); r; r = r->next)
+            {
+                bool expected = false;
+                if (!r->owned.load(std::memory_order_relaxed) && r->owned.compare_exchange_strong(expected, true))
+                    return r;
+            }
+            Record * r = new Record;
+            r->owned.store(true, std::memory_order_relaxed);
+            r->next = records.load(std::memory_order_relaxed);
+            while (!records.compare_exchange_weak(r->next, r, std::memory_order_release, std::memory_order_relaxed))
+                ;
+            return r;
+        }
+
+        // moves the epoch on, if every thread that is reading started in this epoch
+        // returns the (possibly new) epoch
+        std::uint64_t try_advance()
+        {
+            std::uint64_t e = epoch.load(std::memory_order_seq_cst);
+            for (Record * r = records.load(std::memory_order_acquire); r; r = r->next)
+            {
+                std::uint64_t re = r->epoch.load(std::memory_order_seq_cst);
+                if (re != 0 && re != e)
+                    return e; // someone is still reading in an older epoch
+            }
+            epoch.compare_exchange_strong(e, e + 1, std::memory_order_seq_cst); // (if it fails, someone else advanced it)
+            return epoch.load(std::memory_order_seq_cst);
+        }
+    };
+
+    inline Domain & domain()
+    {
+        static Domain d;
+        return d;
+    }
+
+    struct ThreadState
+    {
+        Record * record = nullptr;
+        unsigned pins = 0; // snapshots can nest
+
+        ~ThreadState()
+        {
+            if (record)
+                record->owned.store(false, std::memory_order_release);
+        }
+    };
+
+    inline ThreadState & this_thread()
+    {
+        static thread_local ThreadState state;
+        return state;
+    }
+
+    inline void pin()
+    {
+        ThreadState & t = this_thread();
+        if (t.pins++ == 0)
+        {
+            if (!t.record)
+                t.record = domain().acquire();
+            // seq_cst, so a writer either sees that we are reading, or we see its new item
+            t.record->epoch.store(domain().epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+        }
+    }
+    inline void unpin()
+    {
+        ThreadState & t = this_thread();
+        if (--t.pins == 0)
+            t.record->epoch.store(0, std::memory_order_release);
+    }
+}
+
+template <typename Any = any_movable>
+class basic_atomic_any
+{
+    struct Retired
+    {
+        Any * item;
+        std::uint64_t epoch;
+    };
+
+    std::atomic<Any *> current;
+    mutable std::mutex writers;
+    std::vector<Retired> retired; // (guarded by writers)
+
+    // delete whatever no reader can still see (call with writers locked)
+    void collect()
+    {
+        using namespace atomic_any_detail;
+        // twice: once for readers that started before the last retire, once more to be sure they're gone
+        domain().try_advance();
+        std::uint64_t e = domain().try_advance();
+        auto done = std::remove_if(retired.begin(), retired.end(), [e](Retired const & r) {
+            if (r.epoch + 2 > e)
+                return false;
+            delete r.item;
+            return true;
+        });
+        retired.erase(done, retired.end());
+    }
+
+    void publish(Any * fresh)
+    {
+        Any * old = current.exchange(fresh, std::memory_order_seq_cst);
+        std::lock_guard<std::mutex> lock(writers);
+        retired.push_back(Retired{ old, atomic_any_detail::domain().epoch.load(std::memory_order_seq_cst) });
+        collect();
+    }
+
+public:
+    // a pinned, read-only view of the item, as it was when load() was called
+    class snapshot
+    {
+        friend class basic_atomic_any;
+        Any const * item;
+
+        explicit snapshot(Any const * item)
+            : item(item)
+        {
+        }
+
+    public:
+        snapshot(snapshot && other) noexcept
+            : item(std::exchange(other.item, nullptr))
+        {
+        }
+        snapshot & operator=(snapshot &&) = delete;
+        snapshot(snapshot const &) = delete;
+        ~snapshot()
+        {
+            if (item)
+                atomic_any_detail::unpin();
+        }
+
+        Any const & operator*() const
+        {
+            return *item;
+        }
+        Any const * operator->() const
+        {
+            return item;
+        }
+        template <typename T>
+        T const & access() const
+        {
+            return item->template access<T>();
+        }
+        template <typename T>
+        T const * access_ptr() const
+        {
+            return item->template access_ptr<T>();
+        }
+    };
+
+    basic_atomic_any()
+        : current(new Any())
+    {
+    }
+    template <typename T, typename = std::enable_if_t<!std::is_same_v<std::decay_t<T>, basic_atomic_any>>>
+    basic_atomic_any(T && t)
+        : current(new Any(std::forward<T>(t)))
+    {
+    }
+    basic_atomic_any(basic_atomic_any const &) = delete;
+    basic_atomic_any & operator=(basic_atomic_any const &) = delete;
+
+    // (no one may be reading any more)
+    ~basic_atomic_any()
+    {
+        delete current.load(std::memory_order_relaxed);
+        for (Retired & r : retired)
+            delete r.item;
+    }
+
+    snapshot load() const
+    {
+        atomic_any_detail::pin();
+        return snapshot(current.load(std::memory_order_seq_cst));
+    }
+
+    // replaces the item; the old one is deleted once no reader can see it
+    template <typename T>
+    void store(T && t)
+    {
+        publish(new Any(std::forward<T>(t)));
+    }
+    template <typename T, typename ...Args>
+    void emplace(Args &&... args)
+    {
+        Any * fresh = new Any();
+        try
+        {
+            fresh->template emplace<T>(std::forward<Args>(args)...);
+        }
+        catch (...)
+        {
+            delete fresh;
+            throw;
+        }
+        publish(fresh);
+    }
+
+    // deletes what it can of the replaced items (stores already do this; this is for when stores stop)
+    void reclaim()
+    {
+        std::lock_guard<std::mutex> lock(writers);
+        collect();
+    }
+    // replaced items not deleted yet
+    std::size_t pending() const
+    {
+        std::lock_guard<std::mutex> lock(writers);
+        return retired.size();
+    }
+};
+
+using atomic_any = basic_atomic_any<>;
+
+#endif // _h
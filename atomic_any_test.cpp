@@ -0,0 +1,167 @@
+#include "atomic_any.h"
+#include "alloc_trace.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// link with alloc_trace.cpp
+
+namespace
+{
+    struct Config
+    {
+        static std::atomic<int> alive;
+
+        int a = 0;
+        int b = 0; // always == a, unless someone saw a half-written Config
+        std::string name;
+
+        Config(int v, std::string name = "config")
+            : a(v), b(v), name(std::move(name))
+        {
+            alive++;
+        }
+        Config(Config && other) noexcept
+            : a(other.a), b(other.b), name(std::move(other.name))
+        {
+            alive++;
+        }
+        ~Config()
+        {
+            alive--;
+        }
+    };
+    std::atomic<int> Config::alive{ 0 };
+}
+
+TEST(atomic_any, load_and_store)
+{
+    atomic_any empty;
+    EXPECT_FALSE(empty.load()->has_value());
+
+    atomic_any config = Config(1);
+    EXPECT_EQ(1, config.load().access<Config>().a);
+
+    config.store(Config(2));
+    EXPECT_EQ(2, config.load().access<Config>().a);
+
+    config.emplace<Config>(3, "three");
+    auto snap = config.load();
+    EXPECT_EQ(3, snap.access<Config>().a);
+    EXPECT_EQ("three", snap->access<Config>().name);
+    EXPECT_EQ(nullptr, snap.access_ptr<int>());
+
+    config.store(17);
+    EXPECT_EQ(17, config.load().access<int>());
+}
+
+TEST(atomic_any, old_items_are_deleted_when_no_one_is_reading)
+{
+    {
+        atomic_any config = Config(1);
+        for (int i = 2; i < 10; i++)
+            config.store(Config(i));
+        EXPECT_EQ(0u, config.pending());
+        EXPECT_EQ(1, Config::alive.load());
+    }
+    EXPECT_EQ(0, Config::alive.load());
+}
+
+TEST(atomic_any, snapshots_pin_their_item)
+{
+    {
+        atomic_any config = Config(1);
+        {
+            auto snap = config.load();
+            Config const & c = snap.access<Config>();
+
+            config.store(Config(2));
+            config.store(Config(3));
+            EXPECT_EQ(1, c.a); // still there
+            EXPECT_EQ("config", c.name);
+            EXPECT_EQ(3, config.load().access<Config>().a); // (new loads see the new one)
+            EXPECT_GE(config.pending(), 1u);
+        }
+        config.reclaim();
+        EXPECT_EQ(0u, config.pending());
+        EXPECT_EQ(1, Config::alive.load());
+    }
+    EXPECT_EQ(0, Config::alive.load());
+}
+
+TEST(atomic_any, nested_snapshots)
+{
+    atomic_any a = 1;
+    atomic_any b = 2;
+    {
+        auto outer = a.load();
+        {
+            auto inner = b.load();
+            auto moved = std::move(inner);
+            EXPECT_EQ(2, moved.access<int>());
+        }
+        a.store(10);
+        EXPECT_EQ(1u, a.pending()); // outer is still reading
+        EXPECT_EQ(1, outer.access<int>());
+    }
+    a.reclaim();
+    EXPECT_EQ(0u, a.pending());
+}
+
+TEST(atomic_any, loads_dont_allocate)
+{
+    atomic_any config = Config(1);
+    config.load(); // (first load on a thread sets up its record)
+    auto c = alloc_trace::count([&] {
+        for (int i = 0; i < 100; i++)
+        {
+            auto snap = config.load();
+            EXPECT_EQ(1, snap.access<Config>().a);
+        }
+    });
+    EXPECT_EQ(0u, c.allocations);
+}
+
+TEST(atomic_any, readers_and_writers)
+{
+    {
+        atomic_any config = Config(0);
+        std::atomic<bool> done{ false };
+        std::atomic<int> torn{ 0 };
+
+        std::vector<std::thread> readers;
+        for (int r = 0; r < 4; r++)
+            readers.emplace_back([&] {
+                int last = 0;
+                while (!done.load())
+                {
+                    auto snap = config.load();
+                    Config const & c = snap.access<Config>();
+                    if (c.a != c.b || c.a < last || c.name != "config")
+                        torn++;
+                    last = c.a;
+                }
+            });
+
+        std::thread writer([&] {
+            for (int i = 1; i <= 2000; i++)
+                config.store(Config(i));
+            done = true;
+        });
+
+        writer.join();
+        for (std::thread & t : readers)
+            t.join();
+
+        EXPECT_EQ(0, torn.load());
+        EXPECT_EQ(2000, config.load().access<Config>().a);
+        config.reclaim();
+        EXPECT_EQ(0u, config.pending());
+        EXPECT_EQ(1, Config::alive.load());
+    }
+    EXPECT_EQ(0, Config::alive.load());
+}
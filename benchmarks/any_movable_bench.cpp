@@ -0,0 +1,337 @@
+// any_movable_bench.cpp : what does any_movable cost, compared to std::any, std::variant and std::unique_ptr<Base>?
+//
+// Build it with optimizations (and the repo root on the include path), ie
+//
+//    g++ -std=c++17 -O2 -I.. any_movable_bench.cpp -o any_movable_bench
+//    cl /std:c++17 /O2 /EHsc /I.. any_movable_bench.cpp
+//
+// Output is CSV (or JSON with --json), one row per (operation, implementation), so runs can be diffed between releases:
+//
+//    op,impl,ns_per_op,iterations
+//
+// Options: --json, --min-ms N, --filter TEXT (see bench_common.h)
+//
+// Operations that an implementation can't do (ie std::any has no access_dynamic) are skipped, not faked.
+
+#include "../any_movable.h"
+#include "bench_common.h"
+
+#include <any>
+#include <variant>
+#include <memory>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <type_traits>
+
+//
+// payloads
+//
+struct Base
+{
+    virtual ~Base() = default;
+    virtual int key() const = 0;
+};
+// 16 bytes (with the vptr) - fits in any_movable, but not in libstdc++'s std::any (which only keeps a pointer's worth inline)
+struct Small : Base
+{
+    int x;
+    explicit Small(int x) : x(x) {}
+    int key() const override { return x; }
+};
+// too big for any_movable's inline buffer
+struct Large : Base
+{
+    int x;
+    char pad[252];
+    explicit Large(int x) : x(x) { pad[0] = 0; }
+    int key() const override { return x; }
+};
+// a Small whose bases are not declared, so access_dynamic has to go the slow way (once, then it is cached)
+struct UndeclaredSmall : Base
+{
+    int x;
+    explicit UndeclaredSmall(int x) : x(x) {}
+    int key() const override { return x; }
+};
+struct Unrelated
+{
+    int x;
+};
+
+template <> struct any_movable_bases<Small> { using type = any_bases<Base>; };
+template <> struct any_movable_bases<Large> { using type = any_bases<Base>; };
+
+//
+// each implementation, behind the same little interface
+// dynamic<B>(h) is "get me a B (a base) of whatever is held, or null"
+//
+struct use_any_movable
+{
+    static constexpr char const * name = "any_movable";
+    static constexpr bool has_dynamic = true;
+    using holder = any_movable;
+
+    template <typename T> static holder make(T && t) { return holder(std::forward<T>(t)); }
+    template <typename T> static void assign(holder & h, T && t) { h = std::forward<T>(t); }
+    template <typename T> static bool has(holder const & h) { return h.has_type<T>(); }
+    template <typename T, typename H> static auto & get(H & h) { return h.template access<T>(); }
+    template <typename B> static B * dynamic(holder & h) { return h.access_ptr_dynamic<B>(); }
+    static void reset(holder & h) { h.reset(); }
+};
+
+struct use_std_any
+{
+    static constexpr char const * name = "std::any";
+    static constexpr bool has_dynamic = false;
+    using holder = std::any;
+
+    template <typename T> static holder make(T && t) { return holder(std::forward<T>(t)); }
+    template <typename T> static void assign(holder & h, T && t) { h = std::forward<T>(t); }
+    template <typename T> static bool has(holder const & h) { return h.type() == typeid(T); }
+    template <typename T, typename H> static auto & get(H & h) { return *std::any_cast<T>(&h); }
+    template <typename B> static B * dynamic(holder &) { return nullptr; }
+    static void reset(holder & h) { h.reset(); }
+};
+
+struct use_variant
+{
+    static constexpr char const * name = "std::variant";
+    static constexpr bool has_dynamic = true;
+    using holder = std::variant<std::monostate, Small, Large, UndeclaredSmall>;
+
+    template <typename T> static holder make(T && t) { return holder(std::forward<T>(t)); }
+    template <typename T> static void assign(holder & h, T && t) { h = std::forward<T>(t); }
+    template <typename T> static bool has(holder const & h) { return std::holds_alternative<T>(h); }
+    template <typename T, typename H> static auto & get(H & h) { return *std::get_if<T>(&h); }
+    template <typename B> static B * dynamic(holder & h)
+    {
+        return std::visit([](auto & v) -> B * {
+            if constexpr (std::is_base_of_v<B, std::decay_t<decltype(v)>>)
+                return &v;
+            else
+                return nullptr;
+        }, h);
+    }
+    static void reset(holder & h) { h.template emplace<std::monostate>(); }
+};
+
+struct use_unique_ptr
+{
+    static constexpr char const * name = "unique_ptr<Base>";
+    static constexpr bool has_dynamic = true;
+    using holder = std::unique_ptr<Base>;
+
+    template <typename T> static holder make(T && t) { return std::make_unique<std::decay_t<T>>(std::forward<T>(t)); }
+    template <typename T> static void assign(holder & h, T && t) { h = make(std::forward<T>(t)); }
+    template <typename T> static bool has(holder const & h) { return h && typeid(*h) == typeid(T); }
+    template <typename T, typename H> static auto & get(H & h) { return static_cast<T &>(*h); }
+    template <typename B> static B * dynamic(holder & h) { return dynamic_cast<B *>(h.get()); }
+    static void reset(holder & h) { h.reset(); }
+};
+
+//
+// the benchmarks
+//
+template <typename I, typename Payload>
+void bench_construct(Runner & r, char const * op)
+{
+    r.run(op, I::name, [](std::size_t n) {
+        for (std::size_t i = 0; i < n; i++)
+        {
+            typename I::holder h = I::make(Payload((int)i));
+            do_not_optimize(h);
+        }
+    });
+}
+
+template <typename I, typename Payload>
+void bench_move_construct(Runner & r, char const * op)
+{
+    using H = typename I::holder;
+    r.run(op, I::name, [](std::size_t n) {
+        // ping-pong between two holders, so each op is one move construction (plus destroying the moved-from)
+        H a = I::make(Payload(17));
+        alignas(H) unsigned char buf[sizeof(H)];
+        for (std::size_t i = 0; i < n; i += 2)
+        {
+            H * b = new (buf) H(std::move(a));
+            a.~H();
+            new (&a) H(std::move(*b));
+            b->~H();
+            do_not_optimize(a);
+        }
+    });
+}
+
+template <typename I, typename Payload>
+void bench_move_assign(Runner & r, char const * op)
+{
+    using H = typename I::holder;
+    r.run(op, I::name, [](std::size_t n) {
+        H a = I::make(Payload(17));
+        H b;
+        for (std::size_t i = 0; i < n; i += 2)
+        {
+            b = std::move(a);
+            a = std::move(b);
+            do_not_optimize(a);
+        }
+    });
+}
+
+template <typename I>
+void bench_assign_same_type(Runner & r)
+{
+    r.run("assign_same_type_small", I::name, [](std::size_t n) {
+        typename I::holder h = I::make(Small(0));
+        for (std::size_t i = 0; i < n; i++)
+        {
+            I::assign(h, Small((int)i));
+            do_not_optimize(h);
+        }
+    });
+}
+
+template <typename I>
+void bench_access(Runner & r)
+{
+    r.run("access", I::name, [](std::size_t n) {
+        typename I::holder h = I::make(Small(1));
+        int sum = 0;
+        for (std::size_t i = 0; i < n; i++)
+        {
+            do_not_optimize(h);
+            sum += I::template get<Small>(h).x;
+        }
+        do_not_optimize(sum);
+    });
+}
+
+template <typename I>
+void bench_has_type(Runner & r)
+{
+    r.run("has_type", I::name, [](std::size_t n) {
+        typename I::holder h = I::make(Small(1));
+        int hits = 0;
+        for (std::size_t i = 0; i < n; i++)
+        {
+            do_not_optimize(h);
+            hits += I::template has<Small>(h) + I::template has<Large>(h);
+        }
+        do_not_optimize(hits);
+    });
+}
+
+template <typename I, typename Payload, typename Target>
+void bench_dynamic(Runner & r, char const * op)
+{
+    if constexpr (I::has_dynamic)
+    {
+        r.run(op, I::name, [](std::size_t n) {
+            typename I::holder h = I::make(Payload(1));
+            int found = 0;
+            for (std::size_t i = 0; i < n; i++)
+            {
+                do_not_optimize(h);
+                found += I::template dynamic<Target>(h) != nullptr;
+            }
+            do_not_optimize(found);
+        });
+    }
+}
+
+template <typename I>
+void bench_reset(Runner & r)
+{
+    r.run_timed("reset_small", I::name, [](std::size_t n) {
+        // construction is not part of it
+        std::vector<typename I::holder> v;
+        v.reserve(n);
+        for (std::size_t i = 0; i < n; i++)
+            v.push_back(I::make(Small((int)i)));
+        auto start = std::chrono::steady_clock::now();
+        for (auto & h : v)
+            I::reset(h);
+        auto t = std::chrono::steady_clock::now() - start;
+        do_not_optimize(v);
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(t);
+    });
+}
+
+template <typename I>
+void bench_vector_growth(Runner & r)
+{
+    // no reserve(), so this is mostly about how the vector moves things when it grows
+    r.run("vector_push_back_small", I::name, [](std::size_t n) {
+        std::vector<typename I::holder> v;
+        for (std::size_t i = 0; i < n; i++)
+            v.push_back(I::make(Small((int)i)));
+        do_not_optimize(v);
+    });
+}
+
+template <typename I>
+void bench_vector_sort(Runner & r)
+{
+    // per element, sorting 1000 at a time; refilling the keys is not part of it
+    constexpr std::size_t batch = 1000;
+    r.run_timed("vector_sort_small", I::name, [](std::size_t n) {
+        std::vector<typename I::holder> v;
+        for (std::size_t i = 0; i < batch; i++)
+            v.push_back(I::make(Small(0)));
+        std::chrono::nanoseconds t{ 0 };
+        unsigned key = 12345;
+        for (std::size_t done = 0; done < n; done += batch)
+        {
+            for (auto & h : v)
+            {
+                key = key * 1103515245 + 12345;
+                I::template get<Small>(h).x = (int)(key >> 8);
+            }
+            auto start = std::chrono::steady_clock::now();
+            std::sort(v.begin(), v.end(), [](auto const & a, auto const & b) {
+                return I::template get<Small>(a).x < I::template get<Small>(b).x;
+            });
+            t += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        }
+        do_not_optimize(v);
+        return t;
+    });
+}
+
+template <typename I>
+void bench_all(Runner & r)
+{
+    bench_construct<I, Small>(r, "construct_small");
+    bench_construct<I, Large>(r, "construct_large");
+    bench_move_construct<I, Small>(r, "move_construct_small");
+    bench_move_construct<I, Large>(r, "move_construct_large");
+    bench_move_assign<I, Small>(r, "move_assign_small");
+    bench_move_assign<I, Large>(r, "move_assign_large");
+    bench_assign_same_type<I>(r);
+    bench_access<I>(r);
+    bench_has_type<I>(r);
+    bench_dynamic<I, Small, Base>(r, "access_dynamic_hit");
+    bench_dynamic<I, Small, Unrelated>(r, "access_dynamic_miss");
+    bench_dynamic<I, UndeclaredSmall, Base>(r, "access_dynamic_undeclared_hit");
+    bench_reset<I>(r);
+    bench_vector_growth<I>(r);
+    bench_vector_sort<I>(r);
+}
+
+int main(int argc, char * argv[])
+{
+    BenchOptions o;
+    if (!parse_options(argc, argv, o))
+        return 1;
+
+    Runner r(o);
+    bench_all<use_any_movable>(r);
+    bench_all<use_std_any>(r);
+    bench_all<use_variant>(r);
+    bench_all<use_unique_ptr>(r);
+    r.print(o.json);
+    return 0;
+}
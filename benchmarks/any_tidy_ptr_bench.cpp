@@ -0,0 +1,239 @@
+// any_tidy_ptr_bench.cpp : what does any_tidy_ptr's type-erased deleter cost, compared to unique_ptr and shared_ptr?
+//
+// Build it with optimizations (and the repo root on the include path), linking alloc_trace.cpp (which counts the heap allocations), ie
+//
+//    g++ -std=c++17 -O2 -I.. any_tidy_ptr_bench.cpp ../alloc_trace.cpp -o any_tidy_ptr_bench
+//    cl /std:c++17 /O2 /EHsc /I.. any_tidy_ptr_bench.cpp ../alloc_trace.cpp
+//
+// Output is CSV (or JSON with --json): first the sizes,
+//
+//    impl,sizeof
+//
+// then one row per (operation, implementation):
+//
+//    op,impl,ns_per_op,allocs_per_op,iterations
+//
+// Options: --json, --min-ms N, --filter TEXT (see bench_common.h)
+//
+// Each op runs on a vector of n pointers, built (or torn down) outside the timing:
+//    construct    make n pointers (including the new T, for the owning ones)
+//    destroy      destroy n pointers (including the delete, for the owning ones)
+//    reset        reset() n pointers
+//    move         move-construct (ping-pong), including destroying the moved-from
+//    move_assign  move-assign back and forth
+// allocs_per_op counts the heap allocations (by this thread) in the timed part, per op.
+// (alloc_trace's operator new does a little counting itself, so allocating ops are a bit slower than they'd otherwise be - for all impls.)
+
+#include "../any_tidy_ptr.h"
+#include "../alloc_trace.h"
+#include "bench_common.h"
+
+#include <memory>
+#include <functional>
+#include <vector>
+#include <chrono>
+
+//
+// the pointee
+//
+struct Pixels
+{
+    int x = 0;
+};
+
+Pixels notOwned;                                                   // for the nullptr (don't delete) deleter
+std::shared_ptr<Pixels> const sharedPixels = std::make_shared<Pixels>(); // for the shared_ptr ones
+int deletes = 0;                                                    // for the capturing lambda
+
+//
+// each implementation: its holder type, and how to make one
+//
+struct use_unique_ptr
+{
+    static constexpr char const * name = "unique_ptr<T>";
+    using holder = std::unique_ptr<Pixels>;
+    static holder make() { return holder(new Pixels); }
+};
+
+// what any_tidy_ptr used to be
+struct use_unique_ptr_function
+{
+    static constexpr char const * name = "unique_ptr<T-std::function>";
+    using holder = std::unique_ptr<Pixels, std::function<void(Pixels *)>>;
+    static holder make() { return holder(new Pixels, std::default_delete<Pixels>()); }
+};
+
+struct use_shared_ptr_make
+{
+    static constexpr char const * name = "shared_ptr<T>(make_shared)";
+    using holder = std::shared_ptr<Pixels>;
+    static holder make() { return std::make_shared<Pixels>(); }
+};
+
+struct use_shared_ptr_copy
+{
+    static constexpr char const * name = "shared_ptr<T>(copy)";
+    using holder = std::shared_ptr<Pixels>;
+    static holder make() { return sharedPixels; }
+};
+
+struct use_tidy_default
+{
+    static constexpr char const * name = "any_tidy_ptr(default)";
+    using holder = any_tidy_ptr<Pixels>;
+    static holder make() { return holder(new Pixels); }
+};
+
+struct use_tidy_nullptr
+{
+    static constexpr char const * name = "any_tidy_ptr(nullptr)";
+    using holder = any_tidy_ptr<Pixels>;
+    static holder make() { return holder(&notOwned, nullptr); }
+};
+
+struct use_tidy_lambda
+{
+    static constexpr char const * name = "any_tidy_ptr(lambda)";
+    using holder = any_tidy_ptr<Pixels>;
+    static holder make()
+    {
+        int * counter = &deletes;
+        return holder(new Pixels, [counter](Pixels * p) { ++*counter; delete p; });
+    }
+};
+
+struct use_tidy_shared
+{
+    static constexpr char const * name = "any_tidy_ptr(shared_ptr)";
+    using holder = any_tidy_ptr<Pixels>;
+    static holder make() { return holder(sharedPixels); }
+};
+
+// times (and counts the allocations of) just op
+template <typename Op>
+Measurement measure(Op && op)
+{
+    alloc_trace::scope allocs;
+    auto start = std::chrono::steady_clock::now();
+    op();
+    auto t = std::chrono::steady_clock::now() - start;
+    return Measurement{ std::chrono::duration_cast<std::chrono::nanoseconds>(t), allocs.so_far().allocations };
+}
+
+//
+// the benchmarks
+//
+template <typename I>
+void bench_construct(Runner & r)
+{
+    r.run_measured("construct", I::name, [](std::size_t n) {
+        std::vector<typename I::holder> v;
+        v.reserve(n);
+        Measurement m = measure([&] {
+            for (std::size_t i = 0; i < n; i++)
+                v.push_back(I::make());
+        });
+        do_not_optimize(v);
+        return m;
+    });
+}
+
+template <typename I>
+void bench_destroy(Runner & r)
+{
+    r.run_measured("destroy", I::name, [](std::size_t n) {
+        std::vector<typename I::holder> v;
+        v.reserve(n);
+        for (std::size_t i = 0; i < n; i++)
+            v.push_back(I::make());
+        Measurement m = measure([&] { v.clear(); }); // (clear keeps the vector's memory)
+        do_not_optimize(v);
+        return m;
+    });
+}
+
+template <typename I>
+void bench_reset(Runner & r)
+{
+    r.run_measured("reset", I::name, [](std::size_t n) {
+        std::vector<typename I::holder> v;
+        v.reserve(n);
+        for (std::size_t i = 0; i < n; i++)
+            v.push_back(I::make());
+        Measurement m = measure([&] {
+            for (auto & h : v)
+                h.reset();
+        });
+        do_not_optimize(v);
+        return m;
+    });
+}
+
+template <typename I>
+void bench_move(Runner & r)
+{
+    using H = typename I::holder;
+    r.run_measured("move", I::name, [](std::size_t n) {
+        // ping-pong between two holders, so each op is one move construction (plus destroying the moved-from)
+        H a = I::make();
+        alignas(H) unsigned char buf[sizeof(H)];
+        return measure([&] {
+            for (std::size_t i = 0; i < n; i += 2)
+            {
+                H * b = new (buf) H(std::move(a));
+                a.~H();
+                new (&a) H(std::move(*b));
+                b->~H();
+                do_not_optimize(a);
+            }
+        });
+    });
+}
+
+template <typename I>
+void bench_move_assign(Runner & r)
+{
+    using H = typename I::holder;
+    r.run_measured("move_assign", I::name, [](std::size_t n) {
+        H a = I::make();
+        H b;
+        return measure([&] {
+            for (std::size_t i = 0; i < n; i += 2)
+            {
+                b = std::move(a);
+                a = std::move(b);
+                do_not_optimize(a);
+            }
+        });
+    });
+}
+
+template <typename I>
+void bench_all(Runner & r)
+{
+    r.add_size(I::name, sizeof(typename I::holder));
+    bench_construct<I>(r);
+    bench_destroy<I>(r);
+    bench_reset<I>(r);
+    bench_move<I>(r);
+    bench_move_assign<I>(r);
+}
+
+int main(int argc, char * argv[])
+{
+    BenchOptions o;
+    if (!parse_options(argc, argv, o))
+        return 1;
+
+    Runner r(o, std::size_t(1) << 26); // (each op needs a pointer's worth of vector)
+    bench_all<use_unique_ptr>(r);
+    bench_all<use_unique_ptr_function>(r);
+    bench_all<use_shared_ptr_make>(r);
+    bench_all<use_shared_ptr_copy>(r);
+    bench_all<use_tidy_default>(r);
+    bench_all<use_tidy_nullptr>(r);
+    bench_all<use_tidy_lambda>(r);
+    bench_all<use_tidy_shared>(r);
+    r.print(o.json);
+    return 0;
+}
@@ -0,0 +1,221 @@
+#ifndef bench_common_h_INCLUDED
+#define bench_common_h_INCLUDED
+
+//
+// What the benchmarks have in common: do_not_optimize, the Runner (which picks n, times, and prints CSV or JSON)
+// and the command line.
+//
+// Options:
+//    --json            JSON instead of CSV
+//    --min-ms N        run each benchmark for at least N milliseconds (default 50)
+//    --filter TEXT     only run ops whose name contains TEXT
+//
+// CSV is one row per (operation, implementation) - with an allocs_per_op column if the benchmark counts allocations,
+// and preceded by an impl,sizeof table if it adds sizes:
+//
+//    op,impl,ns_per_op,iterations
+//    op,impl,ns_per_op,allocs_per_op,iterations
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+//
+// keep the optimizer from throwing away what we are measuring
+//
+template <typename T>
+inline void do_not_optimize(T const & value)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    static void const * volatile sink;
+    sink = &value;
+    _ReadWriteBarrier();
+#else
+    asm volatile("" : : "r"(&value) : "memory");
+#endif
+}
+
+//
+// the command line
+//
+struct BenchOptions
+{
+    bool json = false;
+    long minMs = 50;
+    std::string filter;
+};
+
+// false (after printing the usage) if there's something it doesn't understand
+inline bool parse_options(int argc, char * argv[], BenchOptions & o)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (!std::strcmp(argv[i], "--json"))
+            o.json = true;
+        else if (!std::strcmp(argv[i], "--min-ms") && i + 1 < argc)
+            o.minMs = std::atol(argv[++i]);
+        else if (!std::strcmp(argv[i], "--filter") && i + 1 < argc)
+            o.filter = argv[++i];
+        else
+        {
+            std::fprintf(stderr, "usage: %s [--json] [--min-ms N] [--filter TEXT]\n", argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+//
+// the runner
+//
+constexpr std::size_t not_counted = std::size_t(-1);
+
+struct Measurement
+{
+    std::chrono::nanoseconds time;
+    std::size_t allocations = not_counted;
+};
+
+struct Result
+{
+    std::string op;
+    std::string impl;
+    double ns_per_op;
+    double allocs_per_op; // (negative if not counted)
+    std::size_t iterations;
+};
+
+class Runner
+{
+    std::chrono::nanoseconds minTime;
+    std::string filter;
+    std::size_t maxN;
+    std::vector<Result> results;
+    std::vector<std::pair<std::string, std::size_t>> sizes;
+    bool countsAllocations = false;
+
+public:
+    // (maxN: for benchmarks that need memory for each of the n ops)
+    explicit Runner(BenchOptions const & o, std::size_t maxN = std::size_t(1) << 30)
+        : minTime(std::chrono::milliseconds(o.minMs)), filter(o.filter), maxN(maxN)
+    {
+    }
+
+    bool wants(char const * op) const
+    {
+        return filter.empty() || std::strstr(op, filter.c_str());
+    }
+
+    void add_size(char const * impl, std::size_t size)
+    {
+        for (auto const & s : sizes)
+            if (s.first == impl)
+                return;
+        sizes.emplace_back(impl, size);
+    }
+
+    // f(n) does n ops and returns the time taken, and allocations made (so it can leave setup out of it)
+    template <typename F>
+    void run_measured(char const * op, char const * impl, F && f)
+    {
+        if (!wants(op))
+            return;
+        // grow n until one run takes long enough to measure, then take the best of 3
+        std::size_t n = 64;
+        Measurement m = f(n);
+        while (m.time < minTime && n < maxN)
+        {
+            n *= 2;
+            m = f(n);
+        }
+        for (int rep = 0; rep < 2; rep++)
+        {
+            Measurement again = f(n);
+            m.time = std::min(m.time, again.time);
+        }
+        double allocs = -1;
+        if (m.allocations != not_counted)
+        {
+            allocs = double(m.allocations) / double(n);
+            countsAllocations = true;
+        }
+        results.push_back(Result{ op, impl, double(m.time.count()) / double(n), allocs, n });
+    }
+
+    // f(n) does n ops and returns the time taken (so it can leave setup out of it)
+    template <typename F>
+    void run_timed(char const * op, char const * impl, F && f)
+    {
+        run_measured(op, impl, [&f](std::size_t n) { return Measurement{ f(n) }; });
+    }
+
+    // f(n) does n ops, and all of it is timed
+    template <typename F>
+    void run(char const * op, char const * impl, F && f)
+    {
+        run_timed(op, impl, [&f](std::size_t n) {
+            auto start = std::chrono::steady_clock::now();
+            f(n);
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+        });
+    }
+
+    void print(bool json) const
+    {
+        if (json)
+        {
+            // (just the results array, unless there are sizes too)
+            char const * indent = sizes.empty() ? "  " : "    ";
+            if (!sizes.empty())
+            {
+                std::printf("{\n  \"sizes\": [\n");
+                for (std::size_t i = 0; i < sizes.size(); i++)
+                    std::printf("    {\"impl\": \"%s\", \"sizeof\": %zu}%s\n",
+                        sizes[i].first.c_str(), sizes[i].second, i + 1 < sizes.size() ? "," : "");
+                std::printf("  ],\n  \"results\": [\n");
+            }
+            else
+                std::printf("[\n");
+            for (std::size_t i = 0; i < results.size(); i++)
+            {
+                Result const & r = results[i];
+                std::printf("%s{\"op\": \"%s\", \"impl\": \"%s\", \"ns_per_op\": %.3f, ", indent, r.op.c_str(), r.impl.c_str(), r.ns_per_op);
+                if (countsAllocations)
+                    std::printf("\"allocs_per_op\": %.3f, ", r.allocs_per_op);
+                std::printf("\"iterations\": %zu}%s\n", r.iterations, i + 1 < results.size() ? "," : "");
+            }
+            std::printf(sizes.empty() ? "]\n" : "  ]\n}\n");
+        }
+        else
+        {
+            if (!sizes.empty())
+            {
+                std::printf("impl,sizeof\n");
+                for (auto const & s : sizes)
+                    std::printf("%s,%zu\n", s.first.c_str(), s.second);
+                std::printf("\n");
+            }
+            std::printf(countsAllocations ? "op,impl,ns_per_op,allocs_per_op,iterations\n" : "op,impl,ns_per_op,iterations\n");
+            for (Result const & r : results)
+            {
+                std::printf("%s,%s,%.3f,", r.op.c_str(), r.impl.c_str(), r.ns_per_op);
+                if (countsAllocations)
+                    std::printf("%.3f,", r.allocs_per_op);
+                std::printf("%zu\n", r.iterations);
+            }
+        }
+    }
+};
+
+#endif // _h
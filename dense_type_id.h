@@ -0,0 +1,35 @@
+#ifndef dense_type_id_h_INCLUDED
+#define dense_type_id_h_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+
+//
+// A small integer per type - 0, 1, 2, ... in order of first use - for containers that keep a slot per type in an array
+// (so finding a type's slot is an index, not a hash or a search):
+//
+//    std::size_t i = dense_type_id<my_container_ids, T>();
+//
+// Each Tag gets its own run of ids, so the types one container sees don't make another container's arrays longer.
+//
+// (The ids are per "program image" - if a type is used from more than one DLL/.so, each might give it its own id.
+// That just costs a slot, since different ids are different slots.)
+//
+namespace dense_type_id_detail
+{
+    template <typename Tag>
+    std::size_t next()
+    {
+        static std::atomic<std::size_t> next{ 0 };
+        return next.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+template <typename Tag, typename T>
+std::size_t dense_type_id()
+{
+    static std::size_t const id = dense_type_id_detail::next<Tag>();
+    return id;
+}
+
+#endif // _h
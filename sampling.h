@@ -4,11 +4,168 @@
 #include <iterator> // std::distance
 #include <random> // uniform_int_distribution
 #include <algorithm> // for_each (is it worth an include just for that?)
+#include <cmath> // exp, log
+#include <type_traits>
+
+namespace sampling_detail
+{
+    // uniform in (0,1) - never 0, because we take logs of it
+    template <typename UniformRandomNumberGenerator>
+    double open_unit(UniformRandomNumberGenerator & urng)
+    {
+        std::uniform_real_distribution<double> dist(0.0, 1.0);
+        double u;
+        do
+            u = dist(urng);
+        while (u <= 0.0 || u >= 1.0);
+        return u;
+    }
+
+    // Vitter's "Method A" (Vitter 1987, "An Efficient Algorithm for Sequential Random Sampling")
+    // Instead of a random number per item, draw one per *selected* item, and walk along until the odds say we've skipped enough:
+    // the chance of skipping more than s items is a product of (left - need)/left style terms, so multiply them up until they drop below u.
+    // Still O(left) steps (cheap ones), but only O(need) random numbers. Good when need is a big fraction of left.
+    template <typename Iterator, typename DistType, typename UniformRandomNumberGenerator, typename Output>
+    void method_a(Iterator curr, DistType left, DistType need, UniformRandomNumberGenerator & urng, Output const & out)
+    {
+        double top = double(left - need);
+        double leftReal = double(left);
+        while (need >= 2)
+        {
+            double u = open_unit(urng);
+            DistType skip = 0;
+            double quot = top / leftReal;
+            while (quot > u)
+            {
+                skip++;
+                top -= 1.0;
+                leftReal -= 1.0;
+                quot = (quot * top) / leftReal;
+            }
+            curr += skip;
+            out(*curr);
+            ++curr;
+            leftReal -= 1.0;
+            left -= skip + 1;
+            --need;
+        }
+        // the last one is just uniform over what's left
+        DistType skip = std::min(DistType(double(left) * open_unit(urng)), left - 1);
+        curr += skip;
+        out(*curr);
+    }
+
+    // Vitter's "Method D": jump straight to the next winner.
+    // The skip (how many items lose before the next winner) has a known distribution;
+    // D draws it by rejection - a cheap continuous guess, a cheap "squeeze" test that almost always accepts,
+    // and only rarely the exact (O(skip)) test. So O(need) random numbers and O(need) time, however big left is -
+    // k=1000 out of 100M is ~1000 jumps, not 100M coin tosses.
+    // (Straight from the paper, names and all, which is why it reads like Pascal.)
+    // When need gets to be more than 1/13 of left, method A is faster, so we switch.
+    template <typename Iterator, typename DistType, typename UniformRandomNumberGenerator, typename Output>
+    void method_d(Iterator curr, DistType left, DistType need, UniformRandomNumberGenerator & urng, Output const & out)
+    {
+        constexpr DistType alphaInv = 13;
+
+        double needReal = double(need);
+        double leftReal = double(left);
+        double needInv = 1.0 / needReal;
+        double vPrime = std::exp(std::log(open_unit(urng)) * needInv);
+        DistType qu1 = left - need + 1;
+        double qu1Real = leftReal - needReal + 1.0;
+        DistType threshold = alphaInv * need;
+
+        while (need > 1 && threshold < left)
+        {
+            double needMin1Inv = 1.0 / (needReal - 1.0);
+            DistType skip;
+            for (;;)
+            {
+                double x;
+                // D2: a guess at skip, from a continuous approximation (must be < qu1 to be possible at all)
+                for (;;)
+                {
+                    x = leftReal * (1.0 - vPrime);
+                    skip = DistType(x);
+                    if (skip < qu1)
+                        break;
+                    vPrime = std::exp(std::log(open_unit(urng)) * needInv);
+                }
+                // D3: the squeeze test
+                double u = open_unit(urng);
+                double negSkip = -double(skip);
+                double y1 = std::exp(std::log(u * leftReal / qu1Real) * needMin1Inv);
+                vPrime = y1 * (1.0 - x / leftReal) * (qu1Real / (negSkip + qu1Real));
+                if (vPrime <= 1.0)
+                    break; // accepted (the usual case)
+
+                // D4: the exact test
+                double y2 = 1.0;
+                double top = leftReal - 1.0;
+                double bottom;
+                DistType limit;
+                if (need - 1 > skip)
+                {
+                    bottom = leftReal - needReal;
+                    limit = left - skip;
+                }
+                else
+                {
+                    bottom = leftReal + negSkip - 1.0;
+                    limit = qu1;
+                }
+                for (DistType t = left - 1; t >= limit; t--)
+                {
+                    y2 = (y2 * top) / bottom;
+                    top -= 1.0;
+                    bottom -= 1.0;
+                }
+                if (leftReal / (leftReal - x) >= y1 * std::exp(std::log(y2) * needMin1Inv))
+                {
+                    vPrime = std::exp(std::log(open_unit(urng)) * needMin1Inv);
+                    break; // accepted
+                }
+                // rejected, try again
+                vPrime = std::exp(std::log(open_unit(urng)) * needInv);
+            }
+
+            // D5: skip the losers, take the winner
+            curr += skip;
+            out(*curr);
+            ++curr;
+
+            left -= skip + 1;
+            leftReal = double(left);
+            --need;
+            needReal -= 1.0;
+            needInv = needMin1Inv;
+            qu1 -= skip;
+            qu1Real -= double(skip);
+            threshold -= alphaInv;
+        }
+
+        if (need > 1)
+        {
+            method_a(curr, left, need, urng, out);
+        }
+        else
+        {
+            // vPrime is already the right random number for the last one
+            DistType skip = std::min(DistType(leftReal * vPrime), left - 1);
+            curr += skip;
+            out(*curr);
+        }
+    }
+}
 
 // like "Reservoir sampling", without the reservoir
 // because we want an out() function, not a fixed place to put things.
 // similar to std::sample() coming in C++17
 // Note that this maintains the order of the selected samples, thus "stable"_sample
+//
+// For random-access iterators, instead of a random number for every item, we jump from winner to winner (Vitter's Method D, above),
+// so it costs O(sampleSize) random numbers (and time), not O(distance(begin, end)).
+// The other iterators get the per-item loop below (which has to step through every item anyhow).
 template <typename Iterator, typename Sentinel, typename UniformRandomNumberGenerator, typename Output>
 void stable_sample(Iterator begin, Sentinel end, int sampleSize, UniformRandomNumberGenerator& urng, Output const & out)
 {
@@ -16,6 +173,18 @@ void stable_sample(Iterator begin, Sentinel end, int sampleSize, UniformRandomNu
     using DistType = decltype(left);
     DistType need = sampleSize; // how many do we still need
 
+    if constexpr (std::is_base_of_v<std::random_access_iterator_tag, typename std::iterator_traits<Iterator>::iterator_category>)
+    {
+        if (need <= 0)
+            return;
+        if (left <= need) {
+            std::for_each(begin, end, out);
+            return;
+        }
+        sampling_detail::method_d(begin, left, need, urng, out);
+        return;
+    }
+
     // Each item, in order, gets to pick for a "winning ticket"
     // the odds of each pick is based on how many we still need, and how many items are left.
     // So imagine 100 items, and we want 10 of them at random...
@@ -249,3 +249,84 @@ TEST(sampleTest, downsampleVector)
     } while (!allTrue(found) && count < 50);
     EXPECT_GT(50, count); // expect it didn't take 50 tries to see all numbers
 }
+
+// counts how many random numbers get drawn
+struct CountingUrng
+{
+    std::mt19937 gen;
+    long long calls = 0;
+
+    using result_type = std::mt19937::result_type;
+    static constexpr result_type min() { return std::mt19937::min(); }
+    static constexpr result_type max() { return std::mt19937::max(); }
+    result_type operator()() { calls++; return gen(); }
+};
+
+TEST(sampleTest, randomAccessEdgeCases)
+{
+    std::vector<int> pop(5, 9); // five 9s
+    std::mt19937 urng;
+
+    for (int sampleSize : { -17, 0, 1, 3, 5, 99 })
+    {
+        int calls = 0;
+        stable_sample(pop.begin(), pop.end(), sampleSize, urng, [&calls](int) {calls++; });
+        EXPECT_EQ(std::max(0, std::min(sampleSize, 5)), calls);
+    }
+
+    std::vector<int> none;
+    int calls = 0;
+    stable_sample(none.begin(), none.end(), 3, urng, [&calls](int) {calls++; });
+    EXPECT_EQ(0, calls);
+}
+
+TEST(sampleTest, randomAccessFewDraws)
+{
+    // 100 out of a million: the per-item loop would draw a million random numbers
+    std::vector<int> pop;
+    fillNumbersTo(pop, 1000000);
+
+    CountingUrng urng;
+    std::vector<int> res;
+    stable_sample(pop.begin(), pop.end(), 100, urng, [&res](int sel) { res.push_back(sel); });
+
+    EXPECT_EQ(100, res.size());
+    EXPECT_TRUE(std::is_sorted(res.begin(), res.end()));
+    EXPECT_TRUE(std::adjacent_find(res.begin(), res.end()) == res.end()); // no duplicates
+    // a few doubles per sample (and each double is 2 calls of a 32 bit generator)
+    EXPECT_LT(urng.calls, 100 * 20);
+}
+
+// each item should be picked sampleSize/size of the time, give or take
+// (pop.size() / sampleSize > 13 is mostly Method D, less is Method A)
+void expectUniform(int popSize, int sampleSize, int runs)
+{
+    std::vector<int> pop;
+    fillNumbersTo(pop, popSize);
+
+    std::random_device rd;
+    std::mt19937 urng(rd());
+
+    std::vector<int> counters(popSize);
+    for (int run = 0; run < runs; run++)
+    {
+        int prev = -1;
+        stable_sample(pop.begin(), pop.end(), sampleSize, urng, [&counters, &prev](int x) {
+            EXPECT_LT(prev, x); // in order
+            prev = x;
+            counters[x]++;
+        });
+    }
+
+    const int EXPECTED_COUNT = runs * sampleSize / popSize;
+    const int ALLOWED_DELTA = EXPECTED_COUNT / 10;
+    for (int i = 0; i < popSize; i++)
+        EXPECT_NEAR(EXPECTED_COUNT, counters[i], ALLOWED_DELTA) << "item " << i << " of " << popSize << ", choosing " << sampleSize;
+}
+
+TEST(sampleTest, randomAccessActuallyRandom)
+{
+    expectUniform(100, 5, 40000);   // Method D, till the end
+    expectUniform(100, 20, 10000);  // Method A
+    expectUniform(1000, 50, 40000); // D, switching to A once more than 1/13th of what is left is needed
+}
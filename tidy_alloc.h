@@ -0,0 +1,316 @@
+#ifndef tidy_alloc_h_INCLUDED
+#define tidy_alloc_h_INCLUDED
+
+#include "any_tidy_ptr.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio> // reading /proc/self/smaps
+#include <cstring> // memset
+#include <memory> // uninitialized_value_construct_n, destroy_n
+#include <new> // align_val_t, bad_alloc
+#include <stdexcept> // invalid_argument
+#include <type_traits>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+//
+// Factories for buffers that need special memory - SIMD-aligned, huge pages, local to this thread's NUMA node -
+// that come back as plain any_tidy_ptr<T[]>s, with the matching deleter already inside (no hand-written free/munmap lambdas):
+//
+//    tidy_allocation<float> a = tidy_aligned<float>(n, 64);
+//    tidy_allocation<Pixel> h = tidy_huge_pages<Pixel>(w * h);
+//    if (h.backing != tidy_backing::huge_pages) log("no hugetlb pages, got ", to_string(h.backing));
+//
+// Huge pages are best effort - explicit huge pages (MAP_HUGETLB) if the system has any reserved,
+// otherwise a normal (2 MiB aligned) mapping with transparent huge pages requested (MADV_HUGEPAGE), otherwise normal pages -
+// and backing says which was obtained (so TLB-miss savings can be measured, not guessed).
+// The kernel only hands out transparent huge pages when the memory is faulted in, so until then all that is known is
+// that they were requested; tidy_first_touch faults it in, and then checks (in /proc/self/smaps) what it got.
+// tidy_first_touch also writes to every page from the calling thread, which (with Linux's default "first touch" policy)
+// puts the memory on the calling thread's NUMA node - so call it from the thread that will use the memory.
+//
+// The Ts are value-initialized (ie zeroed, for ints/floats; for trivial types in fresh mappings that costs nothing,
+// since new pages are already zero).
+// Each deleter captures at most two words, so fits in tidy_deleter without allocating.
+// Failure to get any memory at all throws std::bad_alloc.
+//
+enum class tidy_backing
+{
+    heap,                       // operator new (aligned)
+    huge_pages,                 // explicit huge pages (MAP_HUGETLB / MEM_LARGE_PAGES)
+    transparent_huge,           // a normal mapping, that (once touched) turned out to be on transparent huge pages
+    transparent_huge_requested, // a normal mapping, with transparent huge pages requested (the kernel gives them when it can)
+    pages,                      // a normal mapping
+};
+
+inline char const * to_string(tidy_backing b)
+{
+    switch (b)
+    {
+    case tidy_backing::heap: return "heap";
+    case tidy_backing::huge_pages: return "huge_pages";
+    case tidy_backing::transparent_huge: return "transparent_huge";
+    case tidy_backing::transparent_huge_requested: return "transparent_huge_requested";
+    case tidy_backing::pages: return "pages";
+    }
+    return "?";
+}
+
+template <typename T>
+struct tidy_allocation
+{
+    any_tidy_ptr<T[]> data;
+    std::size_t size = 0;  // in Ts
+    std::size_t bytes = 0; // actually reserved (ie rounded up to whole pages)
+    tidy_backing backing = tidy_backing::heap;
+    bool first_touched = false; // every page was written by the allocating thread
+};
+
+namespace tidy_alloc_detail
+{
+    constexpr std::size_t huge_page_size = std::size_t(2) << 20;
+
+    inline std::size_t round_up(std::size_t n, std::size_t to)
+    {
+        return (n + to - 1) / to * to;
+    }
+
+    inline std::size_t page_size()
+    {
+#if defined(_WIN32)
+        SYSTEM_INFO info;
+        ::GetSystemInfo(&info);
+        return info.dwPageSize;
+#else
+        static std::size_t const size = (std::size_t)::sysconf(_SC_PAGESIZE);
+        return size;
+#endif
+    }
+
+    struct Mapping
+    {
+        void * p = nullptr;
+        std::size_t bytes = 0;
+        tidy_backing backing = tidy_backing::pages;
+    };
+
+    inline Mapping map(std::size_t bytes, bool huge)
+    {
+        Mapping m;
+#if defined(_WIN32)
+        if (huge)
+        {
+            if (std::size_t large = ::GetLargePageMinimum())
+            {
+                m.bytes = round_up(bytes, large);
+                m.p = ::VirtualAlloc(nullptr, m.bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+                if (m.p)
+                {
+                    m.backing = tidy_backing::huge_pages;
+                    return m;
+                }
+            }
+        }
+        m.bytes = round_up(bytes, page_size());
+        m.p = ::VirtualAlloc(nullptr, m.bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (!m.p)
+            throw std::bad_alloc();
+        m.backing = tidy_backing::pages;
+#else
+#if defined(MAP_HUGETLB)
+        if (huge)
+        {
+            m.bytes = round_up(bytes, huge_page_size);
+            m.p = ::mmap(nullptr, m.bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (m.p != MAP_FAILED)
+            {
+                m.backing = tidy_backing::huge_pages;
+                return m;
+            }
+        }
+#endif
+        // (for THP, a whole number of huge pages, starting on a huge page boundary, so the kernel can use them all the way through -
+        // mmap only promises page alignment, so map a huge page extra and trim off what is either side of the aligned part)
+        m.bytes = round_up(bytes, huge ? huge_page_size : page_size());
+        std::size_t const extra = huge ? huge_page_size : 0;
+        void * raw = ::mmap(nullptr, m.bytes + extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED)
+            throw std::bad_alloc();
+        m.p = raw;
+        if (extra)
+        {
+            std::uintptr_t const start = reinterpret_cast<std::uintptr_t>(raw);
+            std::size_t const head = round_up(start, huge_page_size) - start;
+            m.p = static_cast<char *>(raw) + head;
+            if (head)
+                ::munmap(raw, head);
+            if (extra - head)
+                ::munmap(static_cast<char *>(m.p) + m.bytes, extra - head);
+        }
+        m.backing = tidy_backing::pages;
+#if defined(MADV_HUGEPAGE)
+        if (huge && ::madvise(m.p, m.bytes, MADV_HUGEPAGE) == 0)
+            m.backing = tidy_backing::transparent_huge_requested;
+#endif
+#endif
+        return m;
+    }
+
+    // how many bytes of the mapping containing p are on transparent huge pages, or -1 if that can't be found out
+    // (the kernel can merge neighbouring mappings with the same flags into one, so this can include some of theirs)
+    inline std::size_t anon_huge_bytes(void const * p)
+    {
+#if defined(__linux__)
+        std::FILE * f = std::fopen("/proc/self/smaps", "r");
+        if (!f)
+            return std::size_t(-1);
+        unsigned long long const at = reinterpret_cast<std::uintptr_t>(p);
+        std::size_t kb = std::size_t(-1);
+        bool in = false;
+        char line[512];
+        while (std::fgets(line, sizeof line, f))
+        {
+            unsigned long long start, end;
+            if (std::sscanf(line, "%llx-%llx ", &start, &end) == 2) // (the first line of each mapping)
+            {
+                if (in)
+                    break;
+                in = start <= at && at < end;
+            }
+            else if (in && std::sscanf(line, "AnonHugePages: %zu kB", &kb) == 1)
+            {
+                kb *= 1024;
+                break;
+            }
+        }
+        std::fclose(f);
+        return kb;
+#else
+        (void)p;
+        return std::size_t(-1);
+#endif
+    }
+
+    inline void unmap(void * p, std::size_t bytes)
+    {
+#if defined(_WIN32)
+        (void)bytes;
+        ::VirtualFree(p, 0, MEM_RELEASE);
+#else
+        ::munmap(p, bytes);
+#endif
+    }
+
+    template <typename T>
+    tidy_allocation<T> mapped(std::size_t n, bool huge, bool touch)
+    {
+        static_assert(alignof(T) <= 4096, "tidy_alloc: mappings are only page aligned");
+        tidy_allocation<T> result;
+        if (n == 0)
+        {
+            result.backing = tidy_backing::pages;
+            return result;
+        }
+        if (n > std::size_t(-1) / sizeof(T))
+            throw std::bad_alloc();
+        Mapping m = map(n * sizeof(T), huge);
+        if (touch)
+        {
+            // one write per page is enough to fault it in (here, on this thread's node)
+            std::size_t step = page_size();
+            for (std::size_t i = 0; i < m.bytes; i += step)
+                static_cast<unsigned char volatile *>(m.p)[i] = 0;
+            result.first_touched = true;
+            // now the kernel has decided
+            if (m.backing == tidy_backing::transparent_huge_requested)
+            {
+                std::size_t got = anon_huge_bytes(m.p);
+                if (got != std::size_t(-1))
+                    m.backing = got ? tidy_backing::transparent_huge : tidy_backing::pages;
+            }
+        }
+        T * t = static_cast<T *>(m.p);
+        if constexpr (!std::is_trivially_default_constructible_v<T>)
+        {
+            try
+            {
+                std::uninitialized_value_construct_n(t, n);
+            }
+            catch (...)
+            {
+                unmap(m.p, m.bytes);
+                throw;
+            }
+        }
+        // (trivial Ts: fresh pages are already zero)
+        std::size_t bytes = m.bytes;
+        result.data = any_tidy_ptr<T[]>(t, [n, bytes](T * p) {
+            if constexpr (!std::is_trivially_destructible_v<T>)
+                std::destroy_n(p, n);
+            unmap(p, bytes);
+        });
+        result.size = n;
+        result.bytes = m.bytes;
+        result.backing = m.backing;
+        return result;
+    }
+}
+
+// n Ts, aligned to alignment (a power of 2 - ie 64 for a cache line / AVX-512), from operator new
+// (any other alignment throws std::invalid_argument)
+template <typename T>
+tidy_allocation<T> tidy_aligned(std::size_t n, std::size_t alignment = 64)
+{
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0)
+        throw std::invalid_argument("tidy_aligned: alignment must be a power of 2");
+    if (alignment < alignof(T))
+        alignment = alignof(T);
+    if (n > std::size_t(-1) / sizeof(T))
+        throw std::bad_alloc();
+    std::size_t bytes = n * sizeof(T);
+    T * t = static_cast<T *>(::operator new(bytes ? bytes : 1, std::align_val_t(alignment)));
+    try
+    {
+        std::uninitialized_value_construct_n(t, n);
+    }
+    catch (...)
+    {
+        ::operator delete(t, std::align_val_t(alignment));
+        throw;
+    }
+    tidy_allocation<T> result;
+    result.data = any_tidy_ptr<T[]>(t, [n, alignment](T * p) {
+        std::destroy_n(p, n);
+        ::operator delete(p, std::align_val_t(alignment));
+    });
+    result.size = n;
+    result.bytes = bytes;
+    result.backing = tidy_backing::heap;
+    return result;
+}
+
+// n Ts, on huge pages if possible (see backing for what was obtained)
+template <typename T>
+tidy_allocation<T> tidy_huge_pages(std::size_t n)
+{
+    return tidy_alloc_detail::mapped<T>(n, true, false);
+}
+
+// n Ts, on pages already faulted in by (and so, with first-touch NUMA, local to) the calling thread
+// huge: try for huge pages too (fewer pages to touch, fewer TLB misses)
+template <typename T>
+tidy_allocation<T> tidy_first_touch(std::size_t n, bool huge = true)
+{
+    return tidy_alloc_detail::mapped<T>(n, huge, true);
+}
+
+#endif // _h
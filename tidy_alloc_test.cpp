@@ -0,0 +1,111 @@
+#include "tidy_alloc.h"
+#include "alloc_trace.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <stdexcept>
+
+// link with alloc_trace.cpp
+
+namespace
+{
+    struct Tracker
+    {
+        static int aliveCount;
+        int val = 17;
+
+        Tracker() { aliveCount++; }
+        ~Tracker() { aliveCount--; }
+    };
+    int Tracker::aliveCount = 0;
+
+    bool aligned(void const * p, std::size_t a)
+    {
+        return reinterpret_cast<std::uintptr_t>(p) % a == 0;
+    }
+}
+
+TEST(tidy_alloc, aligned)
+{
+    for (std::size_t a : { 16, 64, 256, 4096 })
+    {
+        tidy_allocation<float> f = tidy_aligned<float>(1000, a);
+        EXPECT_TRUE(aligned(f.data.get(), a));
+        EXPECT_EQ(1000u, f.size);
+        EXPECT_EQ(tidy_backing::heap, f.backing);
+        EXPECT_EQ(0.0f, f.data[999]); // value-initialized
+    }
+}
+
+TEST(tidy_alloc, aligned_rejects_non_powers_of_2)
+{
+    EXPECT_THROW((void)tidy_aligned<float>(10, 48), std::invalid_argument);
+    EXPECT_THROW((void)tidy_aligned<float>(10, 0), std::invalid_argument);
+}
+
+TEST(tidy_alloc, aligned_constructs_and_destroys)
+{
+    {
+        tidy_allocation<Tracker> t = tidy_aligned<Tracker>(10);
+        EXPECT_EQ(10, Tracker::aliveCount);
+        EXPECT_EQ(17, t.data[9].val);
+    }
+    EXPECT_EQ(0, Tracker::aliveCount);
+}
+
+TEST(tidy_alloc, huge_pages)
+{
+    std::size_t n = 3 << 20; // 3 MiB of bytes - more than one huge page
+    tidy_allocation<unsigned char> h = tidy_huge_pages<unsigned char>(n);
+    ASSERT_NE(nullptr, h.data);
+    EXPECT_EQ(n, h.size);
+    EXPECT_GE(h.bytes, n);
+    EXPECT_NE(tidy_backing::heap, h.backing); // (which of the others depends on the machine)
+    EXPECT_TRUE(aligned(h.data.get(), 4096));
+    if (h.backing == tidy_backing::transparent_huge_requested)
+    {
+        EXPECT_TRUE(aligned(h.data.get(), 2 << 20)); // (so THP can back all of it)
+    }
+    EXPECT_EQ(0, h.data[n - 1]);
+    h.data[n - 1] = 17;
+    RecordProperty("backing", to_string(h.backing));
+}
+
+TEST(tidy_alloc, first_touch)
+{
+    {
+        tidy_allocation<Tracker> t = tidy_first_touch<Tracker>(1000, false);
+        EXPECT_TRUE(t.first_touched);
+        EXPECT_EQ(tidy_backing::pages, t.backing);
+        EXPECT_EQ(1000, Tracker::aliveCount);
+        EXPECT_EQ(17, t.data[999].val);
+    }
+    EXPECT_EQ(0, Tracker::aliveCount);
+
+    tidy_allocation<double> d = tidy_first_touch<double>(1 << 20);
+    EXPECT_TRUE(d.first_touched);
+    EXPECT_EQ(0.0, d.data[(1 << 20) - 1]);
+#if defined(__linux__)
+    // once touched, what was actually obtained is known - not just what was asked for
+    EXPECT_NE(tidy_backing::transparent_huge_requested, d.backing);
+#endif
+    RecordProperty("backing", to_string(d.backing));
+}
+
+TEST(tidy_alloc, empty)
+{
+    tidy_allocation<int> e = tidy_huge_pages<int>(0);
+    EXPECT_EQ(nullptr, e.data);
+    EXPECT_EQ(0u, e.size);
+}
+
+TEST(tidy_alloc, deleters_fit_inline)
+{
+    // the only allocation is the memory itself
+    auto c = alloc_trace::count([] {
+        tidy_allocation<float> f = tidy_aligned<float>(100);
+        tidy_allocation<float> h = tidy_huge_pages<float>(100);
+    });
+    EXPECT_EQ(1u, c.allocations);
+}
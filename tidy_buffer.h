@@ -0,0 +1,205 @@
+#ifndef tidy_buffer_h_INCLUDED
+#define tidy_buffer_h_INCLUDED
+
+#include "any_tidy_ptr.h"
+
+#include <memory> // shared_ptr
+#include <vector>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <stdexcept> // out_of_range
+#if __has_include(<span>)
+#include <span>
+#endif
+
+//
+// A run of Ts - pointer + length - that keeps whatever owns them alive.
+// Like any_tidy_ptr<T[]>, it doesn't care *how* the memory gets cleaned up (new[], a C library, a shared_ptr, mmap, ...),
+// but it knows how long it is, and it is cheaply copyable, and sliceable - every copy/slice shares the one owner,
+// and the memory goes away when the last of them does:
+//
+//    tidy_buffer<std::byte> frame(std::move(bytesFromSocket), n);    // adopts an any_tidy_ptr<std::byte[]> (or unique_ptr)
+//    tidy_buffer<std::byte> header = frame.slice(0, 16);             // no copying
+//    tidy_buffer<std::byte> payload = frame.slice(16);
+//    nextStage.push(std::move(payload));                             // frame can go away now
+//
+// The owner is a shared_ptr<void const> (so adopting an any_tidy_ptr/unique_ptr costs one allocation, for the count,
+// and copies cost an atomic increment).
+// A buffer made with a nullptr deleter doesn't own anything (like any_tidy_ptr) - it is only good while someone else keeps the Ts alive.
+//
+// tidy_buffer<T> converts to tidy_buffer<T const> (and to std::span, with C++20).
+//
+template <typename T>
+class tidy_buffer
+{
+    template <typename>
+    friend class tidy_buffer;
+
+    T * ptr = nullptr;
+    std::size_t len = 0;
+    std::shared_ptr<void const> keeper; // null when not owned
+
+public:
+    using element_type = T;
+    using value_type = std::remove_cv_t<T>;
+    using pointer = T *;
+    using iterator = T *;
+    static constexpr std::size_t npos = std::size_t(-1);
+
+    tidy_buffer() = default;
+
+    // adopts p (which points at n Ts) - any_tidy_ptr<T[]> or any other unique_ptr<T[], Deleter>
+    template <typename U, typename D, typename = std::enable_if_t<std::is_convertible_v<U (*)[], T (*)[]>>>
+    tidy_buffer(std::unique_ptr<U[], D> && p, std::size_t n)
+        : ptr(p.get()), len(n)
+    {
+        if (ptr)
+            keeper = std::shared_ptr<U[]>(std::move(p));
+    }
+    // shares sp's ownership
+    template <typename U, typename = std::enable_if_t<std::is_convertible_v<U (*)[], T (*)[]>>>
+    tidy_buffer(std::shared_ptr<U[]> sp, std::size_t n)
+        : ptr(sp.get()), len(n), keeper(std::move(sp))
+    {
+    }
+    // from a foreign API: deleter(data) gets called when the last copy goes away (like any_tidy_ptr's deleter)
+    template <typename Deleter>
+    tidy_buffer(T * data, std::size_t n, Deleter && deleter)
+        : tidy_buffer(any_tidy_ptr<T[]>(data, std::forward<Deleter>(deleter)), n)
+    {
+    }
+    // not owned - someone else keeps the Ts alive (for longer than this buffer and its copies)
+    tidy_buffer(T * data, std::size_t n, std::nullptr_t) noexcept
+        : ptr(data), len(n)
+    {
+    }
+    // data is kept alive by owner (ie data points into owner somewhere)
+    tidy_buffer(std::shared_ptr<void const> owner, T * data, std::size_t n) noexcept
+        : ptr(data), len(n), keeper(std::move(owner))
+    {
+    }
+    // takes over a vector's elements (moves the vector, not the elements)
+    explicit tidy_buffer(std::vector<value_type> && v)
+    {
+        auto held = std::make_shared<std::vector<value_type>>(std::move(v));
+        ptr = held->data();
+        len = held->size();
+        keeper = std::move(held);
+    }
+
+    // T -> T const
+    template <typename U, typename = std::enable_if_t<!std::is_same_v<U, T> && std::is_convertible_v<U (*)[], T (*)[]>>>
+    tidy_buffer(tidy_buffer<U> const & other) noexcept
+        : ptr(other.ptr), len(other.len), keeper(other.keeper)
+    {
+    }
+    template <typename U, typename = std::enable_if_t<!std::is_same_v<U, T> && std::is_convertible_v<U (*)[], T (*)[]>>>
+    tidy_buffer(tidy_buffer<U> && other) noexcept
+        : ptr(std::exchange(other.ptr, nullptr)), len(std::exchange(other.len, 0)), keeper(std::move(other.keeper))
+    {
+    }
+
+    tidy_buffer(tidy_buffer const &) = default;
+    tidy_buffer & operator=(tidy_buffer const &) = default;
+    tidy_buffer(tidy_buffer && other) noexcept
+        : ptr(std::exchange(other.ptr, nullptr)), len(std::exchange(other.len, 0)), keeper(std::move(other.keeper))
+    {
+    }
+    tidy_buffer & operator=(tidy_buffer && other) noexcept
+    {
+        ptr = std::exchange(other.ptr, nullptr);
+        len = std::exchange(other.len, 0);
+        keeper = std::move(other.keeper);
+        return *this;
+    }
+
+    // count Ts starting at offset (or up to the end), sharing the owner
+    tidy_buffer slice(std::size_t offset, std::size_t count = npos) const &
+    {
+        if (offset > len)
+            throw std::out_of_range("tidy_buffer::slice");
+        return tidy_buffer(keeper, ptr + offset, count == npos || count > len - offset ? len - offset : count);
+    }
+    // (from a temporary, no need to touch the reference count)
+    tidy_buffer slice(std::size_t offset, std::size_t count = npos) &&
+    {
+        if (offset > len)
+            throw std::out_of_range("tidy_buffer::slice");
+        return tidy_buffer(std::move(keeper), ptr + offset, count == npos || count > len - offset ? len - offset : count);
+    }
+    tidy_buffer first(std::size_t count) const
+    {
+        return slice(0, count);
+    }
+    tidy_buffer last(std::size_t count) const
+    {
+        return slice(count < len ? len - count : 0);
+    }
+
+    void reset() noexcept
+    {
+        ptr = nullptr;
+        len = 0;
+        keeper.reset();
+    }
+
+    T * data() const noexcept
+    {
+        return ptr;
+    }
+    std::size_t size() const noexcept
+    {
+        return len;
+    }
+    std::size_t size_bytes() const noexcept
+    {
+        return len * sizeof(T);
+    }
+    bool empty() const noexcept
+    {
+        return len == 0;
+    }
+    T & operator[](std::size_t i) const
+    {
+        return ptr[i];
+    }
+    T * begin() const noexcept
+    {
+        return ptr;
+    }
+    T * end() const noexcept
+    {
+        return ptr + len;
+    }
+
+    // whatever keeps the Ts alive (null if not owned)
+    std::shared_ptr<void const> const & owner() const noexcept
+    {
+        return keeper;
+    }
+    bool owned() const noexcept
+    {
+        return keeper != nullptr;
+    }
+
+#if defined(__cpp_lib_span)
+    std::span<T> span() const noexcept
+    {
+        return std::span<T>(ptr, len);
+    }
+    operator std::span<T>() const noexcept
+    {
+        return span();
+    }
+#endif
+};
+
+// n value-initialized Ts, in a new buffer
+template <typename T>
+tidy_buffer<T> make_tidy_buffer(std::size_t n)
+{
+    return tidy_buffer<T>(std::shared_ptr<T[]>(new T[n]()), n);
+}
+
+#endif // _h
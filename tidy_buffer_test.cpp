@@ -0,0 +1,161 @@
+#include "tidy_buffer.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdlib>
+#include <memory>
+#include <numeric>
+#include <type_traits>
+#include <vector>
+
+namespace
+{
+    struct Tracker
+    {
+        static int aliveCount;
+        int val = 0;
+
+        Tracker() { aliveCount++; }
+        ~Tracker() { aliveCount--; }
+    };
+    int Tracker::aliveCount = 0;
+}
+
+TEST(tidy_buffer, default_is_empty)
+{
+    tidy_buffer<int> b;
+    EXPECT_TRUE(b.empty());
+    EXPECT_EQ(0u, b.size());
+    EXPECT_EQ(nullptr, b.data());
+    EXPECT_FALSE(b.owned());
+}
+
+TEST(tidy_buffer, adopts_any_tidy_ptr)
+{
+    {
+        tidy_buffer<Tracker> b(any_tidy_ptr<Tracker[]>(new Tracker[10]), 10);
+        EXPECT_EQ(10u, b.size());
+        EXPECT_EQ(10 * sizeof(Tracker), b.size_bytes());
+        EXPECT_TRUE(b.owned());
+        EXPECT_EQ(10, Tracker::aliveCount);
+    }
+    EXPECT_EQ(0, Tracker::aliveCount);
+}
+
+TEST(tidy_buffer, adopts_unique_ptr_and_shared_ptr)
+{
+    {
+        tidy_buffer<Tracker> u(std::make_unique<Tracker[]>(3), 3);
+        std::shared_ptr<Tracker[]> sp = std::make_unique<Tracker[]>(4);
+        tidy_buffer<Tracker> s(sp, 4);
+        EXPECT_EQ(7, Tracker::aliveCount);
+        EXPECT_EQ(sp.get(), s.data());
+        EXPECT_EQ(2, sp.use_count());
+        sp.reset();
+        EXPECT_EQ(7, Tracker::aliveCount); // s still has them
+    }
+    EXPECT_EQ(0, Tracker::aliveCount);
+}
+
+TEST(tidy_buffer, foreign_deleter)
+{
+    int freed = 0;
+    {
+        int * raw = static_cast<int *>(std::malloc(5 * sizeof(int)));
+        tidy_buffer<int> b(raw, 5, [&freed](int * p) { std::free(p); freed++; });
+        tidy_buffer<int> copy = b;
+        b.reset();
+        EXPECT_EQ(0, freed);
+    }
+    EXPECT_EQ(1, freed);
+}
+
+TEST(tidy_buffer, not_owned)
+{
+    int x[3] = { 1, 2, 3 };
+    tidy_buffer<int> b(x, 3, nullptr);
+    EXPECT_FALSE(b.owned());
+    EXPECT_EQ(3, b[2]);
+}
+
+TEST(tidy_buffer, from_vector)
+{
+    std::vector<int> v(100);
+    std::iota(v.begin(), v.end(), 0);
+    int const * elements = v.data();
+    tidy_buffer<int> b(std::move(v));
+    EXPECT_EQ(elements, b.data()); // no copying
+    EXPECT_EQ(100u, b.size());
+    EXPECT_EQ(99, b[99]);
+}
+
+TEST(tidy_buffer, slices_keep_the_owner_alive)
+{
+    tidy_buffer<Tracker> payload;
+    {
+        tidy_buffer<Tracker> frame(any_tidy_ptr<Tracker[]>(new Tracker[10]), 10);
+        for (std::size_t i = 0; i < frame.size(); i++)
+            frame[i].val = (int)i;
+
+        tidy_buffer<Tracker> header = frame.slice(0, 4);
+        payload = frame.slice(4);
+        EXPECT_EQ(4u, header.size());
+        EXPECT_EQ(6u, payload.size());
+        EXPECT_EQ(frame.data() + 4, payload.data());
+        EXPECT_EQ(frame.owner(), payload.owner());
+
+        EXPECT_EQ(2u, frame.slice(8, 100).size()); // (clamped)
+        EXPECT_EQ(0u, frame.slice(10).size());
+        EXPECT_THROW(frame.slice(11), std::out_of_range);
+
+        EXPECT_EQ(3u, frame.first(3).size());
+        EXPECT_EQ(7, frame.last(3)[0].val);
+    }
+    EXPECT_EQ(10, Tracker::aliveCount);
+    EXPECT_EQ(4, payload[0].val);
+    EXPECT_EQ(9, payload.slice(5)[0].val);
+    payload.reset();
+    EXPECT_EQ(0, Tracker::aliveCount);
+}
+
+TEST(tidy_buffer, to_const)
+{
+    tidy_buffer<int> b = make_tidy_buffer<int>(8);
+    EXPECT_EQ(0, b[7]);
+    b[7] = 17;
+    tidy_buffer<int const> c = b;
+    EXPECT_EQ(17, c[7]);
+    EXPECT_EQ(b.owner(), c.owner());
+    tidy_buffer<int const> d = std::move(b);
+    EXPECT_TRUE(b.empty());
+    EXPECT_EQ(17, d[7]);
+
+    int sum = 0;
+    for (int i : c)
+        sum += i;
+    EXPECT_EQ(17, sum);
+}
+
+TEST(tidy_buffer, no_derived_to_base)
+{
+    // (indexing a Base buffer that really holds Deriveds would step by the wrong size)
+    struct Base { int b = 0; };
+    struct Derived : Base { int d = 0; };
+    static_assert(std::is_convertible_v<tidy_buffer<Base>, tidy_buffer<Base const>>);
+    static_assert(!std::is_convertible_v<tidy_buffer<Derived>, tidy_buffer<Base>>);
+    static_assert(!std::is_convertible_v<tidy_buffer<Derived>, tidy_buffer<Base const>>);
+    static_assert(!std::is_constructible_v<tidy_buffer<Base>, std::unique_ptr<Derived[]>, std::size_t>);
+    static_assert(!std::is_constructible_v<tidy_buffer<Base>, std::shared_ptr<Derived[]>, std::size_t>);
+    static_assert(std::is_constructible_v<tidy_buffer<Base const>, std::shared_ptr<Base[]>, std::size_t>);
+}
+
+#if defined(__cpp_lib_span)
+TEST(tidy_buffer, span)
+{
+    tidy_buffer<int> b = make_tidy_buffer<int>(4);
+    std::span<int> s = b;
+    EXPECT_EQ(4u, s.size());
+    EXPECT_EQ(b.data(), s.data());
+}
+#endif
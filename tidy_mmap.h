@@ -0,0 +1,180 @@
+#ifndef tidy_mmap_h_INCLUDED
+#define tidy_mmap_h_INCLUDED
+
+#include "any_tidy_ptr.h"
+
+#include <cstddef>
+#include <filesystem>
+#include <string>
+#include <system_error>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+//
+// Maps a whole file (read-only) into memory, and hands it back as an any_tidy_ptr whose deleter unmaps it:
+//
+//    tidy_mapping table = tidy_mmap("lut.bin", { tidy_mmap_options::willneed });
+//    use(table.data.get(), table.size);
+//
+// No read() into a heap buffer - the pages come straight from the page cache (shared with every other process mapping the file),
+// and only the ones you touch get loaded.
+// Since it is just an any_tidy_ptr, it goes anywhere any_tidy_ptr does -
+// ie tidy_buffer<std::byte const>(std::move(table.data), table.size) for sliceable, shareable views.
+//
+// The file can be closed (and even deleted) once mapped; the mapping stays until the any_tidy_ptr goes away.
+// But don't truncate a file while it is mapped (touching the missing pages is a SIGBUS, not an exception).
+// An empty file gives a null pointer and size 0.
+// Errors (can't open, can't map) throw std::system_error.
+//
+struct tidy_mmap_options
+{
+    // how the pages will be read (a readahead hint)
+    enum access_pattern { normal, sequential, random, willneed };
+    access_pattern access = normal;
+    // fault all the pages in now (ie at startup), rather than on first touch
+    bool populate = false;
+    // ask for huge pages (only helps where the OS/filesystem can back files with them; otherwise ignored)
+    bool hugepages = false;
+};
+
+struct tidy_mapping
+{
+    any_tidy_ptr<std::byte const[]> data;
+    std::size_t size = 0;
+};
+
+namespace tidy_mmap_detail
+{
+    [[noreturn]] inline void fail(int err, char const * what, std::filesystem::path const & path)
+    {
+        throw std::system_error(err, std::system_category(), std::string("tidy_mmap: ") + what + " " + path.string());
+    }
+}
+
+#if defined(_WIN32)
+
+// (the hints, other than populate, have no Windows equivalent for file views, so are ignored)
+inline tidy_mapping tidy_mmap(std::filesystem::path const & path, tidy_mmap_options options = {})
+{
+    using tidy_mmap_detail::fail;
+    HANDLE file = ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+        OPEN_EXISTING, options.access == tidy_mmap_options::sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        fail((int)::GetLastError(), "open", path);
+
+    tidy_mapping result;
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(file, &size))
+    {
+        DWORD err = ::GetLastError();
+        ::CloseHandle(file);
+        fail((int)err, "size", path);
+    }
+    if (size.QuadPart == 0)
+    {
+        ::CloseHandle(file);
+        return result;
+    }
+
+    HANDLE mapping = ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    DWORD err = ::GetLastError();
+    ::CloseHandle(file); // (the mapping keeps the file open)
+    if (!mapping)
+        fail((int)err, "map", path);
+    void * view = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    err = ::GetLastError();
+    ::CloseHandle(mapping); // (the view keeps the mapping)
+    if (!view)
+        fail((int)err, "map", path);
+
+    result.size = (std::size_t)size.QuadPart;
+    result.data = any_tidy_ptr<std::byte const[]>(static_cast<std::byte const *>(view),
+        [](std::byte const * p) { ::UnmapViewOfFile(p); });
+    if (options.populate)
+    {
+        WIN32_MEMORY_RANGE_ENTRY range = { view, result.size };
+        ::PrefetchVirtualMemory(::GetCurrentProcess(), 1, &range, 0);
+    }
+    return result;
+}
+
+#else
+
+inline tidy_mapping tidy_mmap(std::filesystem::path const & path, tidy_mmap_options options = {})
+{
+    using tidy_mmap_detail::fail;
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        fail(errno, "open", path);
+
+    tidy_mapping result;
+    struct stat st;
+    if (::fstat(fd, &st) != 0)
+    {
+        int err = errno;
+        ::close(fd);
+        fail(err, "stat", path);
+    }
+    if (st.st_size == 0)
+    {
+        ::close(fd);
+        return result;
+    }
+
+    std::size_t size = (std::size_t)st.st_size;
+    int flags = MAP_PRIVATE;
+#if defined(MAP_POPULATE)
+    if (options.populate)
+        flags |= MAP_POPULATE;
+#endif
+    void * p = ::mmap(nullptr, size, PROT_READ, flags, fd, 0);
+    int err = errno;
+    ::close(fd); // (the mapping keeps the file)
+    if (p == MAP_FAILED)
+        fail(err, "map", path);
+
+    // the hints are just hints - if the OS says no, carry on
+    switch (options.access)
+    {
+    case tidy_mmap_options::normal:
+        break;
+    case tidy_mmap_options::sequential:
+        ::madvise(p, size, MADV_SEQUENTIAL);
+        break;
+    case tidy_mmap_options::random:
+        ::madvise(p, size, MADV_RANDOM);
+        break;
+    case tidy_mmap_options::willneed:
+        ::madvise(p, size, MADV_WILLNEED);
+        break;
+    }
+#if !defined(MAP_POPULATE)
+    if (options.populate)
+        ::madvise(p, size, MADV_WILLNEED);
+#endif
+#if defined(MADV_HUGEPAGE)
+    if (options.hugepages)
+        ::madvise(p, size, MADV_HUGEPAGE);
+#endif
+
+    result.size = size;
+    // (the lambda only captures the size, so it fits in tidy_deleter without allocating)
+    result.data = any_tidy_ptr<std::byte const[]>(static_cast<std::byte const *>(p),
+        [size](std::byte const * q) { ::munmap(const_cast<std::byte *>(q), size); });
+    return result;
+}
+
+#endif
+
+#endif // _h
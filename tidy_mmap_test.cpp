@@ -0,0 +1,96 @@
+#include "tidy_mmap.h"
+#include "tidy_buffer.h"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+
+namespace
+{
+    // a file in the temp dir, deleted at the end of the test
+    struct TempFile
+    {
+        std::filesystem::path path;
+
+        TempFile(std::string const & name, std::string const & contents)
+            : path(std::filesystem::temp_directory_path() / name)
+        {
+            std::ofstream out(path, std::ios::binary);
+            out << contents;
+        }
+        ~TempFile()
+        {
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+        }
+    };
+
+    std::string as_string(tidy_mapping const & m)
+    {
+        return std::string(reinterpret_cast<char const *>(m.data.get()), m.size);
+    }
+}
+
+TEST(tidy_mmap, maps_the_file)
+{
+    TempFile file("tidy_mmap_test_maps.bin", "hello, mapped world");
+    tidy_mapping m = tidy_mmap(file.path);
+    ASSERT_NE(nullptr, m.data);
+    EXPECT_EQ(19u, m.size);
+    EXPECT_EQ("hello, mapped world", as_string(m));
+}
+
+TEST(tidy_mmap, hints)
+{
+    std::string contents(1 << 20, 'x');
+    TempFile file("tidy_mmap_test_hints.bin", contents);
+    for (auto access : { tidy_mmap_options::normal, tidy_mmap_options::sequential, tidy_mmap_options::random, tidy_mmap_options::willneed })
+    {
+        tidy_mmap_options options;
+        options.access = access;
+        options.populate = true;
+        options.hugepages = true;
+        tidy_mapping m = tidy_mmap(file.path, options);
+        EXPECT_EQ(contents.size(), m.size);
+        EXPECT_EQ(std::byte{ 'x' }, m.data[contents.size() - 1]);
+    }
+}
+
+TEST(tidy_mmap, outlives_the_file)
+{
+    tidy_mapping m;
+    {
+        TempFile file("tidy_mmap_test_outlives.bin", "still here");
+        m = tidy_mmap(file.path);
+    }
+    EXPECT_EQ("still here", as_string(m));
+    m.data.reset(); // unmaps
+    EXPECT_EQ(nullptr, m.data);
+}
+
+TEST(tidy_mmap, empty_file)
+{
+    TempFile file("tidy_mmap_test_empty.bin", "");
+    tidy_mapping m = tidy_mmap(file.path);
+    EXPECT_EQ(nullptr, m.data);
+    EXPECT_EQ(0u, m.size);
+}
+
+TEST(tidy_mmap, missing_file_throws)
+{
+    EXPECT_THROW(tidy_mmap(std::filesystem::temp_directory_path() / "tidy_mmap_test_no_such_file.bin"), std::system_error);
+}
+
+TEST(tidy_mmap, as_a_tidy_buffer)
+{
+    TempFile file("tidy_mmap_test_buffer.bin", "headerPAYLOAD");
+    tidy_mapping m = tidy_mmap(file.path);
+    tidy_buffer<std::byte const> all(std::move(m.data), m.size);
+    tidy_buffer<std::byte const> payload = all.slice(6);
+    all.reset();
+    EXPECT_EQ("PAYLOAD", std::string(reinterpret_cast<char const *>(payload.data()), payload.size()));
+}
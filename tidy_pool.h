@@ -0,0 +1,376 @@
+#ifndef tidy_pool_h_INCLUDED
+#define tidy_pool_h_INCLUDED
+
+#include "any_tidy_ptr.h"
+#include "unique_function.h"
+
+#include <atomic>
+#include <memory> // shared_ptr
+#include <mutex>
+#include <vector>
+#include <cstddef>
+#include <utility>
+
+//
+// A pool of (big, reusable) Ts - scratch images, parse buffers... - handed out as any_tidy_ptr<T>s
+// whose deleter puts the T back in the pool instead of deleting it. So whoever ends up with one doesn't know (or care) it was pooled:
+//
+//    tidy_pool<Scratch> pool(tidy_pool_limits{}, nullptr, [](Scratch & s) { s.clear(); });
+//
+//    any_tidy_ptr<Scratch> s = pool.acquire();   // a reused Scratch (or a new one, if there are none free)
+//    ...
+//    s.reset();                                  // back in the pool (cleared)
+//
+// Like any_movable_pool:
+// - each thread keeps its own freelist (no locking in the common case)
+// - returning on a different thread than acquiring is fine - it goes on the returning thread's list
+// - when a thread's list is full, half of it goes to the pool's shared list, and a thread with an empty list takes a batch from there
+// So a producer thread acquiring and a consumer thread returning just pass batches through the shared list.
+//
+// The Ts are not destroyed between uses - make() is only called on a miss, and reset (if any) is called on every return
+// (on the returning thread). reset must not throw (it runs in a deleter).
+// make() must return something delete can delete (the default is new T()).
+//
+// Capacity: limits.thread_cache Ts per thread, and limits.max_idle in the shared list; past that, returned Ts are deleted.
+// Handed-out Ts can outlive the pool (its innards stay until the last one is back), and are deleted when they come back.
+// (The deleter is just a pointer to the innards - acquiring and returning don't touch a shared refcount.)
+// Ts that come back while a thread is exiting, after its lists are gone (from a thread_local's destructor), go straight to the shared list.
+// Each thread counts its own hits/misses/returns (so counting doesn't put a shared cache line on the hot path); stats() adds them up.
+// acquire_shared() is for shared_ptr users (and the result works with any_tidy_ptr's shared_ptr constructor too);
+// the T goes back to the pool when the last shared_ptr goes.
+//
+struct tidy_pool_limits
+{
+    std::size_t max_idle = 1024;   // Ts kept in the shared list
+    std::size_t thread_cache = 16; // Ts kept by each thread
+};
+
+struct tidy_pool_stats
+{
+    std::size_t hits = 0;      // acquires served from a freelist
+    std::size_t misses = 0;    // acquires that needed make()
+    std::size_t returns = 0;   // Ts that came back (and were kept)
+    std::size_t discards = 0;  // Ts that came back but were deleted (over a limit, or the pool was gone)
+    std::size_t idle = 0;      // Ts in the shared list (not counting the threads' lists)
+};
+template <typename T>
+class tidy_pool
+{
+    // (returns can "go negative" in one place when Ts are dropped somewhere else - it wraps, and the sum comes out right)
+    struct Counts
+    {
+        std::atomic<std::size_t> hits{ 0 };
+        std::atomic<std::size_t> misses{ 0 };
+        std::atomic<std::size_t> returns{ 0 };
+        std::atomic<std::size_t> discards{ 0 };
+    };
+    // only the owning thread writes its counts, so no need for a (locked) read-modify-write - just don't tear for stats()
+    static void bump(std::atomic<std::size_t> & counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // The pool and the threads' lists hold shared_ptrs to the Core, but handed-out Ts only hold a Core *
+    // (so acquiring and returning don't touch a shared refcount). Instead, when the pool goes, if any Ts are still out,
+    // the Core holds on to itself (self), until the counts say every T is back.
+    struct Core : std::enable_shared_from_this<Core>
+    {
+        tidy_pool_limits limits;
+        unique_function<T *()> make;
+        unique_function<void(T &)> reset;
+
+        std::mutex m;
+        std::vector<T *> idle; // (guarded by m; reserved up front, so giving never allocates)
+        std::atomic<bool> open{ true }; // (only changed with m locked)
+
+        Counts totals;                // (threads' that are done with the pool, and whatever isn't counted on a hot path)
+        std::vector<Counts *> counts; // (guarded by m; the threads still using the pool - for stats())
+        std::shared_ptr<Core> self;   // (guarded by m; set while the pool is gone but Ts are still out)
+
+        // (with m locked) Ts acquired but not back yet.
+        // Once the pool is gone there are no more acquires, so this only goes down - and another thread's returns
+        // can only be read late (ie too high), never early. So 0 really means they're all back.
+        std::size_t handed_out() const
+        {
+            std::size_t n = 0;
+            auto add = [&n](Counts const & c) {
+                n += c.hits.load(std::memory_order_relaxed) + c.misses.load(std::memory_order_relaxed);
+                n -= c.returns.load(std::memory_order_relaxed) + c.discards.load(std::memory_order_relaxed);
+            };
+            add(totals);
+            for (Counts const * c : counts)
+                add(*c);
+            return n;
+        }
+        // (with m locked, after the counts went down) self, if nothing needs it any more - let go of it after unlocking
+        std::shared_ptr<Core> done() noexcept
+        {
+            if (self && !open.load(std::memory_order_relaxed) && handed_out() == 0)
+                return std::move(self);
+            return nullptr;
+        }
+
+        void join(Counts * c)
+        {
+            std::lock_guard<std::mutex> lock(m);
+            counts.push_back(c);
+        }
+        void leave(Counts * c) noexcept
+        {
+            std::shared_ptr<Core> last;
+            std::lock_guard<std::mutex> lock(m);
+            totals.hits.fetch_add(c->hits.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            totals.misses.fetch_add(c->misses.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            totals.returns.fetch_add(c->returns.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            totals.discards.fetch_add(c->discards.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            for (std::size_t i = 0; i < counts.size(); i++)
+                if (counts[i] == c)
+                {
+                    counts[i] = counts.back();
+                    counts.pop_back();
+                    break;
+                }
+            last = done(); // (the caller still holds the Core, so this isn't the last of it)
+        }
+
+        // keeps what fits under max_idle (and deletes the rest - after unlocking)
+        void give(T * const * ts, std::size_t n) noexcept
+        {
+            std::size_t kept = 0;
+            {
+                std::lock_guard<std::mutex> lock(m);
+                if (open.load(std::memory_order_relaxed))
+                    for (; kept < n && idle.size() < limits.max_idle; kept++)
+                        idle.push_back(ts[kept]);
+                if (std::size_t dropped = n - kept)
+                {
+                    totals.returns.fetch_sub(dropped, std::memory_order_relaxed);
+                    totals.discards.fetch_add(dropped, std::memory_order_relaxed);
+                }
+            }
+            for (std::size_t i = kept; i < n; i++)
+                delete ts[i];
+        }
+        // (the last n of items)
+        void give(std::vector<T *> & items, std::size_t n) noexcept
+        {
+            give(items.data() + items.size() - n, n);
+            items.erase(items.end() - n, items.end());
+        }
+        // a T that hasn't been counted as back yet, with no thread list to go on (or the pool is gone)
+        // (this can be the last use of the Core)
+        void give_one(T * t) noexcept
+        {
+            std::shared_ptr<Core> last;
+            bool kept = false;
+            {
+                std::lock_guard<std::mutex> lock(m);
+                if (open.load(std::memory_order_relaxed) && idle.size() < limits.max_idle)
+                {
+                    idle.push_back(t);
+                    totals.returns.fetch_add(1, std::memory_order_relaxed);
+                    kept = true;
+                }
+                else
+                {
+                    totals.discards.fetch_add(1, std::memory_order_relaxed);
+                    last = done();
+                }
+            }
+            if (!kept)
+                delete t;
+        }
+        bool take(std::vector<T *> & into, std::size_t n)
+        {
+            std::lock_guard<std::mutex> lock(m);
+            while (n-- && !idle.empty())
+            {
+                into.push_back(idle.back());
+                idle.pop_back();
+            }
+            return !into.empty();
+        }
+
+        ~Core()
+        {
+            for (T * t : idle)
+                delete t;
+        }
+    };
+
+    // this thread's freelist (and counts) for one pool
+    // (held by unique_ptr, so it stays put while make() or reset() use other pools, and the list grows)
+    struct Local
+    {
+        std::shared_ptr<Core> core;
+        Counts counts;
+        std::vector<T *> items;
+
+        Local(std::shared_ptr<Core> c)
+            : core(std::move(c))
+        {
+            items.reserve(core->limits.thread_cache + 1);
+            core->join(&counts);
+        }
+        Local(Local const &) = delete;
+        Local & operator=(Local const &) = delete;
+        ~Local()
+        {
+            core->give(items, items.size()); // (deletes them, if the pool is gone)
+            core->leave(&counts);
+        }
+    };
+
+    // set (for good) when this thread's lists are destroyed - a thread_local that was constructed before them
+    // (so is destroyed after them) can still be giving Ts back, and those go straight to the shared list
+    static bool & locals_gone()
+    {
+        static thread_local bool gone = false;
+        return gone;
+    }
+    struct Locals
+    {
+        std::vector<std::unique_ptr<Local>> list;
+        ~Locals() { locals_gone() = true; }
+    };
+    // null once this thread's lists are gone
+    static std::vector<std::unique_ptr<Local>> * locals()
+    {
+        if (locals_gone())
+            return nullptr;
+        static thread_local Locals l;
+        return &l.list;
+    }
+    // (a thread uses a few pools at most, so a scan is fine)
+    static Local * local(Core & core)
+    {
+        std::vector<std::unique_ptr<Local>> * list = locals();
+        if (!list)
+            return nullptr;
+        for (std::unique_ptr<Local> & l : *list)
+            if (l->core.get() == &core)
+                return l.get();
+        // a good time to let go of pools that are gone
+        for (std::size_t i = list->size(); i-- > 0;)
+            if (!(*list)[i]->core->open.load(std::memory_order_relaxed))
+                list->erase(list->begin() + i);
+        // (only when a thread first uses the pool - the T being acquired or returned keeps the Core alive till then)
+        list->push_back(std::make_unique<Local>(core.shared_from_this()));
+        return list->back().get();
+    }
+
+    static void give_back(Core & core, T * t)
+    {
+        if (!core.open.load(std::memory_order_relaxed))
+        {
+            core.give_one(t); // (deletes it)
+            return;
+        }
+        if (core.reset)
+            core.reset(*t);
+        // (the Local holds the Core from here on, so counting the T as back can't be the last of the Core)
+        Local * l = local(core);
+        if (!l)
+        {
+            core.give_one(t);
+            return;
+        }
+        bump(l->counts.returns);
+        l->items.push_back(t);
+        if (l->items.size() > core.limits.thread_cache)
+            core.give(l->items, l->items.size() - core.limits.thread_cache / 2);
+    }
+
+    std::shared_ptr<Core> core;
+
+public:
+    // make: how to make a new T (default new T()); reset: what to do to a T when it comes back (default nothing)
+    explicit tidy_pool(tidy_pool_limits limits = {}, unique_function<T *()> make = nullptr, unique_function<void(T &)> reset = nullptr)
+        : core(std::make_shared<Core>())
+    {
+        core->limits = limits;
+        core->idle.reserve(limits.max_idle);
+        core->make = std::move(make);
+        core->reset = std::move(reset);
+    }
+    tidy_pool(tidy_pool const &) = delete;
+    tidy_pool & operator=(tidy_pool const &) = delete;
+
+    // Ts still handed out are deleted when they come back (and Ts in other threads' lists, next time those threads use a pool, or exit)
+    ~tidy_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(core->m);
+            core->open.store(false, std::memory_order_relaxed);
+            if (core->handed_out() != 0)
+                core->self = core;
+        }
+        trim();
+        // (this thread's list goes now)
+        if (std::vector<std::unique_ptr<Local>> * list = locals())
+            for (std::size_t i = list->size(); i-- > 0;)
+                if ((*list)[i]->core == core)
+                    list->erase(list->begin() + i);
+    }
+
+    any_tidy_ptr<T> acquire()
+    {
+        Local * l = local(*core);
+        T * t;
+        // (no list - this thread is exiting - means a new one)
+        if (l && (!l->items.empty() || core->take(l->items, core->limits.thread_cache / 2 + 1)))
+        {
+            t = l->items.back();
+            l->items.pop_back();
+            bump(l->counts.hits);
+        }
+        else
+        {
+            t = core->make ? core->make() : new T();
+            if (l)
+                bump(l->counts.misses);
+            else
+                core->totals.misses.fetch_add(1, std::memory_order_relaxed);
+        }
+        // (the lambda is one pointer, so it fits in tidy_deleter without allocating)
+        return any_tidy_ptr<T>(t, [c = core.get()](T * p) { give_back(*c, p); });
+    }
+
+    // (one allocation, for shared_ptr's control block)
+    std::shared_ptr<T> acquire_shared()
+    {
+        return std::shared_ptr<T>(acquire());
+    }
+
+    // deletes the Ts in the shared list
+    void trim()
+    {
+        std::vector<T *> items;
+        {
+            std::lock_guard<std::mutex> lock(core->m);
+            items.assign(core->idle.begin(), core->idle.end()); // (idle keeps its room)
+            core->idle.clear();
+        }
+        for (T * t : items)
+            delete t;
+    }
+
+    tidy_pool_stats stats() const
+    {
+        tidy_pool_stats s;
+        auto add = [&s](Counts const & c) {
+            s.hits += c.hits.load(std::memory_order_relaxed);
+            s.misses += c.misses.load(std::memory_order_relaxed);
+            s.returns += c.returns.load(std::memory_order_relaxed);
+            s.discards += c.discards.load(std::memory_order_relaxed);
+        };
+        std::lock_guard<std::mutex> lock(core->m);
+        add(core->totals);
+        for (Counts const * c : core->counts)
+            add(*c);
+        s.idle = core->idle.size();
+        return s;
+    }
+};
+
+#endif // _h
@@ -0,0 +1,282 @@
+#include "tidy_pool.h"
+#include "alloc_trace.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// link with alloc_trace.cpp
+
+namespace
+{
+    struct Scratch
+    {
+        static std::atomic<int> alive;
+        std::vector<int> data;
+        int uses = 0;
+
+        Scratch() { alive++; }
+        ~Scratch() { alive--; }
+    };
+    std::atomic<int> Scratch::alive{ 0 };
+}
+
+TEST(tidy_pool, reuses)
+{
+    {
+        tidy_pool<Scratch> pool;
+        Scratch * first;
+        {
+            any_tidy_ptr<Scratch> s = pool.acquire();
+            first = s.get();
+            s->uses++;
+        }
+        any_tidy_ptr<Scratch> s = pool.acquire();
+        EXPECT_EQ(first, s.get()); // the same one
+        EXPECT_EQ(1, s->uses);     // (not reconstructed)
+        EXPECT_EQ(1, Scratch::alive.load());
+
+        tidy_pool_stats st = pool.stats();
+        EXPECT_EQ(1u, st.misses);
+        EXPECT_EQ(1u, st.hits);
+        EXPECT_EQ(1u, st.returns);
+    }
+    EXPECT_EQ(0, Scratch::alive.load());
+}
+
+TEST(tidy_pool, make_and_reset_hooks)
+{
+    int made = 0;
+    tidy_pool<Scratch> pool(tidy_pool_limits{},
+        [&made] { made++; Scratch * s = new Scratch; s->data.reserve(1000); return s; },
+        [](Scratch & s) { s.data.clear(); });
+    {
+        any_tidy_ptr<Scratch> s = pool.acquire();
+        s->data.assign(500, 17);
+    }
+    any_tidy_ptr<Scratch> s = pool.acquire();
+    EXPECT_EQ(1, made);
+    EXPECT_TRUE(s->data.empty());
+    EXPECT_GE(s->data.capacity(), 1000u); // cleared, but kept its memory
+
+    // a hit doesn't allocate (that's the point)
+    s.reset();
+    auto c = alloc_trace::count([&] {
+        any_tidy_ptr<Scratch> t = pool.acquire();
+        t->data.push_back(1);
+    });
+    EXPECT_EQ(0u, c.allocations);
+}
+
+TEST(tidy_pool, limits)
+{
+    tidy_pool_limits limits;
+    limits.thread_cache = 4;
+    limits.max_idle = 2;
+    {
+        tidy_pool<Scratch> pool(limits);
+        std::vector<any_tidy_ptr<Scratch>> v;
+        for (int i = 0; i < 20; i++)
+            v.push_back(pool.acquire());
+        EXPECT_EQ(20, Scratch::alive.load());
+        v.clear();
+        // at most thread_cache here, and max_idle in the shared list
+        EXPECT_LE(Scratch::alive.load(), 6);
+        tidy_pool_stats st = pool.stats();
+        EXPECT_LE(st.idle, 2u);
+        EXPECT_EQ(20u, st.returns + st.discards);
+        EXPECT_GE(st.discards, 14u);
+
+        pool.trim();
+        EXPECT_EQ(0u, pool.stats().idle);
+    }
+    EXPECT_EQ(0, Scratch::alive.load());
+}
+
+TEST(tidy_pool, cross_thread_return)
+{
+    {
+        tidy_pool<Scratch> pool;
+        std::vector<any_tidy_ptr<Scratch>> v;
+        for (int i = 0; i < 100; i++)
+            v.push_back(pool.acquire());
+        // the consumer returns them all
+        std::thread consumer([&v] { v.clear(); });
+        consumer.join();
+        // (and when it exited, its list went to the shared list)
+
+        for (int i = 0; i < 100; i++)
+            v.push_back(pool.acquire());
+        tidy_pool_stats st = pool.stats();
+        EXPECT_EQ(100u, st.misses);
+        EXPECT_EQ(100u, st.hits);
+        EXPECT_EQ(100, Scratch::alive.load());
+    }
+    EXPECT_EQ(0, Scratch::alive.load());
+}
+
+TEST(tidy_pool, stats_count_live_threads)
+{
+    // (each thread counts its own - stats() has to find them)
+    tidy_pool<Scratch> pool;
+    std::mutex m;
+    std::condition_variable cv;
+    bool used = false, checked = false;
+    std::thread t([&] {
+        pool.acquire().reset();
+        pool.acquire().reset();
+        std::unique_lock<std::mutex> lock(m);
+        used = true;
+        cv.notify_all();
+        cv.wait(lock, [&] { return checked; });
+    });
+    {
+        std::unique_lock<std::mutex> lock(m);
+        cv.wait(lock, [&] { return used; });
+        tidy_pool_stats st = pool.stats();
+        EXPECT_EQ(1u, st.misses);
+        EXPECT_EQ(1u, st.hits);
+        EXPECT_EQ(2u, st.returns);
+        checked = true;
+        cv.notify_all();
+    }
+    t.join();
+    // (and once it has exited, its counts are in the totals)
+    tidy_pool_stats st = pool.stats();
+    EXPECT_EQ(1u, st.misses);
+    EXPECT_EQ(1u, st.hits);
+    EXPECT_EQ(2u, st.returns);
+}
+
+TEST(tidy_pool, threads)
+{
+    {
+        tidy_pool<Scratch> pool;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++)
+            threads.emplace_back([&pool] {
+                std::vector<any_tidy_ptr<Scratch>> held;
+                for (int i = 0; i < 2000; i++)
+                {
+                    held.push_back(pool.acquire());
+                    held.back()->uses++;
+                    if (held.size() > 8)
+                        held.erase(held.begin());
+                }
+            });
+        for (std::thread & t : threads)
+            t.join();
+        tidy_pool_stats st = pool.stats();
+        EXPECT_EQ(8000u, st.hits + st.misses);
+        EXPECT_LT(st.misses, 200u); // mostly reused
+    }
+    EXPECT_EQ(0, Scratch::alive.load());
+}
+
+TEST(tidy_pool, shared_ptr)
+{
+    tidy_pool<Scratch> pool;
+    Scratch * first;
+    {
+        std::shared_ptr<Scratch> sp = pool.acquire_shared();
+        first = sp.get();
+        any_tidy_ptr<Scratch> p(sp); // any_tidy_ptr's shared_ptr constructor
+        sp.reset();
+        EXPECT_EQ(0u, pool.stats().returns); // p still has it
+    }
+    EXPECT_EQ(1u, pool.stats().returns);
+    EXPECT_EQ(first, pool.acquire().get());
+}
+
+TEST(tidy_pool, outlived_by_its_objects)
+{
+    any_tidy_ptr<Scratch> survivor;
+    {
+        tidy_pool<Scratch> pool;
+        survivor = pool.acquire();
+        pool.acquire(); // (returned straight away, so in this thread's list)
+        EXPECT_EQ(2, Scratch::alive.load());
+    }
+    EXPECT_EQ(1, Scratch::alive.load());
+    survivor.reset(); // the pool is gone, so it is deleted
+    EXPECT_EQ(0, Scratch::alive.load());
+}
+
+TEST(tidy_pool, outlived_by_objects_returned_on_other_threads)
+{
+    std::vector<any_tidy_ptr<Scratch>> survivors;
+    {
+        tidy_pool<Scratch> pool;
+        for (int i = 0; i < 400; i++)
+            survivors.push_back(pool.acquire());
+        std::thread early([&] { survivors.erase(survivors.begin(), survivors.begin() + 100); });
+        early.join(); // (those went back into the pool - and that thread's list - while it was still there)
+    }
+    EXPECT_EQ(300, Scratch::alive.load());
+    // the pool's innards stay until the last of them comes back
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 3; t++)
+        threads.emplace_back([&survivors, t] {
+            for (std::size_t i = t; i < survivors.size(); i += 3)
+                survivors[i].reset();
+        });
+    for (std::thread & t : threads)
+        t.join();
+    EXPECT_EQ(0, Scratch::alive.load());
+}
+
+TEST(tidy_pool, two_pools_on_one_thread)
+{
+    // destroying the first pool takes its list out of this thread's lists, which moves the second pool's list over it
+    auto first = std::make_unique<tidy_pool<Scratch>>();
+    auto second = std::make_unique<tidy_pool<Scratch>>();
+    first->acquire();
+    second->acquire();
+    second->acquire();
+    EXPECT_EQ(2, Scratch::alive.load());
+    first.reset();
+    EXPECT_EQ(1, Scratch::alive.load());
+    EXPECT_EQ(1u, second->stats().hits); // (its list still works)
+    second.reset();
+    EXPECT_EQ(0, Scratch::alive.load());
+}
+
+TEST(tidy_pool, make_uses_other_pools)
+{
+    // (using new pools in make() grows this thread's lists - the one acquire() is using has to stay put)
+    std::vector<any_tidy_ptr<Scratch>> others;
+    std::vector<std::unique_ptr<tidy_pool<Scratch>>> pools;
+    tidy_pool<Scratch> pool(tidy_pool_limits{}, [&] {
+        for (int i = 0; i < 20; i++)
+        {
+            pools.push_back(std::make_unique<tidy_pool<Scratch>>());
+            others.push_back(pools.back()->acquire());
+        }
+        return new Scratch;
+    });
+    pool.acquire();
+    EXPECT_EQ(1u, pool.stats().misses);
+    EXPECT_EQ(1u, pool.stats().returns);
+    others.clear();
+    pools.clear();
+}
+
+TEST(tidy_pool, returned_after_threads_lists_are_gone)
+{
+    tidy_pool<Scratch> pool;
+    std::thread t([&pool] {
+        // constructed before this thread's pool lists, so destroyed after them
+        static thread_local any_tidy_ptr<Scratch> late;
+        late = pool.acquire();
+    });
+    t.join();
+    EXPECT_EQ(1, Scratch::alive.load());
+    tidy_pool_stats st = pool.stats();
+    EXPECT_EQ(1u, st.returns);
+    EXPECT_EQ(1u, st.idle); // (straight to the shared list)
+}
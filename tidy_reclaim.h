@@ -0,0 +1,279 @@
+#ifndef tidy_reclaim_h_INCLUDED
+#define tidy_reclaim_h_INCLUDED
+
+#include "any_tidy_ptr.h"
+#include "unique_function.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//
+// Deferred (and batched) deleting, for deleters that are too slow to run on a latency-critical thread -
+// freeing big image buffers, munmap, dropping the last reference to a shared_ptr...
+//
+// Instead of running the deleter, the thread adds it to its own batch (no lock, and no allocation -
+// the batch is a reused vector of unique_functions, and an any_tidy_ptr fits inside one),
+// and every batch_size deleters the batch is handed (one lock) to a background thread that runs them.
+//
+//    tidy_reclaim::retire(std::move(frame.pixels));                 // this any_tidy_ptr gets deleted later, elsewhere
+//
+//    any_tidy_ptr<Tile> t(p, tidy_reclaim::deferred(unmapTile));    // this one is *always* deleted later, elsewhere
+//
+//    tidy_reclaim::quiesce();                                       // (tests, shutdown) wait until everything handed over is gone
+//
+// A partial batch stays with its thread until the batch fills, the thread calls flush() (or quiesce()), or the thread exits.
+// So a thread that retires a few things and then goes idle should flush().
+// Anything deferred by a deleter that is running on the background thread just runs (there's no one to hand it to).
+// Deleters must not throw (they are run like destructors).
+// There is one background thread per process; it starts on first use and is stopped (after draining) at exit.
+// (Deleters deferred after that - from a static's destructor, say - are run right there, on the deferring thread.
+// Same for a thread_local's destructor that runs after its thread's batch is gone.)
+//
+namespace tidy_reclaim
+{
+    using batch = std::vector<unique_function<void()>>;
+
+    struct stats
+    {
+        std::uint64_t handed_over = 0; // deleters handed to the background thread
+        std::uint64_t reclaimed = 0;   // ...and run by it
+        std::uint64_t batches = 0;     // how many handovers
+    };
+
+    namespace detail
+    {
+        struct Reclaimer
+        {
+            std::mutex m;
+            std::condition_variable work;
+            std::condition_variable done;
+            std::vector<batch> queue;
+            std::vector<batch> spares; // emptied batches, for threads to refill (so they don't allocate)
+            stats counts;
+            std::uint64_t batches_done = 0;
+            bool stopping = false;
+            std::atomic<std::size_t> batch_size{ 64 };
+            std::thread worker;
+
+            static bool & on_worker()
+            {
+                static thread_local bool is_worker = false;
+                return is_worker;
+            }
+
+            void run()
+            {
+                on_worker() = true;
+                std::vector<batch> todo; // (swapped with queue, so neither ever needs to grow again)
+                std::unique_lock<std::mutex> lock(m);
+                for (;;)
+                {
+                    work.wait(lock, [this] { return stopping || !queue.empty(); });
+                    if (queue.empty())
+                        return; // (stopping)
+                    todo.swap(queue);
+                    lock.unlock();
+                    std::size_t n = 0;
+                    for (batch & b : todo)
+                    {
+                        for (auto & f : b)
+                            f();
+                        n += b.size();
+                        b.clear();
+                    }
+                    lock.lock();
+                    for (batch & b : todo)
+                        spares.push_back(std::move(b));
+                    counts.reclaimed += n;
+                    batches_done += todo.size();
+                    todo.clear();
+                    done.notify_all();
+                }
+            }
+
+            // takes b (and gives back an empty one, with room)
+            void hand_over(batch & b)
+            {
+                std::unique_lock<std::mutex> lock(m);
+                if (stopping)
+                {
+                    // we're past stop() (a static's destructor, or a thread exiting late) - there's no worker anymore,
+                    // and starting one now would leave it running past exit. So just run them here.
+                    counts.handed_over += b.size();
+                    counts.batches++;
+                    lock.unlock();
+                    bool const was_worker = on_worker();
+                    on_worker() = true; // (anything they defer runs straight away too)
+                    for (auto & f : b)
+                        f();
+                    on_worker() = was_worker;
+                    lock.lock();
+                    counts.reclaimed += b.size();
+                    batches_done++;
+                    b.clear();
+                    return;
+                }
+                if (!worker.joinable())
+                    worker = std::thread([this] { run(); });
+                counts.handed_over += b.size();
+                counts.batches++;
+                queue.push_back(std::move(b));
+                b = batch();
+                if (!spares.empty())
+                {
+                    b = std::move(spares.back());
+                    spares.pop_back();
+                }
+                work.notify_one();
+            }
+
+            void wait_for_all()
+            {
+                std::unique_lock<std::mutex> lock(m);
+                std::uint64_t target = counts.batches;
+                done.wait(lock, [&] { return batches_done >= target; });
+            }
+
+            // drains, and stops the worker (for good)
+            void stop()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m);
+                    stopping = true;
+                    work.notify_one();
+                }
+                if (worker.joinable())
+                    worker.join();
+            }
+            ~Reclaimer()
+            {
+                stop();
+            }
+        };
+
+        struct Stopper
+        {
+            Reclaimer & r;
+            ~Stopper() { r.stop(); }
+        };
+
+        inline Reclaimer & reclaimer()
+        {
+            // never destroyed - statics destroyed after it are still allowed to retire things - just stopped, at exit
+            static Reclaimer & r = *new Reclaimer;
+            static Stopper stopper{ r };
+            return r;
+        }
+
+        // set (for good) when this thread's batch is destroyed - a thread_local destroyed after it
+        // (or a static, for the main thread) can still be deferring
+        inline bool & batch_gone()
+        {
+            static thread_local bool gone = false;
+            return gone;
+        }
+
+        struct ThreadBatch
+        {
+            Reclaimer & owner = reclaimer(); // (so the reclaimer is stopped after main's batch is handed over)
+            batch items;
+
+            void flush()
+            {
+                if (!items.empty())
+                    owner.hand_over(items);
+            }
+            ~ThreadBatch()
+            {
+                flush();
+                batch_gone() = true;
+            }
+        };
+
+        // null once this thread's batch is gone
+        inline ThreadBatch * this_thread()
+        {
+            if (batch_gone())
+                return nullptr;
+            static thread_local ThreadBatch b;
+            return &b;
+        }
+    }
+
+    // runs f later, on the background thread
+    inline void defer(unique_function<void()> f)
+    {
+        detail::ThreadBatch * b = detail::Reclaimer::on_worker() ? nullptr : detail::this_thread();
+        if (!b)
+        {
+            f(); // (on the worker, or this thread is exiting)
+            return;
+        }
+        std::size_t size = b->owner.batch_size.load(std::memory_order_relaxed);
+        if (b->items.capacity() < size)
+            b->items.reserve(size);
+        b->items.push_back(std::move(f));
+        if (b->items.size() >= size)
+            b->owner.hand_over(b->items);
+    }
+
+    // deletes p later, on the background thread
+    template <typename T>
+    void retire(any_tidy_ptr<T> && p)
+    {
+        if (p)
+            defer([p = std::move(p)]() mutable { p.reset(); });
+    }
+
+    // a deleter that passes the pointer on to a copy of d - later, on the background thread
+    // (the deleter can run more than once - ie after reset(new T) - so each run gets its own copy)
+    // (d needs to be small - up to a pointer or so - for this to fit in tidy_deleter without allocating)
+    template <typename D>
+    auto deferred(D d)
+    {
+        static_assert(std::is_copy_constructible_v<D>, "deferred deleters are copied into each deferred job");
+        return [d = std::move(d)](auto * p) {
+            defer([d, p]() mutable { d(p); });
+        };
+    }
+
+    // hands this thread's partial batch to the background thread
+    inline void flush()
+    {
+        if (detail::ThreadBatch * b = detail::this_thread())
+            b->flush();
+    }
+
+    // flush(), then wait until everything handed over so far (by any thread) has been deleted
+    // (from a deleter running on the background thread, it just returns - the batches before this one are already done,
+    // and waiting for this one would be waiting for itself)
+    inline void quiesce()
+    {
+        if (detail::Reclaimer::on_worker())
+            return;
+        flush();
+        detail::reclaimer().wait_for_all();
+    }
+
+    // how many deleters to collect before handing them over (default 64)
+    inline void set_batch_size(std::size_t n)
+    {
+        detail::reclaimer().batch_size.store(n ? n : 1, std::memory_order_relaxed);
+    }
+
+    inline stats counts()
+    {
+        detail::Reclaimer & r = detail::reclaimer();
+        std::lock_guard<std::mutex> lock(r.m);
+        return r.counts;
+    }
+}
+
+#endif // _h
@@ -0,0 +1,203 @@
+#include "tidy_reclaim.h"
+#include "alloc_trace.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// link with alloc_trace.cpp
+
+namespace
+{
+    std::atomic<int> deleted{ 0 };
+    std::atomic<bool> deleted_elsewhere{ true };
+    std::thread::id test_thread;
+
+    struct Tracked
+    {
+        ~Tracked()
+        {
+            deleted++;
+            if (std::this_thread::get_id() == test_thread)
+                deleted_elsewhere = false;
+        }
+    };
+
+    void reset_tracking()
+    {
+        tidy_reclaim::quiesce();
+        deleted = 0;
+        deleted_elsewhere = true;
+        test_thread = std::this_thread::get_id();
+    }
+}
+
+TEST(tidy_reclaim, retire_deletes_on_the_background_thread)
+{
+    reset_tracking();
+    for (int i = 0; i < 10; i++)
+        tidy_reclaim::retire(any_tidy_ptr<Tracked>(new Tracked));
+    tidy_reclaim::quiesce();
+    EXPECT_EQ(10, deleted.load());
+    EXPECT_TRUE(deleted_elsewhere.load());
+}
+
+TEST(tidy_reclaim, batches)
+{
+    reset_tracking();
+    tidy_reclaim::set_batch_size(4);
+    auto before = tidy_reclaim::counts();
+    for (int i = 0; i < 3; i++)
+        tidy_reclaim::retire(any_tidy_ptr<Tracked>(new Tracked));
+    EXPECT_EQ(before.batches, tidy_reclaim::counts().batches); // still in this thread's batch
+    EXPECT_EQ(0, deleted.load());
+
+    tidy_reclaim::retire(any_tidy_ptr<Tracked>(new Tracked));
+    auto after = tidy_reclaim::counts();
+    EXPECT_EQ(before.batches + 1, after.batches);
+    EXPECT_EQ(before.handed_over + 4, after.handed_over);
+
+    tidy_reclaim::retire(any_tidy_ptr<Tracked>(new Tracked));
+    tidy_reclaim::quiesce(); // (hands over the partial batch too)
+    EXPECT_EQ(5, deleted.load());
+    EXPECT_EQ(after.handed_over + 1, tidy_reclaim::counts().reclaimed);
+    tidy_reclaim::set_batch_size(64);
+}
+
+TEST(tidy_reclaim, deferred_deleter)
+{
+    reset_tracking();
+    {
+        any_tidy_ptr<Tracked> p(new Tracked, tidy_reclaim::deferred(std::default_delete<Tracked>()));
+        any_tidy_ptr<Tracked[]> a(new Tracked[3], tidy_reclaim::deferred([](Tracked * t) { delete[] t; }));
+    }
+    EXPECT_EQ(0, deleted.load());
+    tidy_reclaim::quiesce();
+    EXPECT_EQ(4, deleted.load());
+    EXPECT_TRUE(deleted_elsewhere.load());
+}
+
+TEST(tidy_reclaim, stateful_deferred_deleter_runs_more_than_once)
+{
+    reset_tracking();
+    auto calls = std::make_shared<std::atomic<int>>(0);
+    {
+        any_tidy_ptr<Tracked> p(new Tracked, tidy_reclaim::deferred([calls](Tracked * t) { ++*calls; delete t; }));
+        p.reset(new Tracked);
+        p.reset(new Tracked);
+        p.reset();
+    }
+    tidy_reclaim::quiesce();
+    EXPECT_EQ(3, calls->load());
+    EXPECT_EQ(3, deleted.load());
+    EXPECT_TRUE(deleted_elsewhere.load());
+}
+
+TEST(tidy_reclaim, quiesce_from_a_deleter)
+{
+    reset_tracking();
+    std::atomic<bool> ran{ false };
+    tidy_reclaim::defer([&ran] {
+        tidy_reclaim::quiesce(); // (on the background thread - mustn't wait for itself)
+        ran = true;
+    });
+    tidy_reclaim::quiesce();
+    EXPECT_TRUE(ran.load());
+}
+
+TEST(tidy_reclaim, shared_ptr_last_reference)
+{
+    reset_tracking();
+    std::shared_ptr<Tracked> sp = std::make_shared<Tracked>();
+    any_tidy_ptr<Tracked> p(sp);
+    sp.reset();
+    tidy_reclaim::retire(std::move(p));
+    tidy_reclaim::quiesce();
+    EXPECT_EQ(1, deleted.load());
+    EXPECT_TRUE(deleted_elsewhere.load());
+}
+
+TEST(tidy_reclaim, retiring_doesnt_touch_the_heap)
+{
+    reset_tracking();
+    tidy_reclaim::set_batch_size(8);
+    // warm up (the batch and the background thread's queue get their memory)
+    for (int i = 0; i < 32; i++)
+        tidy_reclaim::retire(any_tidy_ptr<Tracked>(new Tracked));
+    tidy_reclaim::quiesce();
+    // (quiesce handed over the whole batch, so this thread's next retire() would start a new one)
+    tidy_reclaim::retire(any_tidy_ptr<Tracked>(new Tracked));
+
+    std::vector<any_tidy_ptr<Tracked>> ptrs;
+    for (int i = 0; i < 8; i++)
+        ptrs.emplace_back(new Tracked);
+    auto c = alloc_trace::count([&] {
+        for (auto & p : ptrs)
+            tidy_reclaim::retire(std::move(p));
+    });
+    EXPECT_EQ(0u, c.allocations);
+    EXPECT_EQ(0u, c.deallocations); // the Trackeds were freed elsewhere
+    tidy_reclaim::quiesce();
+    EXPECT_EQ(41, deleted.load());
+    tidy_reclaim::set_batch_size(64);
+}
+
+TEST(tidy_reclaim, thread_exit_hands_over)
+{
+    reset_tracking();
+    std::thread t([] {
+        tidy_reclaim::retire(any_tidy_ptr<Tracked>(new Tracked));
+    });
+    t.join();
+    tidy_reclaim::quiesce();
+    EXPECT_EQ(1, deleted.load());
+}
+
+TEST(tidy_reclaim, handed_over_after_stopping_runs_right_there)
+{
+    // (what happens at exit, to deleters retired by a static's destructor)
+    reset_tracking();
+    tidy_reclaim::detail::Reclaimer r;
+    r.stop();
+    tidy_reclaim::batch b;
+    b.push_back([p = any_tidy_ptr<Tracked>(new Tracked)]() mutable { p.reset(); });
+    r.hand_over(b);
+    EXPECT_EQ(1, deleted.load());
+    EXPECT_FALSE(deleted_elsewhere.load());
+    EXPECT_FALSE(r.worker.joinable()); // (no worker started)
+    EXPECT_TRUE(b.empty());
+    EXPECT_EQ(1u, r.counts.reclaimed);
+    r.wait_for_all(); // (doesn't wait forever)
+}
+
+namespace
+{
+    std::thread::id late_ran_on;
+
+    struct DefersWhenDestroyed
+    {
+        ~DefersWhenDestroyed()
+        {
+            tidy_reclaim::defer([] { late_ran_on = std::this_thread::get_id(); });
+        }
+    };
+}
+
+TEST(tidy_reclaim, deferred_after_the_threads_batch_is_gone)
+{
+    reset_tracking();
+    std::thread t([] {
+        // constructed before this thread's batch, so destroyed after it
+        static thread_local DefersWhenDestroyed late;
+        (void)late;
+        tidy_reclaim::retire(any_tidy_ptr<Tracked>(new Tracked));
+    });
+    std::thread::id exiting = t.get_id();
+    t.join();
+    EXPECT_EQ(exiting, late_ran_on); // it ran right there, on the exiting thread
+    tidy_reclaim::quiesce();
+    EXPECT_EQ(1, deleted.load());
+}
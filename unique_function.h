@@ -0,0 +1,152 @@
+#ifndef unique_function_h_INCLUDED
+#define unique_function_h_INCLUDED
+
+#include "any_movable.h"
+
+#include <functional> // std::invoke, bad_function_call
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+
+//
+// Like std::function, but move-only - so it can hold move-only callables
+// (ie lambdas that capture a unique_ptr or an any_tidy_ptr) without wrapping them in a shared_ptr.
+//
+// It is just a nothrow_any_movable (an any_movable - which was sized to match std::function's buffer anyway -
+// that only holds inline what moves without throwing) plus a pointer to the function that calls what it holds.
+// So calling is one indirect call, and small callables (that can move without throwing) don't allocate.
+// Moves never throw, so std::vector<unique_function<...>> moves (doesn't copy) when it grows.
+//
+// Like std::function, calling an empty one throws std::bad_function_call,
+// and operator() is const even though the callable might not be.
+//
+template <typename Signature>
+class unique_function;
+
+template <typename R, typename ...Args>
+class unique_function<R(Args...)>
+{
+    mutable nothrow_any_movable callable;
+    R (*invoker)(void *, Args &&...) = &throw_empty;
+
+    static R throw_empty(void *, Args &&...)
+    {
+        throw std::bad_function_call();
+    }
+    template <typename F>
+    static R invoke(void * f, Args &&... args)
+    {
+        if constexpr (std::is_void_v<R>)
+            std::invoke(*static_cast<F *>(f), std::forward<Args>(args)...);
+        else
+            return std::invoke(*static_cast<F *>(f), std::forward<Args>(args)...);
+    }
+
+    template <typename F>
+    static bool is_null(F const & f)
+    {
+        if constexpr (std::is_pointer_v<F> || std::is_member_pointer_v<F>)
+            return f == nullptr;
+        else
+            return false;
+    }
+
+    template <typename F>
+    using enable_if_callable = std::enable_if_t<
+        !std::is_same_v<std::decay_t<F>, unique_function>
+        && std::is_invocable_r_v<R, std::decay_t<F> &, Args...>>;
+
+public:
+    using result_type = R;
+
+    unique_function() noexcept = default;
+    unique_function(std::nullptr_t) noexcept
+    {
+    }
+
+    template <typename F, typename = enable_if_callable<F>>
+    unique_function(F && f)
+    {
+        using DF = std::decay_t<F>;
+        if (is_null(f))
+            return;
+        callable.emplace<DF>(std::forward<F>(f));
+        invoker = &invoke<DF>;
+    }
+
+    unique_function(unique_function && other) noexcept
+        : callable(std::move(other.callable)), invoker(other.invoker)
+    {
+        other.invoker = &throw_empty;
+    }
+    unique_function & operator=(unique_function && other) noexcept
+    {
+        if (this != &other)
+        {
+            callable = std::move(other.callable);
+            invoker = other.invoker;
+            other.invoker = &throw_empty;
+        }
+        return *this;
+    }
+    unique_function & operator=(std::nullptr_t) noexcept
+    {
+        reset();
+        return *this;
+    }
+    template <typename F, typename = enable_if_callable<F>>
+    unique_function & operator=(F && f)
+    {
+        return *this = unique_function(std::forward<F>(f));
+    }
+
+    unique_function(unique_function const &) = delete;
+    unique_function & operator=(unique_function const &) = delete;
+
+    void reset() noexcept
+    {
+        callable.reset();
+        invoker = &throw_empty;
+    }
+
+    explicit operator bool() const noexcept
+    {
+        return callable.has_value();
+    }
+
+    R operator()(Args... args) const
+    {
+        return invoker(callable.data(), std::forward<Args>(args)...);
+    }
+
+    std::type_info const & target_type() const noexcept
+    {
+        return callable.type();
+    }
+    template <typename F>
+    F * target() noexcept
+    {
+        return callable.access_ptr<F>();
+    }
+    template <typename F>
+    F const * target() const noexcept
+    {
+        return callable.access_ptr<F>();
+    }
+
+    void swap(unique_function & other) noexcept
+    {
+        std::swap(*this, other);
+    }
+    friend void swap(unique_function & a, unique_function & b) noexcept
+    {
+        a.swap(b);
+    }
+
+    friend bool operator==(unique_function const & f, std::nullptr_t) noexcept { return !f; }
+    friend bool operator==(std::nullptr_t, unique_function const & f) noexcept { return !f; }
+    friend bool operator!=(unique_function const & f, std::nullptr_t) noexcept { return !!f; }
+    friend bool operator!=(std::nullptr_t, unique_function const & f) noexcept { return !!f; }
+};
+
+#endif // _h
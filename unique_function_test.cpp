@@ -0,0 +1,146 @@
+#include "unique_function.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <type_traits>
+
+namespace
+{
+    int add(int a, int b) { return a + b; }
+
+    struct Counted
+    {
+        static int copies;
+        static int moves;
+        Counted() = default;
+        Counted(Counted const &) { copies++; }
+        Counted(Counted &&) noexcept { moves++; }
+        int operator()() const { return 17; }
+    };
+    int Counted::copies = 0;
+    int Counted::moves = 0;
+}
+
+TEST(unique_function, default_is_empty)
+{
+    unique_function<void()> f;
+    EXPECT_FALSE(f);
+    EXPECT_TRUE(f == nullptr);
+    EXPECT_THROW(f(), std::bad_function_call);
+}
+
+TEST(unique_function, holds_function_pointer)
+{
+    unique_function<int(int, int)> f = add;
+    EXPECT_TRUE(f);
+    EXPECT_EQ(5, f(2, 3));
+}
+
+TEST(unique_function, null_function_pointer_is_empty)
+{
+    int (*p)(int, int) = nullptr;
+    unique_function<int(int, int)> f = p;
+    EXPECT_FALSE(f);
+}
+
+TEST(unique_function, holds_move_only_lambda)
+{
+    auto p = std::make_unique<int>(17);
+    unique_function<int()> f = [p = std::move(p)] { return *p; };
+    EXPECT_EQ(17, f());
+
+    unique_function<int()> g = std::move(f);
+    EXPECT_FALSE(f);
+    EXPECT_EQ(17, g());
+}
+
+TEST(unique_function, mutable_lambda)
+{
+    unique_function<int()> f = [n = 0]() mutable { return ++n; };
+    EXPECT_EQ(1, f());
+    EXPECT_EQ(2, f());
+}
+
+TEST(unique_function, forwards_args)
+{
+    unique_function<std::unique_ptr<int>(std::unique_ptr<int>)> f = [](std::unique_ptr<int> p) { (*p)++; return p; };
+    auto r = f(std::make_unique<int>(16));
+    EXPECT_EQ(17, *r);
+
+    unique_function<void(std::string &)> g = [](std::string & s) { s += "!"; };
+    std::string s = "hi";
+    g(s);
+    EXPECT_EQ("hi!", s);
+}
+
+TEST(unique_function, converts_return_type)
+{
+    unique_function<double()> f = [] { return 17; };
+    EXPECT_EQ(17.0, f());
+
+    unique_function<void()> g = [] { return 17; }; // result discarded
+    g();
+}
+
+TEST(unique_function, member_pointer)
+{
+    struct S { int x = 17; int get() const { return x; } };
+    unique_function<int(S const &)> f = &S::get;
+    EXPECT_EQ(17, f(S()));
+}
+
+TEST(unique_function, target)
+{
+    unique_function<int()> f = Counted();
+    EXPECT_EQ(typeid(Counted), f.target_type());
+    EXPECT_NE(nullptr, f.target<Counted>());
+    EXPECT_EQ(nullptr, f.target<int>());
+}
+
+TEST(unique_function, moves_are_noexcept)
+{
+    static_assert(std::is_nothrow_move_constructible_v<unique_function<void()>>);
+    static_assert(std::is_nothrow_move_assignable_v<unique_function<void()>>);
+    static_assert(!std::is_copy_constructible_v<unique_function<void()>>);
+}
+
+TEST(unique_function, vector_growth_never_copies)
+{
+    Counted::copies = 0;
+    std::vector<unique_function<int()>> v;
+    for (int i = 0; i < 100; i++)
+        v.push_back(Counted());
+    EXPECT_EQ(0, Counted::copies);
+    for (auto & f : v)
+        EXPECT_EQ(17, f());
+}
+
+TEST(unique_function, big_callables_work)
+{
+    char big[1000] = { 17 };
+    unique_function<int()> f = [big] { return big[0]; };
+    unique_function<int()> g = std::move(f);
+    EXPECT_EQ(17, g());
+}
+
+TEST(unique_function, reset_and_nullptr_assign)
+{
+    auto p = std::make_shared<int>(17);
+    unique_function<int()> f = [p] { return *p; };
+    EXPECT_EQ(2, p.use_count());
+    f = nullptr;
+    EXPECT_FALSE(f);
+    EXPECT_EQ(1, p.use_count());
+}
+
+TEST(unique_function, swap)
+{
+    unique_function<int()> f = [] { return 1; };
+    unique_function<int()> g = [] { return 2; };
+    swap(f, g);
+    EXPECT_EQ(2, f());
+    EXPECT_EQ(1, g());
+}